@@ -0,0 +1,365 @@
+// Benchmarks for every stage of the pipeline, in the spirit of Google
+// Benchmark but with no dependency beyond the petukh library:
+//   - Lexer, Parser, SemanticAnalyzer, RPNGenerator on generated sources of
+//     N functions (tokens/s, POLIZ instructions/s)
+//   - VM::Run on generated loop and call workloads of size N
+//   - the ackermann, segment_tree and sqrt examples, end to end
+// In a PETUKH_PROFILE build the VM benchmarks also report executed
+// instructions/s; the profiler's hook then adds to the time measured.
+//
+// usage: PetukhBench [--filter <substring>] [--min-time <seconds>]
+//                    [--scale <k>] [--examples <dir>]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "api/Compiler.h"
+#include "lexer/Lexer.h"
+#include "parser/AST.h"
+#include "parser/Parser.h"
+#include "rpn/RPNGenerator.h"
+#include "semantics/SemanticAnalyzer.h"
+#include "vm/VM.h"
+
+#ifndef PETUKH_EXAMPLES_DIR
+#define PETUKH_EXAMPLES_DIR "examples"
+#endif
+
+namespace {
+
+double g_minTime = 0.5;
+
+// Per-iteration amounts, reported as rates over the measured time.
+struct Counters {
+  std::vector<std::pair<std::string, double>> perIteration;
+
+  void Set(const std::string &name, double value) {
+    for (auto &c : perIteration)
+      if (c.first == name) { c.second = value; return; }
+    perIteration.emplace_back(name, value);
+  }
+};
+
+struct Benchmark {
+  std::string name;
+  // sets up, then calls the iteration body as often as it is asked to run
+  std::function<void(Counters &, const std::function<void(const std::function<void()> &)> &)> fn;
+};
+
+std::string Human(double v) {
+  const char *suffix[] = {"", "k", "M", "G", "T"};
+  int i = 0;
+  while (v >= 1000.0 && i < 4) { v /= 1000.0; ++i; }
+  std::ostringstream s;
+  s << std::fixed << std::setprecision(v < 10 ? 2 : v < 100 ? 1 : 0) << v << suffix[i];
+  return s.str();
+}
+
+std::string Duration(double seconds) {
+  std::ostringstream s;
+  s << std::fixed << std::setprecision(3);
+  if (seconds < 1e-3) s << seconds * 1e6 << " us";
+  else if (seconds < 1.0) s << seconds * 1e3 << " ms";
+  else s << seconds << " s";
+  return s.str();
+}
+
+void RunBenchmark(const Benchmark &b) {
+  Counters counters;
+  double seconds = 0.0;
+  uint64_t iterations = 0;
+
+  b.fn(counters, [&](const std::function<void()> &body) {
+    body();  // warm-up, also fills in the counters
+    using Clock = std::chrono::steady_clock;
+    uint64_t batch = 1;
+    while (true) {
+      auto start = Clock::now();
+      for (uint64_t i = 0; i < batch; ++i)
+        body();
+      double t = std::chrono::duration<double>(Clock::now() - start).count();
+      if (t >= g_minTime || batch >= (1ull << 30)) {
+        seconds = t;
+        iterations = batch;
+        return;
+      }
+      // aim a little past the minimum so the next batch is the last one
+      batch = t > 0 ? std::max(batch * 2, static_cast<uint64_t>(static_cast<double>(batch) * g_minTime * 1.4 / t))
+                    : batch * 10;
+    }
+  });
+
+  double perIter = iterations ? seconds / static_cast<double>(iterations) : 0.0;
+  std::cout << std::left << std::setw(32) << b.name << std::right << std::setw(14) << Duration(perIter)
+            << std::setw(12) << iterations;
+  for (const auto &[name, value] : counters.perIteration)
+    std::cout << "  " << name << "=" << Human(perIter > 0 ? value / perIter : 0.0);
+  std::cout << "\n";
+}
+
+// ---------------- workloads ----------------
+
+// N functions touching every construct the front end knows: declarations,
+// arrays, for / while / if-else, calls, int and double arithmetic, strings.
+std::string GenerateSource(int functions) {
+  std::ostringstream s;
+  for (int i = 0; i < functions; ++i) {
+    s << "fn int f" << i << "(int a, int b) {\n"
+      << "    int c = a * " << (i % 97 + 1) << " + b;\n"
+      << "    double d = 0.5;\n"
+      << "    string tag = \"f" << i << "\";\n"
+      << "    int arr[8];\n"
+      << "    for (int j = 0; j < 8; j = j + 1) {\n"
+      << "        arr[j] = c + j * 3;\n"
+      << "        if (arr[j] % 2 == 0) {\n"
+      << "            c = c + arr[j] / 2;\n"
+      << "        } else {\n"
+      << "            c = c - 1;\n"
+      << "        }\n"
+      << "        d = d * 1.5 + j;\n"
+      << "    }\n"
+      << "    while (c > 1000) {\n"
+      << "        c = c / 3;\n"
+      << "    }\n";
+    if (i > 0) s << "    c = c + f" << i - 1 << "(b, a);\n";
+    s << "    return c;\n"
+      << "}\n\n";
+  }
+  s << "fn int main() {\n"
+    << "    printInt(f" << functions - 1 << "(1, 2));\n"
+    << "}\n";
+  return s.str();
+}
+
+const char *kLoopProgram = R"(fn int main() {
+    int n = inputInt();
+    int a[1024];
+    int s = 0;
+    for (int i = 0; i < n; i = i + 1) {
+        a[i % 1024] = a[(i * 7) % 1024] + i;
+        s = s + a[i % 1024] % 1000;
+    }
+    printInt(s);
+}
+)";
+
+const char *kCallProgram = R"(fn int fib(int n) {
+    if (n < 2) {
+        return n;
+    }
+    return fib(n - 1) + fib(n - 2);
+}
+
+fn int main() {
+    printInt(fib(inputInt()));
+}
+)";
+
+size_t CountTokens(const std::string &source) {
+  return Lexer(source).Tokenize().size();
+}
+
+std::shared_ptr<const CompiledModule> CompileOrDie(const std::string &source, const std::string &what) {
+  CompileResult r = Compile(source);
+  if (!r.Ok()) {
+    std::cerr << what << ": compilation failed\n";
+    for (const auto &e : r.syntaxErrors) std::cerr << "  " << e << "\n";
+    for (const auto &e : r.semanticErrors) std::cerr << "  " << e << "\n";
+    std::exit(1);
+  }
+  return r.module;
+}
+
+// A file the VM reads its input from; rewound before every run.
+class InputFile {
+ public:
+  explicit InputFile(const std::string &text) {
+    char path[] = "/tmp/petukh-bench-XXXXXX";
+    fd_ = mkstemp(path);
+    if (fd_ < 0) { std::perror("mkstemp"); std::exit(1); }
+    unlink(path);
+    if (write(fd_, text.data(), text.size()) != static_cast<ssize_t>(text.size())) {
+      std::perror("write");
+      std::exit(1);
+    }
+  }
+  ~InputFile() { close(fd_); }
+  int Rewind() const { lseek(fd_, 0, SEEK_SET); return fd_; }
+
+ private:
+  int fd_ = -1;
+};
+
+void RunVM(const std::shared_ptr<const CompiledModule> &module, const std::string &input,
+           Counters &counters, const std::function<void(const std::function<void()> &)> &run) {
+  InputFile in(input);
+  int devnull = open("/dev/null", O_WRONLY);
+  VM vm(module);
+  run([&] {
+    vm.SetIO(in.Rewind(), devnull);
+    vm.Run();
+#if PETUKH_PROFILE
+    counters.Set("instr/s", static_cast<double>(vm.Profile().Instructions()));
+#endif
+  });
+  vm.SetIO(0, 1);
+  close(devnull);
+  (void)counters;
+}
+
+std::string ReadFile(const std::string &path) {
+  std::ifstream f(path);
+  if (!f.is_open()) {
+    std::cerr << "cannot open " << path << " (pass --examples <dir>)\n";
+    std::exit(1);
+  }
+  std::stringstream s;
+  s << f.rdbuf();
+  return s.str();
+}
+
+std::string SegmentTreeInput(int n, int queries) {
+  std::mt19937 rng(12345);
+  std::ostringstream s;
+  s << n << "\n";
+  for (int i = 0; i < n; ++i)
+    s << static_cast<int>(rng() % 2001) - 1000 << "\n";
+  s << queries << "\n";
+  for (int i = 0; i < queries; ++i) {
+    int l = static_cast<int>(rng() % n) + 1, r = static_cast<int>(rng() % n) + 1;
+    if (rng() % 2) s << "1 " << std::min(l, r) << " " << std::max(l, r) << "\n";
+    else s << "2 " << l << " " << static_cast<int>(rng() % 2001) - 1000 << "\n";
+  }
+  return s.str();
+}
+
+std::vector<Benchmark> AllBenchmarks(int scale, const std::string &examples) {
+  std::vector<Benchmark> out;
+
+  for (int n : {100 * scale, 1000 * scale, 10000 * scale}) {
+    std::string suffix = "/" + std::to_string(n);
+
+    out.push_back({"Lexer::Tokenize" + suffix, [n](Counters &c, auto run) {
+      std::string source = GenerateSource(n);
+      run([&] {
+        auto tokens = Lexer(source).Tokenize();
+        c.Set("tokens/s", static_cast<double>(tokens.size()));
+        c.Set("bytes/s", static_cast<double>(source.size()));
+      });
+    }});
+
+    // tokens are streamed into the parser, so this includes the lexer
+    out.push_back({"Parser::ParseProgram" + suffix, [n](Counters &c, auto run) {
+      std::string source = GenerateSource(n);
+      c.Set("tokens/s", static_cast<double>(CountTokens(source)));
+      run([&] {
+        ASTArena arena;
+        Lexer lexer(source);
+        Parser parser(lexer, arena);
+        parser.ParseProgram();
+      });
+    }});
+
+    out.push_back({"SemanticAnalyzer::Analyze" + suffix, [n](Counters &c, auto run) {
+      std::string source = GenerateSource(n);
+      c.Set("tokens/s", static_cast<double>(CountTokens(source)));
+      ASTArena arena;
+      Lexer lexer(source);
+      Parser parser(lexer, arena);
+      ASTNode *root = parser.ParseProgram();
+      run([&] {
+        SemanticAnalyzer sema;
+        sema.Analyze(root);
+      });
+    }});
+
+    out.push_back({"RPNGenerator::Generate" + suffix, [n](Counters &c, auto run) {
+      std::string source = GenerateSource(n);
+      ASTArena arena;
+      Lexer lexer(source);
+      Parser parser(lexer, arena);
+      ASTNode *root = parser.ParseProgram();
+      SemanticAnalyzer sema;
+      sema.Analyze(root);
+      run([&] {
+        RPNGenerator generator;
+        auto poliz = generator.Generate(root, &sema.GetExprTypes());
+        c.Set("instr/s", static_cast<double>(poliz.size()));
+      });
+    }});
+  }
+
+  for (int n : {10000 * scale, 100000 * scale, 1000000 * scale}) {
+    out.push_back({"VM::Run/loop/" + std::to_string(n), [n](Counters &c, auto run) {
+      auto module = CompileOrDie(kLoopProgram, "loop");
+      c.Set("iter/s", n);
+      RunVM(module, std::to_string(n), c, run);
+    }});
+  }
+  for (int n : {15, 20, 25}) {
+    out.push_back({"VM::Run/fib/" + std::to_string(n), [n](Counters &c, auto run) {
+      auto module = CompileOrDie(kCallProgram, "fib");
+      RunVM(module, std::to_string(n), c, run);
+    }});
+  }
+
+  // the examples, compiled once and run on fixed inputs
+  out.push_back({"Example/ackermann", [examples](Counters &c, auto run) {
+    auto module = CompileOrDie(ReadFile(examples + "/ackermann.petukh"), "ackermann");
+    RunVM(module, "6 3\n", c, run);  // ackermann(3, 6)
+  }});
+  out.push_back({"Example/segment_tree", [examples, scale](Counters &c, auto run) {
+    auto module = CompileOrDie(ReadFile(examples + "/segment_tree.petukh"), "segment_tree");
+    int queries = 20000 * scale;
+    c.Set("queries/s", queries);
+    RunVM(module, SegmentTreeInput(2000 * scale, queries), c, run);
+  }});
+  out.push_back({"Example/sqrt", [examples](Counters &c, auto run) {
+    auto module = CompileOrDie(ReadFile(examples + "/sqrt.petukh"), "sqrt");
+    RunVM(module, "123456789.0\n", c, run);
+  }});
+
+  return out;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  std::string filter;
+  std::string examples = PETUKH_EXAMPLES_DIR;
+  int scale = 1;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--filter" && i + 1 < argc) filter = argv[++i];
+    else if (arg == "--min-time" && i + 1 < argc) g_minTime = std::atof(argv[++i]);
+    else if (arg == "--scale" && i + 1 < argc) scale = std::max(1, std::atoi(argv[++i]));
+    else if (arg == "--examples" && i + 1 < argc) examples = argv[++i];
+    else {
+      std::cerr << "usage: PetukhBench [--filter <substring>] [--min-time <seconds>] [--scale <k>] [--examples <dir>]\n";
+      return 1;
+    }
+  }
+
+  std::cout << std::left << std::setw(32) << "Benchmark" << std::right << std::setw(14) << "Time"
+            << std::setw(12) << "Iterations" << "  Counters\n"
+            << std::string(80, '-') << "\n";
+  for (const auto &b : AllBenchmarks(scale, examples))
+    if (filter.empty() || b.name.find(filter) != std::string::npos)
+      RunBenchmark(b);
+  return 0;
+}
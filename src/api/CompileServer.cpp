@@ -0,0 +1,151 @@
+#include "CompileServer.h"
+
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+
+#include "../lexer/Lexer.h"
+#include "../parser/SourceSplitter.h"
+#include "../semantics/SemanticAnalyzer.h"
+#include "../rpn/RPNGenerator.h"
+#include "../opt/ASTOptimizer.h"
+#include "../opt/LoopOptimizer.h"
+#include "../opt/PeepholeOptimizer.h"
+
+namespace {
+
+constexpr uint64_t kFnvBasis = 14695981039346656037ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+uint64_t Mix(uint64_t h, uint64_t byte) { return (h ^ byte) * kFnvPrime; }
+
+// FNV-1a over the types and spellings of tokens, so layout does not count
+uint64_t HashTokens(const Token *begin, const Token *end, uint64_t h = kFnvBasis) {
+  for (const Token *t = begin; t != end; ++t) {
+    h = Mix(h, static_cast<uint64_t>(t->type) + 0x100);
+    for (char c : t->text)
+      h = Mix(h, static_cast<unsigned char>(c));
+  }
+  return h;
+}
+
+}  // namespace
+
+CompileServer::CompileServer(CompileOptions options) : options_(std::move(options)) {
+  options_.dumpDir.clear();
+  options_.cacheDir.clear();
+}
+
+CompileResult CompileServer::Compile(const std::string &source) {
+  reused_ = 0;
+  recompiled_ = 0;
+  auto whole = [&] { return ::Compile(source, options_); };
+
+  std::vector<Token> tokens = Lexer(source).Tokenize();
+  std::vector<SourcePiece> pieces;
+  if (!SplitTopLevel(source, tokens, pieces))
+    return whole();
+
+  uint64_t context = Mix(kFnvBasis, static_cast<uint64_t>(options_.optLevel));
+  for (const SourcePiece &p : pieces) {
+    size_t end = p.end;
+    if (p.isFunction)
+      for (end = p.begin; tokens[end].type != TokenType::LBRACE; ++end) {}
+    context = HashTokens(tokens.data() + p.begin, tokens.data() + end, Mix(context, p.isFunction));
+  }
+  const bool reuse = context == context_;
+
+  // this compile's top-level statements, and the Program the analyzer walks
+  ASTArena arena;
+  ASTNode *program = arena.Make(NodeKind::Program, "Program");
+  ASTNode *topLevel = arena.Make(NodeKind::Program, "Program");
+
+  std::vector<std::pair<uint64_t, Function>> redone;
+  std::vector<uint64_t> order;  // every function's hash, in source order
+  std::unordered_set<const ASTNode *> changed;
+  for (size_t k = 0; k < pieces.size(); ++k) {
+    const SourcePiece &p = pieces[k];
+    if (!p.isFunction) {
+      ASTNode *stmts = ParsePieces(p.text, arena);
+      if (!stmts)
+        return whole();
+      for (ASTNode *stmt : stmts->children) {
+        arena.Append(program, stmt);
+        arena.Append(topLevel, stmt);
+      }
+      continue;
+    }
+
+    uint64_t hash = HashTokens(tokens.data() + p.begin, tokens.data() + p.end);
+    order.push_back(hash);
+    auto cached = functions_.find(hash);
+    if (reuse && cached != functions_.end()) {
+      arena.Append(program, cached->second.node);
+      continue;
+    }
+
+    Function fn;
+    fn.arena = std::make_unique<ASTArena>();
+    ASTNode *root = ParsePieces(p.text, *fn.arena);
+    if (!root || root->children.size() != 1 || root->children[0]->kind != NodeKind::Function)
+      return whole();
+    fn.node = root->children[0];
+    arena.Append(program, fn.node);
+    changed.insert(fn.node);
+    redone.emplace_back(hash, std::move(fn));
+  }
+
+  SemanticAnalyzer sema;
+  sema.Analyze(program, options_.builtins, &changed);
+  if (!sema.GetErrors().empty())
+    return whole();
+  const ExprTypes *types = &sema.GetExprTypes();
+
+  std::unordered_set<std::string_view> names;
+  for (ASTNode *child : program->children)
+    if (child->kind == NodeKind::Function)
+      names.insert(child->text);
+
+  // each function is optimized as a program of its own, in the arena it was parsed into
+  auto optimize = [&](ASTNode *root, ASTArena &in) {
+    if (options_.optLevel >= 1)
+      ASTOptimizer(in, types).Optimize(root);
+    if (options_.optLevel >= 2)
+      LoopOptimizer(in, types).Optimize(root, names);
+  };
+  optimize(topLevel, arena);
+
+  RPNGenerator generator;
+  for (auto &[hash, fn] : redone) {
+    ASTNode *root = fn.arena->Make(NodeKind::Program, "Program");
+    fn.arena->Append(root, fn.node);
+    optimize(root, *fn.arena);
+    fn.code = generator.GenerateFunction(fn.node, names, types);
+  }
+
+  std::vector<Instruction> poliz = generator.GenerateTopLevel(
+      std::vector<ASTNode *>(topLevel->children.begin(), topLevel->children.end()), names, types);
+  std::unordered_map<uint64_t, Function> next;
+  for (auto &[hash, fn] : redone)
+    next.emplace(hash, std::move(fn));
+  for (uint64_t hash : order) {
+    auto it = next.find(hash);
+    const Function &fn = it != next.end() ? it->second : functions_.at(hash);
+    poliz.insert(poliz.end(), fn.code.begin(), fn.code.end());
+  }
+  poliz = PeepholeOptimizer(options_.optLevel).Optimize(std::move(poliz));
+
+  CompileResult result;
+  result.module = CompiledModule::Link(std::move(poliz), options_.builtins);
+
+  // what this source is made of is what the next one is compared against
+  recompiled_ = redone.size();
+  for (uint64_t hash : order) {
+    if (next.count(hash)) continue;
+    next.emplace(hash, std::move(functions_.at(hash)));
+    ++reused_;
+  }
+  functions_ = std::move(next);
+  context_ = context;
+  return result;
+}
@@ -0,0 +1,57 @@
+#ifndef PETUKH_COMPILE_SERVER_H
+#define PETUKH_COMPILE_SERVER_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Compiler.h"
+#include "../parser/AST.h"
+#include "../rpn/RPNInstruction.h"
+
+// Compiles successive versions of one program, as an editor or a watch loop
+// produces them, redoing only what changed. The source is split at its
+// top-level `fn`s and each function's tokens are hashed: a function that
+// hashes as it did last time keeps its AST and POLIZ, and only the others are
+// parsed, checked, optimized and generated again. The pieces are then put
+// through the PeepholeOptimizer and linked as a whole, which is linear and
+// cheap next to the front end.
+//
+// A function's code also depends on the rest of the program (the signatures
+// it calls, which names are functions rather than builtins, the top-level
+// declarations it sees), so a change to any signature or to the top-level
+// statements recompiles every function.
+//
+// The module is the one Compile would link for the same source. When the
+// source does not compile it goes through Compile for the diagnostics, and
+// the state of the last good compile is kept for the next one.
+class CompileServer {
+ public:
+  // dumpDir and cacheDir are ignored: all the server keeps is in memory
+  explicit CompileServer(CompileOptions options = {});
+
+  CompileResult Compile(const std::string &source);
+
+  // functions the last Compile took over from the one before, and the ones it redid
+  [[nodiscard]] size_t Reused() const { return reused_; }
+  [[nodiscard]] size_t Recompiled() const { return recompiled_; }
+
+ private:
+  struct Function {
+    std::unique_ptr<ASTArena> arena;  // its tree, as the optimizers left it
+    ASTNode *node = nullptr;
+    std::vector<Instruction> code;    // from its label on, before the peephole pass
+  };
+
+  CompileOptions options_;
+  // hash of the signatures and top-level tokens the functions were compiled against
+  uint64_t context_ = 0;
+  // by the hash of their tokens
+  std::unordered_map<uint64_t, Function> functions_;
+  size_t reused_ = 0;
+  size_t recompiled_ = 0;
+};
+
+#endif // PETUKH_COMPILE_SERVER_H
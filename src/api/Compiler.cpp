@@ -0,0 +1,311 @@
+#include "Compiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <unordered_set>
+
+#include "../lexer/Lexer.h"
+#include "../parser/Parser.h"
+#include "../parser/ASTPrinter.h"
+#include "../parser/SourceSplitter.h"
+#include "../semantics/SemanticAnalyzer.h"
+#include "../rpn/RPNGenerator.h"
+#include "../rpn/RPNInstruction.h"
+#include "../opt/ASTOptimizer.h"
+#include "../opt/LoopOptimizer.h"
+#include "../opt/PeepholeOptimizer.h"
+#include "../vm/BytecodeCache.h"
+
+namespace {
+
+// fewer functions than this per chunk are not worth the threads
+constexpr size_t kFunctionsPerChunk = 8;
+// chunks per worker, so one that gets the big functions does not hold up the rest
+constexpr size_t kChunksPerThread = 4;
+
+// The part of the source one worker of the parallel front end takes at a
+// time: a run of whole SourcePieces, parsed into an arena of its own.
+struct Chunk {
+  std::string_view text;
+  ASTArena arena;
+  ASTNode *root = nullptr;
+  size_t first = 0;  // where its children start in the assembled program
+  std::vector<std::vector<std::string>> errors;  // of each of its functions
+  std::vector<Instruction> code;                 // of its functions, in order
+  std::exception_ptr failure;
+};
+
+// Runs body(chunk) for every chunk on `workers` threads that take chunks off
+// a shared counter, as ParallelRunner does its jobs, then rethrows the first failure.
+template <class Body>
+void ForEachChunk(std::vector<Chunk> &chunks, unsigned workers, const Body &body) {
+  std::atomic<size_t> next{0};
+  auto worker = [&] {
+    for (size_t i = next++; i < chunks.size(); i = next++) {
+      try {
+        body(chunks[i]);
+      } catch (...) {
+        chunks[i].failure = std::current_exception();
+      }
+    }
+  };
+  const auto count = static_cast<unsigned>(std::min<size_t>(workers, chunks.size()));
+  std::vector<std::thread> pool;
+  pool.reserve(count);
+  for (unsigned t = 0; t < count; ++t)
+    pool.emplace_back(worker);
+  for (auto &t : pool)
+    t.join();
+  for (auto &chunk : chunks)
+    if (chunk.failure)
+      std::rethrow_exception(chunk.failure);
+}
+
+void Optimize(ASTNode *root, ASTArena &arena, const ExprTypes *types, int optLevel,
+              const std::unordered_set<std::string_view> &functions) {
+  if (optLevel >= 1)
+    ASTOptimizer(arena, types).Optimize(root);
+  if (optLevel >= 2)
+    LoopOptimizer(arena, types).Optimize(root, functions);
+}
+
+// The front end for sources with many functions. The source is cut at its
+// top-level `fn`s (see SourceSplitter) into runs of pieces, a few per
+// thread, and `threads` workers take the runs in turn: each parses its run,
+// then checks its functions against the whole program's signatures,
+// optimizes and generates them. The top-level
+// statements are checked and generated on the calling thread, and the code
+// and errors are put together in source order, so both come out exactly as
+// the sequential front end has them. Returns false, having done nothing, for
+// sources with too few functions and for syntax errors, which the sequential
+// parser then reports with their positions.
+bool ParallelFrontEnd(const std::string &source, const CompileOptions &options, unsigned threads,
+                      CompileResult &result, std::vector<Instruction> &poliz) {
+  std::vector<Token> tokens = Lexer(source).Tokenize();
+  std::vector<SourcePiece> pieces;
+  if (!SplitTopLevel(source, tokens, pieces))
+    return false;
+  size_t functions = std::count_if(pieces.begin(), pieces.end(), [](const SourcePiece &p) { return p.isFunction; });
+  size_t count = std::min<size_t>(size_t{threads} * kChunksPerThread, functions / kFunctionsPerChunk);
+  if (count < 2)
+    return false;
+
+  // runs of about the same number of tokens
+  std::vector<Chunk> chunks(count);
+  const size_t perChunk = tokens.size() / count + 1;
+  for (const SourcePiece &p : pieces) {
+    Chunk &chunk = chunks[std::min(count - 1, p.begin / perChunk)];
+    if (chunk.text.empty())
+      chunk.text = p.text;
+    else
+      chunk.text = std::string_view(chunk.text.data(), p.text.data() + p.text.size() - chunk.text.data());
+  }
+
+  ForEachChunk(chunks, threads, [](Chunk &chunk) { chunk.root = ParsePieces(chunk.text, chunk.arena); });
+  ASTArena arena;  // the assembled program and the top level's optimizations
+  ASTNode *program = arena.Make(NodeKind::Program, "Program");
+  for (auto &chunk : chunks) {
+    if (!chunk.root)
+      return false;
+    chunk.first = program->children.size();
+    for (ASTNode *child : chunk.root->children)
+      arena.Append(program, child);
+  }
+
+  std::unordered_set<std::string_view> names;
+  for (ASTNode *child : program->children)
+    if (child->kind == NodeKind::Function)
+      names.insert(child->text);
+
+  ForEachChunk(chunks, threads, [&](Chunk &chunk) {
+    // every statement before the chunk's end is checked for the globals it
+    // declares; only the chunk's own functions are this thread's to report
+    SemanticAnalyzer sema;
+    sema.Declare(program, options.builtins);
+    size_t seen = sema.GetErrors().size();
+    const size_t end = chunk.first + chunk.root->children.size();
+    chunk.errors.resize(chunk.root->children.size());
+    bool clean = true;
+    for (size_t i = 0; i < end; ++i) {
+      ASTNode *child = program->children[i];
+      bool mine = child->kind == NodeKind::Function;
+      if (mine && i < chunk.first)
+        continue;
+      sema.Check(child);
+      const auto &errors = sema.GetErrors();
+      if (mine) {
+        chunk.errors[i - chunk.first].assign(errors.begin() + static_cast<ptrdiff_t>(seen), errors.end());
+        clean = clean && errors.size() == seen;
+      }
+      seen = errors.size();
+    }
+    if (!clean)
+      return;
+
+    const ExprTypes *types = &sema.GetExprTypes();
+    ASTNode *own = chunk.arena.Make(NodeKind::Program, "Program");
+    for (ASTNode *child : chunk.root->children)
+      if (child->kind == NodeKind::Function)
+        chunk.arena.Append(own, child);
+    Optimize(own, chunk.arena, types, options.optLevel, names);
+
+    RPNGenerator generator;
+    for (ASTNode *fn : own->children) {
+      auto code = generator.GenerateFunction(fn, names, types);
+      chunk.code.insert(chunk.code.end(), std::make_move_iterator(code.begin()), std::make_move_iterator(code.end()));
+    }
+  });
+
+  // the duplicate functions and the top-level statements
+  SemanticAnalyzer sema;
+  sema.Declare(program, options.builtins);
+  result.semanticErrors = sema.GetErrors();
+  std::vector<ASTNode *> topLevel;
+  std::vector<std::vector<std::string>> topLevelErrors;
+  for (ASTNode *child : program->children) {
+    if (child->kind == NodeKind::Function)
+      continue;
+    size_t seen = sema.GetErrors().size();
+    sema.Check(child);
+    topLevel.push_back(child);
+    topLevelErrors.emplace_back(sema.GetErrors().begin() + static_cast<ptrdiff_t>(seen), sema.GetErrors().end());
+  }
+
+  size_t nextTopLevel = 0;
+  for (auto &chunk : chunks) {
+    for (size_t i = 0; i < chunk.root->children.size(); ++i) {
+      auto &errors = chunk.root->children[i]->kind == NodeKind::Function ? chunk.errors[i]
+                                                                         : topLevelErrors[nextTopLevel++];
+      result.semanticErrors.insert(result.semanticErrors.end(), errors.begin(), errors.end());
+    }
+  }
+  if (!result.semanticErrors.empty())
+    return true;
+
+  ASTNode *root = arena.Make(NodeKind::Program, "Program");
+  for (ASTNode *stmt : topLevel)
+    arena.Append(root, stmt);
+  Optimize(root, arena, &sema.GetExprTypes(), options.optLevel, names);
+
+  poliz = RPNGenerator().GenerateTopLevel(topLevel, names, &sema.GetExprTypes());
+  for (auto &chunk : chunks)
+    poliz.insert(poliz.end(), std::make_move_iterator(chunk.code.begin()), std::make_move_iterator(chunk.code.end()));
+  return true;
+}
+
+}  // namespace
+
+CompileResult Compile(const std::string &source, const CompileOptions &options) {
+  CompileResult result;
+  const bool dump = !options.dumpDir.empty();
+  auto dumpPath = [&](const char *name) { return options.dumpDir + "/" + name; };
+
+  std::string cachePath;
+  uint64_t cacheKey = 0;
+  if (!options.cacheDir.empty()) {
+    cacheKey = BytecodeCache::Key(source, options.optLevel);
+    cachePath = BytecodeCache::PathFor(options.cacheDir, cacheKey);
+    result.module = BytecodeCache::Load(cachePath, cacheKey, options.builtins);
+    if (result.module) {
+      result.fromCache = true;
+      return result;
+    }
+  }
+
+  // the back end, whichever front end produced the POLIZ
+  auto link = [&](std::vector<Instruction> poliz) {
+    poliz = PeepholeOptimizer(options.optLevel).Optimize(std::move(poliz));
+
+    if (dump) {
+      std::ofstream fp(dumpPath("res_poliz.txt"));
+      fp << "=== POLIZ ===\n\n";
+      for (size_t i = 0; i < poliz.size(); ++i)
+        fp << i << ": " << InstructionToString(poliz[i]) << "\n";
+    }
+
+    result.module = CompiledModule::Link(std::move(poliz), options.builtins);
+    if (dump) {
+      std::ofstream fr(dumpPath("res_registers.txt"));
+      result.module->Registers().Print(fr);
+    }
+    if (!cachePath.empty())
+      BytecodeCache::Save(cachePath, *result.module, cacheKey);  // a failed write only costs the next start
+    return result;
+  };
+
+  // the dumps want the whole tree, so they always come from the sequential front end
+  const unsigned threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+  if (!dump && threads > 1) {
+    std::vector<Instruction> poliz;
+    if (ParallelFrontEnd(source, options, threads, result, poliz))
+      return result.semanticErrors.empty() ? link(std::move(poliz)) : result;
+  }
+
+  // ================= Lexer =================
+  // only the dump needs the whole token stream; the parser pulls its own
+  if (dump) {
+    std::ofstream f(dumpPath("res_lexer.txt"));
+    for (const auto &t : Lexer(source).Tokenize()) {
+      f << "Line " << t.line << ":" << t.col << "  "
+        << TokenTypeToString(t.type) << "  '" << t.text << "'\n";
+    }
+  }
+
+  // ================= Parser =================
+  // the tree lives in one arena and is released with it when Compile returns
+  ASTArena arena;
+  Lexer lexer(source);
+  Parser parser(lexer, arena);
+  ASTNode *program = parser.ParseProgram();
+  result.syntaxErrors = parser.GetErrors();
+
+  if (dump) {
+    std::ofstream fout(dumpPath("res_syntax.txt"));
+    ASTPrinter printer;
+    if (result.syntaxErrors.empty()) {
+      printer.Print(program, fout);
+      fout << "\n=== No syntax errors ===\n";
+    } else {
+      fout << "=== AST (partial or empty due to errors) ===\n";
+      if (program)
+        printer.Print(program, fout);
+
+      fout << "\n=== Syntax errors ===\n";
+      for (const auto &err : result.syntaxErrors)
+        fout << err << "\n";
+    }
+  }
+  if (!result.syntaxErrors.empty())
+    return result;
+
+  // ================= Semantic =================
+  SemanticAnalyzer sema;
+  sema.Analyze(program, options.builtins);
+  result.semanticErrors = sema.GetErrors();
+
+  if (dump) {
+    std::ofstream fs(dumpPath("res_semantic.txt"));
+    if (result.semanticErrors.empty()) {
+      fs << "=== Semantic OK ===\n";
+    } else {
+      fs << "=== Semantic errors ===\n";
+      for (const auto &e : result.semanticErrors)
+        fs << e << "\n";
+    }
+  }
+  if (!result.semanticErrors.empty())
+    return result;
+
+  // ================= POLIZ =================
+  if (options.optLevel >= 1)
+    ASTOptimizer(arena, &sema.GetExprTypes()).Optimize(program);
+  if (options.optLevel >= 2)
+    LoopOptimizer(arena, &sema.GetExprTypes()).Optimize(program);
+
+  RPNGenerator generator;
+  return link(generator.Generate(program, &sema.GetExprTypes()));
+}
@@ -0,0 +1,40 @@
+#ifndef PETUKH_COMPILER_H
+#define PETUKH_COMPILER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../vm/Builtins.h"
+#include "../vm/CompiledModule.h"
+
+struct CompileOptions {
+  // 0 runs the program exactly as generated, 1 / 2 optimize it (see ASTOptimizer,
+  // LoopOptimizer, PeepholeOptimizer)
+  int optLevel = 2;
+  // when set, res_lexer.txt, res_syntax.txt, res_semantic.txt, res_poliz.txt and
+  // res_registers.txt are written there
+  std::string dumpDir;
+  BuiltinTable builtins = BuiltinTable::Standard();
+  // when set, linked modules are cached there by source hash (see BytecodeCache);
+  // a cache hit skips the whole front end, and with it the dumps
+  std::string cacheDir;
+  // above 1, sources with many functions go through the front end on that many
+  // threads (0 picks one per hardware thread); the result is the same either way
+  unsigned threads = 1;
+};
+
+struct CompileResult {
+  std::shared_ptr<const CompiledModule> module;  // null if there were errors
+  std::vector<std::string> syntaxErrors;
+  std::vector<std::string> semanticErrors;
+  bool fromCache = false;
+
+  [[nodiscard]] bool Ok() const { return module != nullptr; }
+};
+
+// Runs Lexer -> Parser -> SemanticAnalyzer -> optimizers -> RPNGenerator and
+// links the result. Compile once, then hand the module to as many VMs as needed.
+CompileResult Compile(const std::string &source, const CompileOptions &options = {});
+
+#endif // PETUKH_COMPILER_H
@@ -0,0 +1,71 @@
+#include "Runner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <sstream>
+#include <thread>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "../vm/VM.h"
+
+ParallelRunner::ParallelRunner(std::shared_ptr<const CompiledModule> module, unsigned threads)
+    : module_(std::move(module)), threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+static RunOutcome RunOne(VM &vm, const RunJob &job, bool reportMemory) {
+  RunOutcome outcome;
+  int in = open(job.inputPath.c_str(), O_RDONLY);
+  if (in < 0) {
+    outcome.error = "cannot open " + job.inputPath + ": " + std::strerror(errno);
+    return outcome;
+  }
+  int out = open(job.outputPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (out < 0) {
+    outcome.error = "cannot open " + job.outputPath + ": " + std::strerror(errno);
+    close(in);
+    return outcome;
+  }
+
+  vm.SetIO(in, out);
+  try {
+    outcome.exitCode = vm.Run();
+  } catch (const std::exception &e) {
+    outcome.error = e.what();
+  }
+  if (reportMemory) {
+    std::ostringstream table;
+    vm.ReportMemory(table);
+    outcome.memory = table.str();
+  }
+  // what was printed before a failure is kept, as it would be on stdout
+  vm.SetIO(0, 1);
+  close(in);
+  close(out);
+  return outcome;
+}
+
+std::vector<RunOutcome> ParallelRunner::Run(const std::vector<RunJob> &jobs) const {
+  std::vector<RunOutcome> outcomes(jobs.size());
+  std::atomic<size_t> next{0};
+
+  auto worker = [&] {
+    VM vm(module_);
+    vm.SetLimits(limits_);
+    for (size_t i = next++; i < jobs.size(); i = next++)
+      outcomes[i] = RunOne(vm, jobs[i], reportMemory_);
+  };
+
+  unsigned count = static_cast<unsigned>(std::min<size_t>(threads_, jobs.size()));
+  std::vector<std::thread> pool;
+  pool.reserve(count);
+  for (unsigned t = 0; t < count; ++t)
+    pool.emplace_back(worker);
+  for (auto &t : pool)
+    t.join();
+  return outcomes;
+}
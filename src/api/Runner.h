@@ -0,0 +1,50 @@
+#ifndef PETUKH_RUNNER_H
+#define PETUKH_RUNNER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "../vm/CompiledModule.h"
+#include "../vm/VM.h"
+
+// One execution of the program: stdin is read from inputPath, stdout goes to outputPath.
+struct RunJob {
+  std::string inputPath;
+  std::string outputPath;
+};
+
+struct RunOutcome {
+  int exitCode = 0;
+  std::string error;  // empty on success: a file could not be opened, or the VM threw
+  std::string memory;  // the job's VM::ReportMemory table, if ReportMemory(true)
+
+  [[nodiscard]] bool Ok() const { return error.empty(); }
+};
+
+// Runs one compiled module over many inputs at once. Each worker thread owns
+// a single VM and takes jobs off a shared queue until it is empty; the module
+// itself is shared read-only, so nothing is recompiled per input.
+class ParallelRunner {
+ public:
+  // threads == 0 picks one worker per hardware thread
+  explicit ParallelRunner(std::shared_ptr<const CompiledModule> module, unsigned threads = 0);
+
+  // Outcomes are in the order of `jobs`, whichever worker ran them.
+  std::vector<RunOutcome> Run(const std::vector<RunJob> &jobs) const;
+
+  [[nodiscard]] unsigned Threads() const { return threads_; }
+
+  // Every job runs under these, as VM::SetLimits; one that hits a limit fails with its error.
+  void SetLimits(const VM::Limits &limits) { limits_ = limits; }
+  // Whether each outcome carries its run's memory table, failed runs included.
+  void ReportMemory(bool report) { reportMemory_ = report; }
+
+ private:
+  std::shared_ptr<const CompiledModule> module_;
+  unsigned threads_;
+  VM::Limits limits_;
+  bool reportMemory_ = false;
+};
+
+#endif // PETUKH_RUNNER_H
@@ -0,0 +1,75 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <string_view>
+
+#include "Token.h"
+
+// Keyword recognizer for Lexer::Identifier. The set is fixed, so it is a
+// switch on length and first letter followed by one comparison: no tables
+// to build per Lexer and no lookups per character.
+constexpr TokenType KeywordOrIdentifier(std::string_view w) {
+  auto is = [w](std::string_view kw) { return w == kw; };
+  switch (w.size()) {
+    case 2:
+      switch (w[0]) {
+        case 'i': return is("if") ? TokenType::KW_IF : TokenType::IDENTIFIER;
+        case 'd': return is("do") ? TokenType::KW_DO : TokenType::IDENTIFIER;
+        case 'f': return is("fn") ? TokenType::KW_FN : TokenType::IDENTIFIER;
+        default: break;
+      }
+      break;
+    case 3:
+      switch (w[0]) {
+        case 'f': return is("for") ? TokenType::KW_FOR : TokenType::IDENTIFIER;
+        case 'i': return is("int") ? TokenType::KW_INT : TokenType::IDENTIFIER;
+        default: break;
+      }
+      break;
+    case 4:
+      switch (w[0]) {
+        case 'e': return is("else") ? TokenType::KW_ELSE : TokenType::IDENTIFIER;
+        case 'c': return is("char") ? TokenType::KW_CHAR : TokenType::IDENTIFIER;
+        default: break;
+      }
+      break;
+    case 5:
+      switch (w[0]) {
+        case 'w': return is("while") ? TokenType::KW_WHILE : TokenType::IDENTIFIER;
+        case 'b': return is("break") ? TokenType::KW_BREAK : TokenType::IDENTIFIER;
+        default: break;
+      }
+      break;
+    case 6:
+      switch (w[0]) {
+        case 'd': return is("double") ? TokenType::KW_DOUBLE : TokenType::IDENTIFIER;
+        case 's': return is("string") ? TokenType::KW_STRING : TokenType::IDENTIFIER;
+        case 'r': return is("return") ? TokenType::KW_RETURN : TokenType::IDENTIFIER;
+        default: break;
+      }
+      break;
+    case 8:
+      return is("continue") ? TokenType::KW_CONTINUE : TokenType::IDENTIFIER;
+    default:
+      break;
+  }
+  return TokenType::IDENTIFIER;
+}
+
+static_assert(KeywordOrIdentifier("if") == TokenType::KW_IF);
+static_assert(KeywordOrIdentifier("else") == TokenType::KW_ELSE);
+static_assert(KeywordOrIdentifier("for") == TokenType::KW_FOR);
+static_assert(KeywordOrIdentifier("while") == TokenType::KW_WHILE);
+static_assert(KeywordOrIdentifier("do") == TokenType::KW_DO);
+static_assert(KeywordOrIdentifier("fn") == TokenType::KW_FN);
+static_assert(KeywordOrIdentifier("int") == TokenType::KW_INT);
+static_assert(KeywordOrIdentifier("char") == TokenType::KW_CHAR);
+static_assert(KeywordOrIdentifier("double") == TokenType::KW_DOUBLE);
+static_assert(KeywordOrIdentifier("string") == TokenType::KW_STRING);
+static_assert(KeywordOrIdentifier("return") == TokenType::KW_RETURN);
+static_assert(KeywordOrIdentifier("break") == TokenType::KW_BREAK);
+static_assert(KeywordOrIdentifier("continue") == TokenType::KW_CONTINUE);
+static_assert(KeywordOrIdentifier("iff") == TokenType::IDENTIFIER);
+static_assert(KeywordOrIdentifier("strinG") == TokenType::IDENTIFIER);
+
+#endif
@@ -1,29 +1,10 @@
 #include "Lexer.h"
 
 #include <cctype>
-#include <utility>
 
-Lexer::Lexer(std::string src) : src_(std::move(src)), pos_(0), line_(1), col_(1) {
-  InitTrie();
-}
+#include "Keywords.h"
 
-void Lexer::InitTrie() const {
-  keyword_trie_.Insert("if", static_cast<int>(TokenType::KW_IF));
-  keyword_trie_.Insert("else", static_cast<int>(TokenType::KW_ELSE));
-  keyword_trie_.Insert("for", static_cast<int>(TokenType::KW_FOR));
-  keyword_trie_.Insert("while", static_cast<int>(TokenType::KW_WHILE));
-  keyword_trie_.Insert("do", static_cast<int>(TokenType::KW_DO));
-  keyword_trie_.Insert("fn", static_cast<int>(TokenType::KW_FN));
-
-  keyword_trie_.Insert("int", static_cast<int>(TokenType::KW_INT));
-  keyword_trie_.Insert("char", static_cast<int>(TokenType::KW_CHAR));
-  keyword_trie_.Insert("double", static_cast<int>(TokenType::KW_DOUBLE));
-  keyword_trie_.Insert("string", static_cast<int>(TokenType::KW_STRING));
-
-  keyword_trie_.Insert("return", static_cast<int>(TokenType::KW_RETURN));
-  keyword_trie_.Insert("break", static_cast<int>(TokenType::KW_BREAK));
-  keyword_trie_.Insert("continue", static_cast<int>(TokenType::KW_CONTINUE));
-}
+Lexer::Lexer(std::string_view src) : src_(src), pos_(0), line_(1), col_(1) {}
 
 bool Lexer::IsEnd() const { return pos_ >= src_.size(); }
 
@@ -102,44 +83,43 @@ Token Lexer::EndOfFile() const {
 
 Token Lexer::Identifier() {
   const int startCol = col_;
-  std::string text;
+  const size_t start = pos_;
   while (!IsEnd() && (IsLetter(Peek()) || isdigit(Peek()) || Peek() == '_')) {
-    text += Get();
-  }
-  if (int kw = keyword_trie_.Match(text); kw != -1) {
-    return Make(static_cast<TokenType>(kw), text, startCol);
+    Get();
   }
-  return Make(TokenType::IDENTIFIER, text, startCol);
+  const std::string_view text = src_.substr(start, pos_ - start);
+  return Make(KeywordOrIdentifier(text), text, startCol);
 }
 
 Token Lexer::Number() {
   int start_col = col_;
-  std::string value;
+  const size_t start = pos_;
 
   // Целая часть
   while (!IsEnd() && isdigit(Peek())) {
-    value += Get();
+    Get();
   }
 
   // Дробная часть
   if (!IsEnd() && Peek() == '.' && isdigit(Peek(1))) {
-    value += Get();  // съели '.'
+    Get();  // съели '.'
 
     while (!IsEnd() && isdigit(Peek())) {
-      value += Get();
+      Get();
     }
   }
 
-  return Make(TokenType::NUMBER, value, start_col);
+  return Make(TokenType::NUMBER, src_.substr(start, pos_ - start), start_col);
 }
 
 Token Lexer::StringLiteral() {
   const int startCol = col_;
-  std::string text;
   Get();
+  const size_t start = pos_;
   while (!IsEnd() && Peek() != '"') {
-    text += Get();
+    Get();
   }
+  const std::string_view text = src_.substr(start, pos_ - start);
   Get();
   return Make(TokenType::STRING_LITERAL, text, startCol);
 }
@@ -201,9 +181,9 @@ Token Lexer::Symbol() {
     default:
       break;
   }
-  return Make(TokenType::UNKNOWN, std::string(1, c), startCol);
+  return Make(TokenType::UNKNOWN, src_.substr(pos_ - 1, 1), startCol);
 }
 
-Token Lexer::Make(TokenType type, const std::string &text, int start_col) const {
+Token Lexer::Make(TokenType type, std::string_view text, int start_col) const {
   return {type, text, line_, start_col};
 }
@@ -2,31 +2,29 @@
 #define LEXER_H
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "Token.h"
-#include "Trie.h"
 
+// Token texts point into `src`, which is not copied and must outlive them.
 class Lexer {
  public:
-  explicit Lexer(std::string src);
+  explicit Lexer(std::string_view src);
 
+  // The whole stream at once; the Parser pulls tokens one by one instead.
   std::vector<Token> Tokenize();
   Token NextToken();
   Token PeekToken();
 
  private:
-  std::string src_;
+  std::string_view src_;
   size_t pos_;
   int line_, col_;
 
-  Trie keyword_trie_;
-
   Token buffered_token_;
   bool has_buffered_token_ = false;
 
-  void InitTrie() const;
-
   [[nodiscard]] bool IsEnd() const;
   [[nodiscard]] char Peek(int offset = 0) const;
   char Get();
@@ -41,7 +39,7 @@ class Lexer {
   Token Symbol();
   [[nodiscard]] Token EndOfFile() const;
 
-  [[nodiscard]] Token Make(TokenType type, const std::string &text,
+  [[nodiscard]] Token Make(TokenType type, std::string_view text,
                            int start_col) const;
 };
 
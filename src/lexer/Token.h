@@ -1,7 +1,7 @@
 #ifndef TOKEN_H
 #define TOKEN_H
 
-#include <string>
+#include <string_view>
 
 enum class TokenType {
   KW_IF,
@@ -48,9 +48,11 @@ enum class TokenType {
   UNKNOWN
 };
 
+// text is a slice of the source the Lexer was given (or a static spelling),
+// so a token is only valid while that source is.
 struct Token {
   TokenType type;
-  std::string text;
+  std::string_view text;
   int line, col;
 };
 
@@ -1,37 +1,116 @@
+#include <cctype>
+#include <exception>
 #include <iostream>
 #include <fstream>
 #include <sstream>
-#include <vector>
-
-#include "lexer/Lexer.h"
-#include "parser/Parser.h"
-#include "parser/ASTPrinter.h"
-#include "semantics/SemanticAnalyzer.h"
-#include "rpn/RPNGenerator.h"
-#include "rpn/RPNInstruction.h"
-#include "vm/VM.h"
-
-int main() {
-  const std::string programPath =
-      "../examples/program.petukh";
-
-  const std::string lexerOutPath =
-      "../examples/res_lexer.txt";
+#include <string>
 
-  const std::string syntaxOutPath =
-      "../examples/res_syntax.txt";
+#include "api/CompileServer.h"
+#include "api/Compiler.h"
+#include "api/Runner.h"
+#include "vm/VM.h"
 
-  const std::string semanticOutPath =
-      "../examples/res_semantic.txt";
+// usage: PetukhPlusPlus [program.petukh] [-O0|-O1|-O2] [--dump] [--cache <dir>] [--registers]
+//                       [--profile <file>] [--folded <file>] [--memory] [--max-heap <bytes>]
+//                       [--max-stack <n>] [--max-calls <n>] [-j<n>] [--each <input>...] [--serve]
+//   --dump writes res_lexer.txt, res_syntax.txt, res_semantic.txt,
+//   res_poliz.txt and res_registers.txt next to the program
+//   --registers runs the register VM instead of the stack one
+//   --cache keeps compiled bytecode in <dir> and reuses it while the source is unchanged
+//   --profile / --folded write the Profiler report / flamegraph stacks of the run
+//   (only in a build with PETUKH_PROFILE)
+//   --memory prints the heap, operand stack and call depth the run used (each run, with --each) to stderr
+//   --max-heap / --max-stack / --max-calls stop the run with an error past that many
+//   bytes of strings and arrays, operand stack values or frames
+//   --each <input>... runs the program once per input file, in parallel on -j<n> threads
+//   (all cores by default); the output of <input> goes to <input>.out
+//   -j<n> also compiles a program with many functions on n threads (on one without it)
+//   --serve reads program paths from stdin, one per line, and compiles each with one
+//   CompileServer, so only functions changed since the previous line are recompiled;
+//   it reports errors or how many functions were reused, and runs nothing
+int main(int argc, char **argv) {
+  std::string programPath = "../examples/program.petukh";
+  CompileOptions options;
+  bool dump = false;
+  std::vector<RunJob> jobs;
+  bool each = false;
+  bool serve = false;
+  unsigned threads = 0;
+  std::string profilePath, foldedPath;
+  bool memory = false;
+  VM::Limits limits;
+  VM::Backend backend = VM::Backend::kStack;
+
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && std::isdigit(static_cast<unsigned char>(arg[2])))
+      options.optLevel = arg[2] - '0';
+    else if (arg == "--dump")
+      dump = true;
+    else if (arg == "--registers")
+      backend = VM::Backend::kRegister;
+    else if (arg == "--cache" && i + 1 < argc)
+      options.cacheDir = argv[++i];
+    else if (arg == "--profile" && i + 1 < argc)
+      profilePath = argv[++i];
+    else if (arg == "--folded" && i + 1 < argc)
+      foldedPath = argv[++i];
+    else if (arg == "--memory")
+      memory = true;
+    else if (arg == "--max-heap" && i + 1 < argc)
+      limits.heapBytes = std::stoull(argv[++i]);
+    else if (arg == "--max-stack" && i + 1 < argc)
+      limits.stackDepth = std::stoull(argv[++i]);
+    else if (arg == "--max-calls" && i + 1 < argc)
+      limits.callDepth = std::stoull(argv[++i]);
+    else if (arg.size() > 2 && arg[0] == '-' && arg[1] == 'j')
+      threads = options.threads = static_cast<unsigned>(std::stoul(arg.substr(2)));
+    else if (arg == "--each")
+      each = true;
+    else if (arg == "--serve")
+      serve = true;
+    else if (each)
+      jobs.push_back({arg, arg + ".out"});
+    else
+      programPath = arg;
+  }
 
-  const std::string polizOutPath =
-      "../examples/res_poliz.txt";
+  if (dump) {
+    size_t slash = programPath.find_last_of('/');
+    options.dumpDir = slash == std::string::npos ? "." : programPath.substr(0, slash);
+  }
 
+  if (serve) {
+    CompileServer server(options);
+    std::string path;
+    while (std::getline(std::cin, path)) {
+      std::ifstream in(path);
+      if (!in.is_open()) {
+        std::cout << path << ": cannot open" << std::endl;
+        continue;
+      }
+      std::stringstream text;
+      text << in.rdbuf();
+      CompileResult compiled = server.Compile(text.str());
+      if (compiled.Ok()) {
+        std::cout << path << ": ok, " << server.Reused() << " functions reused, "
+                  << server.Recompiled() << " recompiled" << std::endl;
+        continue;
+      }
+      std::cout << path << ": " << compiled.syntaxErrors.size() + compiled.semanticErrors.size() << " errors\n";
+      for (const auto &e : compiled.syntaxErrors)
+        std::cout << "  " << e << "\n";
+      for (const auto &e : compiled.semanticErrors)
+        std::cout << "  " << e << "\n";
+      std::cout.flush();
+    }
+    return 0;
+  }
 
   // ================= Load source =================
   std::ifstream fin(programPath);
   if (!fin.is_open()) {
-    std::cerr << "Error: cannot open program.petukh\n";
+    std::cerr << "Error: cannot open " << programPath << "\n";
     return 1;
   }
 
@@ -39,97 +118,79 @@ int main() {
   buffer << fin.rdbuf();
   fin.close();
 
-  std::string source = buffer.str();
 
+  // ================= Compile =================
+  CompileResult compiled = Compile(buffer.str(), options);
 
-  // ================= Lexer =================
-  Lexer lexer(source);
-  std::vector<Token> tokens = lexer.Tokenize();
-
-  {
-    std::ofstream f(lexerOutPath);
-    for (const auto &t : tokens) {
-      f << "Line " << t.line << ":" << t.col << "  "
-        << TokenTypeToString(t.type) << "  '" << t.text << "'\n";
+  auto report = [&](const char *what, const char *file, const std::vector<std::string> &errors) {
+    std::cerr << what << " errors detected.";
+    if (dump) {
+      std::cerr << " See " << file << ".\n";
+      return;
     }
-  }
-
-
-  // ================= Parser =================
-  Parser parser(tokens);
-  std::unique_ptr<ASTNode> program = parser.ParseProgram();
-
-  {
-    std::ofstream fout(syntaxOutPath);
+    std::cerr << "\n";
+    for (const auto &e : errors)
+      std::cerr << e << "\n";
+  };
 
-    if (parser.GetErrors().empty()) {
-      ASTPrinter printer;
-      printer.Print(program.get(), fout);
-      fout << "\n=== No syntax errors ===\n";
-    } else {
-      fout << "=== AST (partial or empty due to errors) ===\n";
-      ASTPrinter printer;
-      if (program)
-        printer.Print(program.get(), fout);
-
-      fout << "\n=== Syntax errors ===\n";
-      for (const auto &err : parser.GetErrors()) {
-        fout << err << "\n";
-      }
-
-      std::cerr << "Syntax errors detected. See res_syntax.txt.\n";
-      return 1;
-    }
+  if (!compiled.syntaxErrors.empty()) {
+    report("Syntax", "res_syntax.txt", compiled.syntaxErrors);
+    return 1;
   }
-
-
-  // ================= Semantic =================
-  SemanticAnalyzer sema;
-  sema.Analyze(program.get());
-
-  const auto &semErrors = sema.GetErrors();
-
-  {
-    std::ofstream fs(semanticOutPath);
-
-    if (semErrors.empty()) {
-      fs << "=== Semantic OK ===\n";
-      std::cout << "No semantic errors.\n";
-    } else {
-      fs << "=== Semantic errors ===\n";
-      for (const auto &e : semErrors) {
-        fs << e << "\n";
-      }
-      std::cerr << "Semantic errors detected. See res_semantic.txt.\n";
-      return 1;
-    }
+  if (!compiled.semanticErrors.empty()) {
+    report("Semantic", "res_semantic.txt", compiled.semanticErrors);
+    return 1;
   }
 
-
-  // ================= POLIZ =================
-  RPNGenerator generator;
-  auto poliz = generator.Generate(program.get());
-
-  {
-    std::ofstream fp(polizOutPath);
-
-    fp << "=== POLIZ ===\n\n";
-
-    for (size_t i = 0; i < poliz.size(); ++i) {
-      fp << i << ": "
-         << OpCodeToString(poliz[i].op);
-
-      if (!poliz[i].arg.empty())
-        fp << " " << poliz[i].arg;
-
-      fp << "\n";
+  std::cout << "No semantic errors.\n";
+  std::cout << "Compilation successful.\n";
+  if (dump)
+    std::cout << "POLIZ written to res_poliz.txt\n";
+
+
+  // ================= Run =================
+  if (each) {
+    ParallelRunner runner(compiled.module, threads);
+    runner.SetLimits(limits);
+    runner.ReportMemory(memory);
+    std::vector<RunOutcome> outcomes = runner.Run(jobs);
+    int failed = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+      if (memory) std::cerr << jobs[i].inputPath << ":\n" << outcomes[i].memory;
+      if (outcomes[i].Ok()) continue;
+      std::cerr << jobs[i].inputPath << ": " << outcomes[i].error << "\n";
+      ++failed;
     }
+    return failed ? 1 : 0;
   }
 
+  VM vm(compiled.module, backend);
+  if (backend != vm.ActiveBackend())
+    std::cerr << "No register code for this program; running it on the stack VM.\n";
+#if !PETUKH_PROFILE
+  if (!profilePath.empty() || !foldedPath.empty())
+    std::cerr << "Profiling is not available: rebuild with PETUKH_PROFILE.\n";
+#endif
+  vm.SetLimits(limits);
+  try {
+    vm.Run();
+  } catch (const std::exception &e) {
+    // what was held when a limit (or anything else) stopped it
+    if (memory) vm.ReportMemory(std::cerr);
+    std::cerr << "Runtime error: " << e.what() << "\n";
+    return 1;
+  }
+  if (memory) vm.ReportMemory(std::cerr);
 
-  std::cout << "Compilation successful.\n";
-  std::cout << "POLIZ written to res_poliz.txt\n";
-  VM vm(poliz);
-  vm.Run();
+#if PETUKH_PROFILE
+  if (!profilePath.empty()) {
+    std::ofstream f(profilePath);
+    vm.Profile().Report(f);
+  }
+  if (!foldedPath.empty()) {
+    std::ofstream f(foldedPath);
+    vm.Profile().WriteFolded(f);
+  }
+#endif
   return 0;
 }
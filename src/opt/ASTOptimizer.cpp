@@ -0,0 +1,385 @@
+#include "ASTOptimizer.h"
+
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <sstream>
+
+#include "../rpn/RPNInstruction.h"
+
+static bool IsFloatingLiteral(std::string_view s) {
+  for (char c : s) {
+    if (c == '.' || c == 'e' || c == 'E') return true;
+  }
+  return false;
+}
+
+// Two's complement wrap-around, which is what the VM's int64 arithmetic does in practice.
+static int64_t WrapAdd(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) + static_cast<uint64_t>(b));
+}
+
+static int64_t WrapSub(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) - static_cast<uint64_t>(b));
+}
+
+static int64_t WrapMul(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) * static_cast<uint64_t>(b));
+}
+
+void ASTOptimizer::Optimize(ASTNode *root) {
+  if (!root)
+    return;
+
+  // top-level statements share the bottom frame, every function has its own
+  std::vector<ASTNode *> topLevel;
+  for (auto &child : root->children) {
+    if (!child) continue;
+    if (child->kind != NodeKind::Function) {
+      topLevel.push_back(child);
+      continue;
+    }
+
+    // children[0] is the return type, children[1..n-2] the parameters, the last one the body
+    std::vector<std::string_view> params;
+    for (size_t i = 1; i + 1 < child->children.size(); ++i)
+      params.push_back(child->children[i]->text);
+    if (!child->children.empty())
+      OptimizeUnit({child->children.back()}, params);
+  }
+  OptimizeUnit(topLevel, {});
+}
+
+// A local is only propagated when its single declaration is the only write
+// to it: with one slot per name and function that makes every read see it.
+void ASTOptimizer::OptimizeUnit(const std::vector<ASTNode *> &stmts, const std::vector<std::string_view> &params) {
+  std::unordered_map<std::string_view, int> decls;
+  std::unordered_set<std::string_view> assigned(params.begin(), params.end());
+  for (auto *stmt : stmts)
+    CollectWrites(stmt, decls, assigned);
+
+  candidates_.clear();
+  for (const auto &[name, count] : decls)
+    if (count == 1 && !assigned.count(name))
+      candidates_.insert(name);
+
+  known_.clear();
+  for (auto *stmt : stmts)
+    Statement(stmt);
+}
+
+void ASTOptimizer::CollectWrites(const ASTNode *node, std::unordered_map<std::string_view, int> &decls,
+                                 std::unordered_set<std::string_view> &assigned) const {
+  if (!node)
+    return;
+
+  if (node->kind == NodeKind::VarDecl)
+    decls[node->text]++;
+  else if (node->kind == NodeKind::Assign && !node->children.empty() &&
+           node->children[0]->kind == NodeKind::Identifier)
+    assigned.insert(node->children[0]->text);
+
+  for (auto &child : node->children)
+    CollectWrites(child, decls, assigned);
+}
+
+void ASTOptimizer::Statement(ASTNode *node) {
+  if (!node)
+    return;
+
+  switch (node->kind) {
+    case NodeKind::Block: {
+      size_t mark = known_.size();
+      for (auto &stmt : node->children)
+        Statement(stmt);
+      known_.resize(mark);
+      break;
+    }
+
+    case NodeKind::VarDeclList:
+      // children[0] — TypeNode
+      for (size_t i = 1; i < node->children.size(); ++i) {
+        auto *var = node->children[i];
+        if (!var->children.empty())
+          Expression(var->children[0]);
+        if (var->isArray || !candidates_.count(var->text))
+          continue;
+
+        // an uninitialized scalar is stored as int 0
+        Const c;
+        if (var->children.empty() || ToConst(var->children[0], c))
+          known_.emplace_back(var->text, c);
+      }
+      break;
+
+    case NodeKind::ExprStmt:
+    case NodeKind::Return:
+      if (!node->children.empty())
+        Expression(node->children[0]);
+      break;
+
+    case NodeKind::Assign:
+      Expression(node);
+      break;
+
+    case NodeKind::If:
+      Expression(node->children[0]);
+      Statement(node->children[1]);
+      for (size_t i = 2; i < node->children.size(); ++i) {
+        ASTNode *child = node->children[i];
+        if (child->kind == NodeKind::ElseIf) {
+          Expression(child->children[0]);
+          Statement(child->children[1]);
+        } else {
+          Statement(child);
+        }
+      }
+      break;
+
+    case NodeKind::While:
+      Expression(node->children[0]);
+      Statement(node->children[1]);
+      break;
+
+    case NodeKind::DoWhile:
+      Statement(node->children[0]);
+      Expression(node->children[1]);
+      break;
+
+    case NodeKind::For: {
+      // AST: children[0]=init, children[1]=cond, children[2]=step, children[3]=body
+      size_t mark = known_.size();
+      Statement(node->children[0]);
+      Expression(node->children[1]);
+      Expression(node->children[2]);
+      Statement(node->children[3]);
+      known_.resize(mark);
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+void ASTOptimizer::Expression(ASTNode *node) {
+  if (!node)
+    return;
+
+  switch (node->kind) {
+    case NodeKind::Identifier:
+      if (const Const *c = Lookup(node->text))
+        SetConst(node, *c);
+      break;
+
+    case NodeKind::Assign: {
+      // the target itself is written, only its index is an expression
+      auto *target = node->children[0];
+      if (target->kind == NodeKind::Index) {
+        Expression(target->children[0]);
+        Expression(target->children[1]);
+      }
+      Expression(node->children[1]);
+      break;
+    }
+
+    case NodeKind::Call:
+      // children[0] is the callee name
+      for (size_t i = 1; i < node->children.size(); ++i)
+        Expression(node->children[i]);
+      break;
+
+    case NodeKind::Unary:
+      Expression(node->children[0]);
+      FoldUnary(node);
+      break;
+
+    case NodeKind::Binary:
+      Expression(node->children[0]);
+      Expression(node->children[1]);
+      FoldBinary(node);
+      if (node->kind == NodeKind::Binary)
+        Simplify(node);
+      break;
+
+    case NodeKind::Index:
+    case NodeKind::CommaExpr:
+      for (auto &child : node->children)
+        Expression(child);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void ASTOptimizer::FoldUnary(ASTNode *node) {
+  Const v;
+  if (!ToConst(node->children[0], v))
+    return;
+
+  Const r;
+  if (node->text == "+") {
+    r = v;
+  } else if (node->text == "-") {
+    r.isDouble = v.isDouble;
+    r.i = WrapSub(0, v.i);
+    r.d = -v.d;
+  } else if (node->text == "!") {
+    r.i = (v.isDouble ? v.d == 0.0 : v.i == 0) ? 1 : 0;
+  } else {
+    return;
+  }
+  SetConst(node, r);
+}
+
+// Mirrors the VM's generic operators: int op int stays int, a double on either
+// side promotes both, int / 0 and int % 0 give 0, == / != compare the printed forms.
+void ASTOptimizer::FoldBinary(ASTNode *node) {
+  Const a, b;
+  if (!ToConst(node->children[0], a) || !ToConst(node->children[1], b))
+    return;
+
+  std::string_view op = node->text;
+  bool dbl = a.isDouble || b.isDouble;
+  double x = a.isDouble ? a.d : static_cast<double>(a.i);
+  double y = b.isDouble ? b.d : static_cast<double>(b.i);
+  Const r;
+
+  auto text = [](const Const &c) {
+    if (!c.isDouble) return std::to_string(c.i);
+    std::ostringstream oss; oss << c.d; return oss.str();
+  };
+
+  if (op == "+" || op == "-" || op == "*" || op == "/") {
+    if (dbl) {
+      r.isDouble = true;
+      r.d = op == "+" ? x + y : op == "-" ? x - y : op == "*" ? x * y : x / y;
+      if (!std::isfinite(r.d)) return;  // no literal spells it
+    } else if (op == "+") {
+      r.i = WrapAdd(a.i, b.i);
+    } else if (op == "-") {
+      r.i = WrapSub(a.i, b.i);
+    } else if (op == "*") {
+      r.i = WrapMul(a.i, b.i);
+    } else {
+      if (b.i == -1 && a.i == std::numeric_limits<int64_t>::min()) return;  // traps at run time
+      r.i = b.i == 0 ? 0 : a.i / b.i;
+    }
+  } else if (op == "%") {
+    if (dbl) return;
+    if (b.i == -1 && a.i == std::numeric_limits<int64_t>::min()) return;
+    r.i = b.i == 0 ? 0 : a.i % b.i;
+  } else if (op == "==" || op == "!=") {
+    bool same = text(a) == text(b);
+    r.i = (op == "==") == same ? 1 : 0;
+  } else if (op == "<") {
+    r.i = dbl ? x < y : a.i < b.i;
+  } else if (op == ">") {
+    r.i = dbl ? x > y : a.i > b.i;
+  } else if (op == "<=") {
+    r.i = dbl ? x <= y : a.i <= b.i;
+  } else if (op == ">=") {
+    r.i = dbl ? x >= y : a.i >= b.i;
+  } else {
+    return;
+  }
+  SetConst(node, r);
+}
+
+// Identities on int operands. These rely on the SemanticAnalyzer types: for a
+// string (x + 0 concatenates) or a double they would not hold.
+void ASTOptimizer::Simplify(ASTNode *node) {
+  if (!IsInt(node) || !IsInt(node->children[0]) || !IsInt(node->children[1]))
+    return;
+
+  std::string_view op = node->text;
+  Const l, r;
+  bool lConst = ToConst(node->children[0], l) && !l.isDouble;
+  bool rConst = ToConst(node->children[1], r) && !r.isDouble;
+
+  // (x + a) - b and friends become x + (a - b)
+  ASTNode *inner = node->children[0];
+  Const a;
+  if ((op == "+" || op == "-") && rConst && inner->kind == NodeKind::Binary &&
+      (inner->text == "+" || inner->text == "-") && IsInt(inner) && IsInt(inner->children[0]) &&
+      ToConst(inner->children[1], a) && !a.isDouble) {
+    Const k;
+    k.i = WrapAdd(inner->text == "+" ? a.i : WrapSub(0, a.i), op == "+" ? r.i : WrapSub(0, r.i));
+
+    ASTNode *c = inner->children[1];
+    SetConst(c, k);
+    node->text = arena_.Intern("+");
+    node->children[0] = inner->children[0];
+    node->children[1] = c;
+    lConst = false;
+    rConst = true;
+    r = k;
+  }
+
+  if (rConst && ((op == "+" || op == "-") ? r.i == 0 : (op == "*" || op == "/") && r.i == 1))
+    Replace(node, 0);
+  else if (lConst && ((op == "+" && l.i == 0) || (op == "*" && l.i == 1)))
+    Replace(node, 1);
+}
+
+bool ASTOptimizer::IsInt(const ASTNode *node) const {
+  if (!types_) return false;
+  auto it = types_->find(node);
+  return it != types_->end() && it->second == TypeKind::INT;
+}
+
+const ASTOptimizer::Const *ASTOptimizer::Lookup(std::string_view name) const {
+  for (auto it = known_.rbegin(); it != known_.rend(); ++it)
+    if (it->first == name)
+      return &it->second;
+  return nullptr;
+}
+
+bool ASTOptimizer::ToConst(const ASTNode *node, Const &out) {
+  if (!node || node->kind != NodeKind::Number)
+    return false;
+  out = Const{};
+  if (IsFloatingLiteral(node->text)) {
+    out.isDouble = true;
+    try { out.d = std::stod(std::string(node->text)); } catch (...) { out.d = 0.0; }
+  } else {
+    out.i = ParseIntLiteral(node->text);
+  }
+  return true;
+}
+
+void ASTOptimizer::SetConst(ASTNode *node, const Const &c) {
+  node->kind = NodeKind::Number;
+  node->isArray = false;
+  node->children.clear();
+  if (!c.isDouble) {
+    node->text = arena_.Intern(std::to_string(c.i));
+    return;
+  }
+
+  // enough digits to read back the same double, and still looks like one
+  char buf[32];
+  std::snprintf(buf, sizeof buf, "%.17g", c.d);
+  std::string text = buf;
+  if (!IsFloatingLiteral(text))
+    text += ".0";
+  node->text = arena_.Intern(text);
+}
+
+// Only operands that leave exactly one value behind may take the operator's
+// place: a bare call or assignment changes what ExprStmt pops.
+void ASTOptimizer::Replace(ASTNode *node, size_t child) {
+  switch (node->children[child]->kind) {
+    case NodeKind::Identifier:
+    case NodeKind::Number:
+    case NodeKind::Index:
+    case NodeKind::Unary:
+    case NodeKind::Binary: {
+      *node = *node->children[child];
+      break;
+    }
+    default:
+      break;
+  }
+}
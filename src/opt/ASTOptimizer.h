@@ -0,0 +1,62 @@
+#ifndef AST_OPTIMIZER_H
+#define AST_OPTIMIZER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../parser/AST.h"
+#include "../semantics/SemanticAnalyzer.h"
+
+// Simplifies a checked AST in place before RPN generation:
+//   - constant folding of int / double literal arithmetic, comparisons, ! and unary -
+//   - constant propagation of scalar locals that are declared once with a
+//     constant initializer and never assigned afterwards
+//   - algebraic identities on int operands (x + 0, x * 1, x / 1, (x + a) - b, ...)
+// Folded nodes are rewritten rather than replaced, so the SemanticAnalyzer
+// types recorded for them stay valid for the generator.
+class ASTOptimizer {
+ public:
+  // folded literals are interned in `arena`, the one the tree was parsed into
+  explicit ASTOptimizer(ASTArena &arena, const ExprTypes *types = nullptr) : arena_(arena), types_(types) {}
+
+  void Optimize(ASTNode *root);
+
+ private:
+  // a literal value, carrying the VM's own int / double distinction
+  struct Const {
+    bool isDouble = false;
+    int64_t i = 0;
+    double d = 0.0;
+  };
+
+  ASTArena &arena_;
+  const ExprTypes *types_;
+
+  // names that may be propagated in the unit (function body / top level) being optimized
+  std::unordered_set<std::string_view> candidates_;
+  // constants visible at the current point, innermost last
+  std::vector<std::pair<std::string_view, Const>> known_;
+
+  void OptimizeUnit(const std::vector<ASTNode *> &stmts, const std::vector<std::string_view> &params);
+  void CollectWrites(const ASTNode *node, std::unordered_map<std::string_view, int> &decls,
+                     std::unordered_set<std::string_view> &assigned) const;
+
+  void Statement(ASTNode *node);
+  void Expression(ASTNode *node);
+  void FoldUnary(ASTNode *node);
+  void FoldBinary(ASTNode *node);
+  void Simplify(ASTNode *node);
+
+  bool IsInt(const ASTNode *node) const;
+  const Const *Lookup(std::string_view name) const;
+
+  static bool ToConst(const ASTNode *node, Const &out);
+  void SetConst(ASTNode *node, const Const &c);
+  static void Replace(ASTNode *node, size_t child);
+};
+
+#endif // AST_OPTIMIZER_H
@@ -0,0 +1,600 @@
+#include "LoopOptimizer.h"
+
+#include <initializer_list>
+#include <limits>
+#include <string>
+#include <utility>
+
+#include "../rpn/RPNInstruction.h"
+
+static bool IsFloatingLiteral(std::string_view s) {
+  for (char c : s) {
+    if (c == '.' || c == 'e' || c == 'E') return true;
+  }
+  return false;
+}
+
+static bool HasIdentifier(const ASTNode *node) {
+  if (!node) return false;
+  if (node->kind == NodeKind::Identifier) return true;
+  for (const ASTNode *child : node->children)
+    if (HasIdentifier(child)) return true;
+  return false;
+}
+
+void LoopOptimizer::Optimize(ASTNode *root) {
+  if (!root)
+    return;
+
+  std::unordered_set<std::string_view> functions;
+  for (auto &child : root->children)
+    if (child && child->kind == NodeKind::Function)
+      functions.insert(child->text);
+  Optimize(root, functions);
+}
+
+void LoopOptimizer::Optimize(ASTNode *root, const std::unordered_set<std::string_view> &functions) {
+  if (!root)
+    return;
+
+  functions_ = &functions;
+
+  // top-level statements share the bottom frame, every function has its own
+  std::vector<ASTNode *> topLevel;
+  for (auto &child : root->children) {
+    if (!child) continue;
+    if (child->kind != NodeKind::Function) {
+      topLevel.push_back(child);
+      continue;
+    }
+
+    // children[0] is the return type, children[1..n-2] the parameters, the last one the body
+    std::vector<const ASTNode *> params;
+    for (size_t i = 1; i + 1 < child->children.size(); ++i)
+      params.push_back(child->children[i]);
+    if (!child->children.empty())
+      OptimizeUnit({child->children.back()}, params);
+  }
+  OptimizeUnit(topLevel, {});
+}
+
+void LoopOptimizer::OptimizeUnit(const std::vector<ASTNode *> &stmts, const std::vector<const ASTNode *> &params) {
+  decls_.clear();
+  assigned_.clear();
+  visible_.clear();
+  ranges_.clear();
+  hoisted_ = 0;
+
+  for (const ASTNode *param : params) {
+    decls_[param->text]++;
+    visible_.push_back({param->text, param->isArray, nullptr});
+  }
+  for (auto *stmt : stmts)
+    CollectWrites(stmt, decls_, assigned_);
+
+  const ASTNode *prev = nullptr;
+  for (auto *stmt : stmts) {
+    Statement(stmt, prev);
+    prev = stmt;
+  }
+}
+
+void LoopOptimizer::CollectWrites(const ASTNode *node, std::unordered_map<std::string_view, int> &decls,
+                                  std::unordered_set<std::string_view> &assigned) {
+  if (!node)
+    return;
+
+  if (node->kind == NodeKind::VarDecl)
+    decls[node->text]++;
+  else if (node->kind == NodeKind::Assign && !node->children.empty() &&
+           node->children[0]->kind == NodeKind::Identifier)
+    assigned.insert(node->children[0]->text);
+
+  for (const ASTNode *child : node->children)
+    CollectWrites(child, decls, assigned);
+}
+
+void LoopOptimizer::Statements(ChildList &stmts) {
+  size_t mark = visible_.size();
+  const ASTNode *prev = nullptr;
+  for (auto &stmt : stmts) {
+    Statement(stmt, prev);
+    prev = stmt;
+  }
+  visible_.resize(mark);
+}
+
+// `prev` is the statement run right before this one in the same block, if any.
+void LoopOptimizer::Statement(ASTNode *node, const ASTNode *prev) {
+  if (!node)
+    return;
+
+  switch (node->kind) {
+    case NodeKind::Block:
+      Statements(node->children);
+      break;
+
+    case NodeKind::VarDeclList:
+      // children[0] — TypeNode
+      for (size_t i = 1; i < node->children.size(); ++i) {
+        auto *var = node->children[i];
+        for (auto &child : var->children)
+          Expression(child);
+
+        // one declaration and no assignment: the slot holds this array from here on,
+        // only ever grown by stores; the generator sizes it by children[0]
+        Decl decl{var->text, var->isArray, nullptr};
+        int64_t n;
+        if (var->isArray && decls_[var->text] == 1 && !assigned_.count(var->text) && !var->children.empty() &&
+            (IntLiteral(var->children[0], n) || IsStable(var->children[0])))
+          decl.size = var->children[0];
+        visible_.push_back(decl);
+      }
+      break;
+
+    case NodeKind::ExprStmt:
+    case NodeKind::Return:
+      if (!node->children.empty())
+        Expression(node->children[0]);
+      break;
+
+    case NodeKind::Assign:
+      Expression(node);
+      break;
+
+    case NodeKind::If: {
+      auto branch = [&](ASTNode *body) {
+        size_t mark = visible_.size();
+        Statement(body, nullptr);
+        visible_.resize(mark);
+      };
+      Expression(node->children[0]);
+      branch(node->children[1]);
+      for (size_t i = 2; i < node->children.size(); ++i) {
+        ASTNode *child = node->children[i];
+        if (child->kind == NodeKind::ElseIf) {
+          Expression(child->children[0]);
+          branch(child->children[1]);
+        } else {
+          branch(child);
+        }
+      }
+      break;
+    }
+
+    case NodeKind::While:
+    case NodeKind::DoWhile:
+    case NodeKind::For:
+      Loop(node, prev);
+      break;
+
+    default:
+      break;
+  }
+}
+
+void LoopOptimizer::Loop(ASTNode *node, const ASTNode *prev) {
+  size_t mark = visible_.size();
+
+  if (node->kind == NodeKind::For) {
+    // AST: children[0]=init, children[1]=cond, children[2]=step, children[3]=body
+    ASTNode *init = node->children[0];
+    if (init && init->kind == NodeKind::VarDeclList)
+      Statement(init, nullptr);
+    else
+      Expression(init);
+    Expression(node->children[1]);
+    Expression(node->children[2]);
+
+    Range range;
+    bool counted = CountingLoop(node, init ? init : prev, range);
+    if (counted)
+      ranges_.push_back(range);
+    Statement(node->children[3], nullptr);
+    if (counted)
+      ranges_.pop_back();
+    if (BulkCall(node)) {
+      visible_.resize(mark);
+      return;
+    }
+  } else if (node->kind == NodeKind::While) {
+    Expression(node->children[0]);
+    Statement(node->children[1], nullptr);
+  } else {
+    Statement(node->children[0], nullptr);
+    Expression(node->children[1]);
+  }
+
+  visible_.resize(mark);
+  Hoist(node);
+}
+
+void LoopOptimizer::Expression(ASTNode *node) {
+  if (!node)
+    return;
+
+  for (auto &child : node->children)
+    Expression(child);
+
+  if (node->kind != NodeKind::Index)
+    return;
+  const ASTNode *base = node->children[0];
+  const ASTNode *index = node->children[1];
+  if (base->kind != NodeKind::Identifier || index->kind != NodeKind::Identifier || !IsInt(index))
+    return;
+  const Decl *array = Visible(base->text);
+  if (!array || !array->isArray || !array->size)
+    return;
+
+  for (const Range &r : ranges_) {
+    if (r.index != index->text)
+      continue;
+    int64_t size, bound;
+    bool inside = IntLiteral(array->size, size) && IntLiteral(r.bound, bound)
+                      ? (r.inclusive ? bound < size : bound <= size)
+                      : !r.inclusive && Same(array->size, r.bound);
+    if (inside) {
+      node->inBounds = true;
+      return;
+    }
+  }
+}
+
+// for (<i = lo>; i < bound; i = i + step) with an int literal lo >= 0, set by
+// the init or, without one, by the statement right before the loop, and i
+// written by nothing but the step. The step is small enough that i cannot
+// wrap around before it passes the size of any array.
+bool LoopOptimizer::CountingLoop(const ASTNode *loop, const ASTNode *start, Range &out) const {
+  const ASTNode *cond = loop->children[1];
+  const ASTNode *step = loop->children[2];
+  if (!cond || !step || cond->kind != NodeKind::Binary || (cond->text != "<" && cond->text != "<="))
+    return false;
+  const ASTNode *index = cond->children[0];
+  if (index->kind != NodeKind::Identifier || !IsInt(index))
+    return false;
+  std::string_view i = index->text;
+
+  int64_t k;
+  if (step->kind != NodeKind::Assign || step->children[0]->kind != NodeKind::Identifier ||
+      step->children[0]->text != i)
+    return false;
+  const ASTNode *next = step->children[1];
+  if (next->kind != NodeKind::Binary || next->text != "+" || next->children[0]->kind != NodeKind::Identifier ||
+      next->children[0]->text != i || !IntLiteral(next->children[1], k) || k <= 0 ||
+      k > std::numeric_limits<int32_t>::max())
+    return false;
+
+  // the value i enters the loop with
+  int64_t lo = -1;
+  if (start && start->kind == NodeKind::ExprStmt && !start->children.empty())
+    start = start->children[0];
+  if (start && start->kind == NodeKind::VarDeclList) {
+    const ASTNode *var = start->children.back();
+    if (var->kind != NodeKind::VarDecl || var->text != i || var->isArray)
+      return false;
+    if (var->children.empty()) lo = 0;
+    else if (!IntLiteral(var->children[0], lo)) return false;
+  } else if (start && start->kind == NodeKind::Assign && start->children[0]->kind == NodeKind::Identifier &&
+             start->children[0]->text == i) {
+    if (!IntLiteral(start->children[1], lo)) return false;
+  }
+  if (lo < 0)
+    return false;
+
+  std::unordered_map<std::string_view, int> decls;
+  std::unordered_set<std::string_view> assigned;
+  CollectWrites(cond, decls, assigned);
+  CollectWrites(loop->children[3], decls, assigned);
+  if (decls.count(i) || assigned.count(i))
+    return false;
+
+  const ASTNode *bound = cond->children[1];
+  int64_t m;
+  if (!IntLiteral(bound, m) && (cond->text == "<=" || !IsStable(bound)))
+    return false;
+  out = Range{i, bound, cond->text == "<="};
+  return true;
+}
+
+const LoopOptimizer::Decl *LoopOptimizer::Visible(std::string_view name) const {
+  for (auto it = visible_.rbegin(); it != visible_.rend(); ++it)
+    if (it->name == name)
+      return &*it;
+  return nullptr;
+}
+
+// Int arithmetic over literals and scalar locals that are declared once
+// before this point and never assigned: it gives the same value wherever it
+// is evaluated from here on.
+bool LoopOptimizer::IsStable(const ASTNode *expr) const {
+  int64_t n;
+  switch (expr->kind) {
+    case NodeKind::Number:
+      return IntLiteral(expr, n);
+    case NodeKind::Identifier: {
+      auto it = decls_.find(expr->text);
+      const Decl *decl = Visible(expr->text);
+      return IsInt(expr) && it != decls_.end() && it->second == 1 && !assigned_.count(expr->text) && decl &&
+             !decl->isArray;
+    }
+    case NodeKind::Unary:
+      return expr->text == "-" && IsInt(expr) && IsStable(expr->children[0]);
+    case NodeKind::Binary:
+      return (expr->text == "+" || expr->text == "-" || expr->text == "*" || expr->text == "/" ||
+              expr->text == "%") &&
+             IsInt(expr) && IsStable(expr->children[0]) && IsStable(expr->children[1]);
+    default:
+      return false;
+  }
+}
+
+bool LoopOptimizer::IsInt(const ASTNode *node) const {
+  if (!types_) return false;
+  auto it = types_->find(node);
+  return it != types_->end() && it->second == TypeKind::INT;
+}
+
+// for (<init>; i < bound; i = i + 1) { <one statement> } over an int array,
+// as the builtin that does the same (see Builtins.cpp):
+//   a[i] = v;          ->  a = fill(a, i, bound, v);
+//   a[i] = b[i + c];   ->  a = copy(a, i, b, i + c, bound - i);
+//   s = s + a[i + c];  ->  s = s + sum(a, i + c, bound + c);
+// The loop node becomes { <init>; if (i < bound) { <call>; i = bound; } },
+// so i ends up where the loop would have left it. v, c and bound are pure
+// and do not read what the loop writes; v and c are also evaluated when the
+// loop would not have run, so they must not divide.
+bool LoopOptimizer::BulkCall(ASTNode *loop) {
+  ASTNode *cond = loop->children[1];
+  const ASTNode *step = loop->children[2];
+  const ASTNode *body = loop->children[3];
+  if (!cond || !step || !body || cond->kind != NodeKind::Binary || cond->text != "<")
+    return false;
+  const ASTNode *index = cond->children[0];
+  ASTNode *bound = cond->children[1];
+  if (index->kind != NodeKind::Identifier || !IsInt(index) || !IsPure(bound, true) || Reads(bound, index->text))
+    return false;
+  std::string_view i = index->text;
+
+  int64_t k;
+  if (step->kind != NodeKind::Assign || step->children[0]->kind != NodeKind::Identifier ||
+      step->children[0]->text != i || step->children[1]->kind != NodeKind::Binary ||
+      step->children[1]->text != "+" || step->children[1]->children[0]->kind != NodeKind::Identifier ||
+      step->children[1]->children[0]->text != i || !IntLiteral(step->children[1]->children[1], k) || k != 1)
+    return false;
+
+  if (body->kind != NodeKind::Block || body->children.size() != 1)
+    return false;
+  ASTNode *stmt = body->children[0];
+  if (stmt->kind == NodeKind::ExprStmt && !stmt->children.empty())
+    stmt = stmt->children[0];
+  if (stmt->kind != NodeKind::Assign)
+    return false;
+  ASTNode *target = stmt->children[0];
+  ASTNode *value = stmt->children[1];
+  if (!IsInt(target) || !IsInt(value))
+    return false;
+
+  auto isArray = [&](const ASTNode *node) {
+    const Decl *decl = node->kind == NodeKind::Identifier ? Visible(node->text) : nullptr;
+    return decl && decl->isArray;
+  };
+  auto make = [&](NodeKind kind, std::string_view text, std::initializer_list<ASTNode *> children) {
+    ASTNode *node = arena_.Make(kind, arena_.Intern(text));
+    for (ASTNode *child : children)
+      arena_.Append(node, child);
+    return node;
+  };
+  auto ident = [&](std::string_view name) { return make(NodeKind::Identifier, name, {}); };
+  // i + c / i - c as a fresh node, or i itself
+  auto shifted = [&](ASTNode *base, ASTNode *offset, bool minus) {
+    return offset ? make(NodeKind::Binary, minus ? "-" : "+", {base, offset}) : base;
+  };
+
+  ASTNode *call = nullptr;
+  std::string_view result;
+  auto builtin = [&](std::string_view name) { return !functions_->count(name); };
+  ASTNode *offset = nullptr;
+  bool minus = false;
+  if (target->kind == NodeKind::Index) {
+    ASTNode *array = target->children[0];
+    if (!isArray(array) || target->children[1]->kind != NodeKind::Identifier || target->children[1]->text != i ||
+        Reads(bound, array->text))
+      return false;
+    result = array->text;
+    ASTNode *source = value->kind == NodeKind::Index ? value->children[0] : nullptr;
+    if (source && isArray(source) && source->text != array->text &&
+        IndexOffset(value->children[1], i, offset, minus) && !Reads(offset, array->text) && builtin("copy")) {
+      call = make(NodeKind::Call, "Call",
+                  {ident("copy"), ident(array->text), ident(i), ident(source->text),
+                   shifted(ident(i), offset, minus), make(NodeKind::Binary, "-", {bound, ident(i)})});
+    } else if (IsPure(value, false) && !Reads(value, i) && !Reads(value, array->text) && builtin("fill")) {
+      call = make(NodeKind::Call, "Call", {ident("fill"), ident(array->text), ident(i), bound, value});
+    } else {
+      return false;
+    }
+  } else if (target->kind == NodeKind::Identifier) {
+    result = target->text;
+    const Decl *decl = Visible(result);
+    if (result == i || !decl || decl->isArray || value->kind != NodeKind::Binary || value->text != "+" ||
+        Reads(bound, result))
+      return false;
+    ASTNode *element = value->children[0];
+    ASTNode *acc = value->children[1];
+    if (element->kind == NodeKind::Identifier)
+      std::swap(element, acc);
+    if (acc->kind != NodeKind::Identifier || acc->text != result || element->kind != NodeKind::Index ||
+        !IsInt(element) || !isArray(element->children[0]) || element->children[0]->text == result ||
+        !IndexOffset(element->children[1], i, offset, minus) || Reads(offset, result) || !builtin("sum"))
+      return false;
+    std::string_view array = element->children[0]->text;
+    ASTNode *sum = make(NodeKind::Call, "Call",
+                        {ident("sum"), ident(array), shifted(ident(i), offset, minus),
+                         shifted(bound, offset, minus)});
+    call = make(NodeKind::Binary, "+", {ident(result), sum});
+  } else {
+    return false;
+  }
+
+  ASTNode *then = make(NodeKind::Block, "Block",
+                       {make(NodeKind::ExprStmt, "ExprStmt", {make(NodeKind::Assign, "=", {ident(result), call})}),
+                        make(NodeKind::ExprStmt, "ExprStmt", {make(NodeKind::Assign, "=", {ident(i), bound})})});
+  ASTNode *guard = make(NodeKind::If, "If", {cond, then});
+  ASTNode *init = loop->children[0];
+  loop->kind = NodeKind::Block;
+  loop->text = arena_.Intern("Block");
+  loop->children.clear();
+  if (init)
+    arena_.Append(loop, init);
+  arena_.Append(loop, guard);
+  return true;
+}
+
+// Moves each invariant part of the condition into a fresh local: the loop
+// node becomes a block declaring them, followed by the loop itself.
+void LoopOptimizer::Hoist(ASTNode *loop) {
+  size_t c = loop->kind == NodeKind::While ? 0 : 1;
+  if (c >= loop->children.size() || !loop->children[c])
+    return;
+
+  std::unordered_map<std::string_view, int> decls;
+  std::unordered_set<std::string_view> written;
+  CollectWrites(loop, decls, written);
+  for (const auto &[name, count] : decls)
+    written.insert(name);
+
+  std::vector<ASTNode *> invariants;
+  CollectInvariants(loop->children[c], written, invariants);
+  if (invariants.empty())
+    return;
+
+  ASTNode *list = arena_.Make(NodeKind::VarDeclList, "VarDeclList");
+  arena_.Append(list, arena_.Make(NodeKind::TypeNode, "int"));
+  for (ASTNode *expr : invariants) {
+    // the copy computes the value before the loop; the original node, typed
+    // INT, turns into a read of it
+    ASTNode *copy = arena_.Make(expr->kind, expr->text);
+    for (ASTNode *child : expr->children)
+      arena_.Append(copy, child);
+    std::string_view name = arena_.Intern("$inv" + std::to_string(hoisted_++));
+    expr->kind = NodeKind::Identifier;
+    expr->text = name;
+    expr->children.clear();
+
+    ASTNode *var = arena_.Make(NodeKind::VarDecl, name);
+    arena_.Append(var, copy);
+    arena_.Append(list, var);
+  }
+
+  ASTNode *inner = arena_.Make(loop->kind, loop->text);
+  arena_.Resize(inner, loop->children.size());
+  for (size_t i = 0; i < loop->children.size(); ++i)
+    inner->children[i] = loop->children[i];
+  loop->kind = NodeKind::Block;
+  loop->text = arena_.Intern("Block");
+  loop->children.clear();
+  arena_.Append(loop, list);
+  arena_.Append(loop, inner);
+}
+
+// Largest invariant operator subtrees that read at least one local (the
+// rest ASTOptimizer has already folded).
+void LoopOptimizer::CollectInvariants(ASTNode *node, const std::unordered_set<std::string_view> &written,
+                                      std::vector<ASTNode *> &out) const {
+  if (!node)
+    return;
+  if ((node->kind == NodeKind::Binary || node->kind == NodeKind::Unary) && IsInvariant(node, written) &&
+      HasIdentifier(node)) {
+    out.push_back(node);
+    return;
+  }
+  for (auto &child : node->children)
+    CollectInvariants(child, written, out);
+}
+
+// Only + - * and negation: they cannot trap, so computing them once before
+// the loop is safe even where the loop would not have evaluated them.
+bool LoopOptimizer::IsInvariant(const ASTNode *node, const std::unordered_set<std::string_view> &written) const {
+  int64_t n;
+  switch (node->kind) {
+    case NodeKind::Number:
+      return IntLiteral(node, n);
+    case NodeKind::Identifier: {
+      const Decl *decl = Visible(node->text);
+      return IsInt(node) && !written.count(node->text) && decl && !decl->isArray;
+    }
+    case NodeKind::Unary:
+      return node->text == "-" && IsInt(node) && IsInvariant(node->children[0], written);
+    case NodeKind::Binary:
+      return (node->text == "+" || node->text == "-" || node->text == "*") && IsInt(node) &&
+             IsInvariant(node->children[0], written) && IsInvariant(node->children[1], written);
+    default:
+      return false;
+  }
+}
+
+// index is i, i + c, c + i or i - c with a pure c that does not read i and cannot trap
+bool LoopOptimizer::IndexOffset(ASTNode *index, std::string_view i, ASTNode *&offset, bool &minus) {
+  offset = nullptr;
+  minus = false;
+  if (index->kind == NodeKind::Identifier)
+    return index->text == i;
+  if (index->kind != NodeKind::Binary || (index->text != "+" && index->text != "-"))
+    return false;
+  ASTNode *lhs = index->children[0];
+  ASTNode *rhs = index->children[1];
+  if (index->text == "+" && rhs->kind == NodeKind::Identifier && rhs->text == i)
+    std::swap(lhs, rhs);
+  if (lhs->kind != NodeKind::Identifier || lhs->text != i || !IsPure(rhs, false) || Reads(rhs, i))
+    return false;
+  offset = rhs;
+  minus = index->text == "-";
+  return true;
+}
+
+// Reads of locals and elements, literals and operators: no calls or
+// assignments, and without mayTrap no division by a possible zero either.
+bool LoopOptimizer::IsPure(const ASTNode *node, bool mayTrap) {
+  switch (node->kind) {
+    case NodeKind::Number:
+    case NodeKind::String:
+    case NodeKind::Identifier:
+      return true;
+    case NodeKind::Binary:
+      if (!mayTrap && (node->text == "/" || node->text == "%"))
+        return false;
+      [[fallthrough]];
+    case NodeKind::Unary:
+    case NodeKind::Index:
+      for (const ASTNode *child : node->children)
+        if (!IsPure(child, mayTrap)) return false;
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool LoopOptimizer::Reads(const ASTNode *node, std::string_view name) {
+  if (!node) return false;
+  if (node->kind == NodeKind::Identifier && node->text == name) return true;
+  for (const ASTNode *child : node->children)
+    if (Reads(child, name)) return true;
+  return false;
+}
+
+bool LoopOptimizer::IntLiteral(const ASTNode *node, int64_t &out) {
+  if (!node || node->kind != NodeKind::Number || IsFloatingLiteral(node->text))
+    return false;
+  out = ParseIntLiteral(node->text);
+  return true;
+}
+
+bool LoopOptimizer::Same(const ASTNode *a, const ASTNode *b) {
+  if (!a || !b)
+    return a == b;
+  if (a->kind != b->kind || a->text != b->text || a->children.size() != b->children.size())
+    return false;
+  for (size_t i = 0; i < a->children.size(); ++i)
+    if (!Same(a->children[i], b->children[i]))
+      return false;
+  return true;
+}
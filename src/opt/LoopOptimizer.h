@@ -0,0 +1,93 @@
+#ifndef LOOP_OPTIMIZER_H
+#define LOOP_OPTIMIZER_H
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../parser/AST.h"
+#include "../semantics/SemanticAnalyzer.h"
+
+// Loop analysis on a checked, ASTOptimizer-simplified AST, run before RPN
+// generation at -O2:
+//   - bounds-check elimination: in a canonical counting loop
+//       for (<i = lo>; i < bound; i = i + step) ... a[i] ...
+//     with lo >= 0 and `a` declared as `a[bound]` (the same expression over
+//     locals nothing writes, or int literals with bound <= size), a[i] is
+//     marked inBounds and generated as LOAD_INDEX_UNSAFE / STORE_INDEX_UNSAFE
+//   - loop-invariant hoisting: int arithmetic in a loop condition over locals
+//     the loop does not write (`i < 2 * n`) is computed once into a hidden
+//     local declared just before the loop
+//   - bulk array loops: a counting loop whose body is a single fill, copy or
+//     sum over an int array becomes one call of the fill / copy / sum builtin
+// Like ASTOptimizer it rewrites nodes in place, so nodes the SemanticAnalyzer
+// typed keep their types.
+class LoopOptimizer {
+ public:
+  explicit LoopOptimizer(ASTArena &arena, const ExprTypes *types = nullptr) : arena_(arena), types_(types) {}
+
+  void Optimize(ASTNode *root);
+  // For a root holding only part of the program (see CompileServer):
+  // `functions` names all of the program's functions.
+  void Optimize(ASTNode *root, const std::unordered_set<std::string_view> &functions);
+
+ private:
+  // a name declared in an enclosing block before the current point
+  struct Decl {
+    std::string_view name;
+    bool isArray = false;
+    const ASTNode *size = nullptr;  // arrays whose size is known to stay what it was declared with
+  };
+
+  // inside the body of a canonical loop: 0 <= index < bound (<= for inclusive)
+  struct Range {
+    std::string_view index;
+    const ASTNode *bound;
+    bool inclusive;
+  };
+
+  ASTArena &arena_;
+  const ExprTypes *types_;
+
+  // the program's functions, which shadow builtins of the same name
+  const std::unordered_set<std::string_view> *functions_ = nullptr;
+
+  // writes in the unit (function body / top level) being optimized; parameters count as declarations
+  std::unordered_map<std::string_view, int> decls_;
+  std::unordered_set<std::string_view> assigned_;
+
+  std::vector<Decl> visible_;
+  std::vector<Range> ranges_;
+  int hoisted_ = 0;
+
+  void OptimizeUnit(const std::vector<ASTNode *> &stmts, const std::vector<const ASTNode *> &params);
+  static void CollectWrites(const ASTNode *node, std::unordered_map<std::string_view, int> &decls,
+                            std::unordered_set<std::string_view> &assigned);
+
+  void Statements(ChildList &stmts);
+  void Statement(ASTNode *node, const ASTNode *prev);
+  void Loop(ASTNode *node, const ASTNode *prev);
+  void Expression(ASTNode *node);
+
+  bool CountingLoop(const ASTNode *loop, const ASTNode *prev, Range &out) const;
+  const Decl *Visible(std::string_view name) const;
+  bool IsStable(const ASTNode *expr) const;
+  bool IsInt(const ASTNode *node) const;
+
+  bool BulkCall(ASTNode *loop);
+
+  void Hoist(ASTNode *loop);
+  void CollectInvariants(ASTNode *node, const std::unordered_set<std::string_view> &written,
+                         std::vector<ASTNode *> &out) const;
+  bool IsInvariant(const ASTNode *node, const std::unordered_set<std::string_view> &written) const;
+
+  static bool IndexOffset(ASTNode *index, std::string_view i, ASTNode *&offset, bool &minus);
+  static bool IsPure(const ASTNode *node, bool mayTrap);
+  static bool Reads(const ASTNode *node, std::string_view name);
+  static bool IntLiteral(const ASTNode *node, int64_t &out);
+  static bool Same(const ASTNode *a, const ASTNode *b);
+};
+
+#endif // LOOP_OPTIMIZER_H
@@ -0,0 +1,198 @@
+#include "PeepholeOptimizer.h"
+
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+std::vector<Instruction> PeepholeOptimizer::Optimize(std::vector<Instruction> code) const {
+  if (level_ <= 0)
+    return code;
+
+  ThreadJumps(code);
+  while (RemoveDeadCode(code)) {
+  }
+
+  if (level_ >= 2)
+    FuseSuperinstructions(code);
+
+  return code;
+}
+
+// JMP / JZ to a label whose first instruction is another JMP goes straight
+// to the final destination.
+void PeepholeOptimizer::ThreadJumps(std::vector<Instruction> &code) {
+  std::unordered_map<std::string, size_t> labels;
+  for (size_t i = 0; i < code.size(); ++i)
+    if (code[i].op == OpCode::LABEL)
+      labels[code[i].arg] = i;
+
+  // first real instruction at or after a label
+  auto landing = [&](const std::string &label) -> const Instruction * {
+    auto it = labels.find(label);
+    if (it == labels.end()) return nullptr;
+    size_t i = it->second;
+    while (i < code.size() && code[i].op == OpCode::LABEL) i++;
+    return i < code.size() ? &code[i] : nullptr;
+  };
+
+  for (auto &ins : code) {
+    if (!IsJump(ins.op)) continue;
+    std::unordered_set<std::string> seen{ins.arg};
+    const Instruction *next = landing(ins.arg);
+    while (next && next->op == OpCode::JMP && seen.insert(next->arg).second) {
+      ins.arg = next->arg;
+      next = landing(ins.arg);
+    }
+  }
+}
+
+// Drops instructions that follow an unconditional JMP / RET / TAIL_CALL up to the next
+// label that is still jumped to or called, labels nobody references, and
+// JMPs to the very next instruction. Returns true if anything changed.
+bool PeepholeOptimizer::RemoveDeadCode(std::vector<Instruction> &code) {
+  std::unordered_set<std::string> referenced{"main"};
+  for (const auto &ins : code)
+    if (IsJump(ins.op) || ins.op == OpCode::CALL || ins.op == OpCode::TAIL_CALL)
+      referenced.insert(ins.arg);
+
+  std::vector<Instruction> out;
+  out.reserve(code.size());
+  bool reachable = true;
+  for (const auto &ins : code) {
+    if (ins.op == OpCode::LABEL) {
+      if (!referenced.count(ins.arg)) continue;
+      reachable = true;
+    }
+    if (!reachable) continue;
+    out.push_back(ins);
+    if (ins.op == OpCode::JMP || ins.op == OpCode::RET || ins.op == OpCode::TAIL_CALL)
+      reachable = false;
+  }
+
+  // JMP L immediately followed by LABEL L (possibly among other labels)
+  std::vector<Instruction> result;
+  result.reserve(out.size());
+  for (size_t i = 0; i < out.size(); ++i) {
+    if (out[i].op == OpCode::JMP) {
+      bool toNext = false;
+      for (size_t j = i + 1; j < out.size() && out[j].op == OpCode::LABEL; ++j)
+        if (out[j].arg == out[i].arg) toNext = true;
+      if (toNext) continue;
+    }
+    result.push_back(out[i]);
+  }
+
+  bool changed = result.size() != code.size();
+  code = std::move(result);
+  return changed;
+}
+
+namespace {
+
+// Maps an int comparison to its fused JZ_<cmp>_IMM / JZ_<cmp>_LOCAL form.
+bool CompareJump(OpCode cmp, bool local, OpCode &out) {
+  static const OpCode kImm[] = {OpCode::JZ_EQ_IMM, OpCode::JZ_NEQ_IMM, OpCode::JZ_LT_IMM,
+                                OpCode::JZ_GT_IMM, OpCode::JZ_LE_IMM, OpCode::JZ_GE_IMM};
+  static const OpCode kLocal[] = {OpCode::JZ_EQ_LOCAL, OpCode::JZ_NEQ_LOCAL, OpCode::JZ_LT_LOCAL,
+                                  OpCode::JZ_GT_LOCAL, OpCode::JZ_LE_LOCAL, OpCode::JZ_GE_LOCAL};
+  int k;
+  switch (cmp) {
+    case OpCode::EQ_I64: k = 0; break;
+    case OpCode::NEQ_I64: k = 1; break;
+    case OpCode::LT_I64: k = 2; break;
+    case OpCode::GT_I64: k = 3; break;
+    case OpCode::LE_I64: k = 4; break;
+    case OpCode::GE_I64: k = 5; break;
+    default: return false;
+  }
+  out = local ? kLocal[k] : kImm[k];
+  return true;
+}
+
+bool FitsInt32(int64_t v) {
+  return v >= std::numeric_limits<int32_t>::min() && v <= std::numeric_limits<int32_t>::max();
+}
+
+}  // namespace
+
+// Only the *_I64 forms are fused: their generic fallback is what the fused
+// handler falls back to as well, so the result is unchanged for any operand.
+void PeepholeOptimizer::FuseSuperinstructions(std::vector<Instruction> &code) {
+  std::vector<Instruction> out;
+  out.reserve(code.size());
+
+  auto at = [&](size_t i, OpCode op) { return i < code.size() && code[i].op == op; };
+
+  for (size_t i = 0; i < code.size(); ++i) {
+    const Instruction &ins = code[i];
+    if (ins.op != OpCode::LOAD) {
+      out.push_back(ins);
+      continue;
+    }
+
+    // LOAD x; PUSH_INT c; ...
+    if (at(i + 1, OpCode::PUSH_INT)) {
+      int64_t c = ParseIntLiteral(code[i + 1].arg);
+
+      // ...ADD_I64 / SUB_I64; STORE x
+      if ((at(i + 2, OpCode::ADD_I64) || at(i + 2, OpCode::SUB_I64)) &&
+          at(i + 3, OpCode::STORE) && code[i + 3].operand == ins.operand &&
+          c != std::numeric_limits<int64_t>::min()) {
+        Instruction fused(OpCode::INC_LOCAL, ins.arg, ins.operand);
+        fused.imm = code[i + 2].op == OpCode::ADD_I64 ? c : -c;
+        out.push_back(fused);
+        i += 3;
+        continue;
+      }
+
+      // ...<cmp>_I64; JZ label
+      OpCode jump;
+      if (i + 2 < code.size() && CompareJump(code[i + 2].op, false, jump) &&
+          at(i + 3, OpCode::JZ) && FitsInt32(c)) {
+        Instruction fused(jump, code[i + 3].arg, ins.operand);
+        fused.imm = c;
+        out.push_back(fused);
+        i += 3;
+        continue;
+      }
+
+      // ...ADD_I64
+      if (at(i + 2, OpCode::ADD_I64)) {
+        Instruction fused(OpCode::ADD_LOCAL_IMM, ins.arg, ins.operand);
+        fused.imm = c;
+        out.push_back(fused);
+        i += 2;
+        continue;
+      }
+    }
+
+    // LOAD x; LOAD y; ...
+    if (at(i + 1, OpCode::LOAD)) {
+      const Instruction &y = code[i + 1];
+
+      // ...<cmp>_I64; JZ label
+      OpCode jump;
+      if (i + 2 < code.size() && CompareJump(code[i + 2].op, true, jump) && at(i + 3, OpCode::JZ)) {
+        Instruction fused(jump, code[i + 3].arg, ins.operand);
+        fused.imm = y.operand;
+        out.push_back(fused);
+        i += 3;
+        continue;
+      }
+
+      // ...ADD_I64
+      if (at(i + 2, OpCode::ADD_I64)) {
+        Instruction fused(OpCode::LOAD_LOAD_ADD, ins.arg + "," + y.arg, ins.operand);
+        fused.imm = y.operand;
+        out.push_back(fused);
+        i += 2;
+        continue;
+      }
+    }
+
+    out.push_back(ins);
+  }
+
+  code = std::move(out);
+}
@@ -0,0 +1,25 @@
+#ifndef PEEPHOLE_OPTIMIZER_H
+#define PEEPHOLE_OPTIMIZER_H
+
+#include <vector>
+#include "../rpn/RPNInstruction.h"
+
+// Rewrites the POLIZ stream between RPNGenerator and the VM.
+//   level 0: code is left exactly as generated
+//   level 1: jump threading, unreachable code and redundant jumps removed
+//   level 2: additionally fuses common sequences into superinstructions
+class PeepholeOptimizer {
+ public:
+  explicit PeepholeOptimizer(int level = 2) : level_(level) {}
+
+  std::vector<Instruction> Optimize(std::vector<Instruction> code) const;
+
+ private:
+  int level_;
+
+  static void ThreadJumps(std::vector<Instruction> &code);
+  static bool RemoveDeadCode(std::vector<Instruction> &code);
+  static void FuseSuperinstructions(std::vector<Instruction> &code);
+};
+
+#endif // PEEPHOLE_OPTIMIZER_H
@@ -0,0 +1,61 @@
+#include "AST.h"
+
+#include <algorithm>
+#include <cstring>
+
+void *ASTArena::Allocate(size_t bytes, size_t align) {
+  auto p = reinterpret_cast<uintptr_t>(cur_);
+  uintptr_t aligned = (p + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+  if (!cur_ || aligned + bytes > reinterpret_cast<uintptr_t>(end_)) {
+    // oversized requests get a block of their own
+    size_t size = std::max(kBlockSize, bytes + align);
+    blocks_.push_back(std::make_unique<char[]>(size));
+    cur_ = blocks_.back().get();
+    end_ = cur_ + size;
+    p = reinterpret_cast<uintptr_t>(cur_);
+    aligned = (p + align - 1) & ~(static_cast<uintptr_t>(align) - 1);
+  }
+  cur_ = reinterpret_cast<char *>(aligned + bytes);
+  return reinterpret_cast<void *>(aligned);
+}
+
+ASTNode *ASTArena::Make(NodeKind kind, std::string_view text) {
+  auto *node = new (Allocate(sizeof(ASTNode), alignof(ASTNode))) ASTNode{};
+  node->kind = kind;
+  node->text = Intern(text);
+  return node;
+}
+
+std::string_view ASTArena::Intern(std::string_view s) {
+  if (s.empty()) return {};
+  auto it = strings_.find(s);
+  if (it != strings_.end()) return *it;
+  char *copy = static_cast<char *>(Allocate(s.size(), 1));
+  std::memcpy(copy, s.data(), s.size());
+  return *strings_.emplace(copy, s.size()).first;
+}
+
+// The old array is left behind in the arena; doubling keeps that waste bounded.
+void ASTArena::Reserve(ChildList &list, size_t n) {
+  if (n <= list.capacity_) return;
+  size_t capacity = std::max<size_t>({n, 2 * static_cast<size_t>(list.capacity_), 2});
+  auto **data = static_cast<ASTNode **>(Allocate(capacity * sizeof(ASTNode *), alignof(ASTNode *)));
+  if (list.size_)
+    std::memcpy(data, list.data_, list.size_ * sizeof(ASTNode *));
+  list.data_ = data;
+  list.capacity_ = static_cast<uint32_t>(capacity);
+}
+
+void ASTArena::Append(ASTNode *parent, ASTNode *child) {
+  ChildList &list = parent->children;
+  Reserve(list, list.size_ + 1);
+  list.data_[list.size_++] = child;
+}
+
+void ASTArena::Resize(ASTNode *parent, size_t n) {
+  ChildList &list = parent->children;
+  Reserve(list, n);
+  for (size_t i = list.size_; i < n; ++i)
+    list.data_[i] = nullptr;
+  list.size_ = static_cast<uint32_t>(n);
+}
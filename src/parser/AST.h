@@ -1,9 +1,12 @@
 #ifndef AST_H
 #define AST_H
 
-#include <string>
-#include <vector>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
 
 enum class NodeKind {
   Program,
@@ -67,19 +70,72 @@ inline const char *NodeKindToString(NodeKind k) {
   }
 }
 
+struct ASTNode;
+
+// Children of a node: a pointer array that lives in the tree's ASTArena and is
+// grown (by ASTArena::Append / Resize) into fresh arena space when it fills.
+class ChildList {
+ public:
+  [[nodiscard]] size_t size() const { return size_; }
+  [[nodiscard]] bool empty() const { return size_ == 0; }
+
+  ASTNode *&operator[](size_t i) { return data_[i]; }
+  ASTNode *operator[](size_t i) const { return data_[i]; }
+  [[nodiscard]] ASTNode *back() const { return data_[size_ - 1]; }
+
+  ASTNode **begin() { return data_; }
+  ASTNode **end() { return data_ + size_; }
+  ASTNode *const *begin() const { return data_; }
+  ASTNode *const *end() const { return data_ + size_; }
+
+  void clear() { size_ = 0; }
+
+ private:
+  friend class ASTArena;
+
+  ASTNode **data_ = nullptr;
+  uint32_t size_ = 0;
+  uint32_t capacity_ = 0;
+};
+
+// Trivially destructible: the arena releases a whole tree at once.
 struct ASTNode {
   NodeKind kind;
-  std::string text;
   bool isArray = false;
+  bool inBounds = false;  // Index: LoopOptimizer proved the subscript inside the array
+  std::string_view text;  // interned by the arena the node came from
 
-  std::vector<std::unique_ptr<ASTNode>> children;
+  ChildList children;
 };
 
-inline std::unique_ptr<ASTNode> make_node(NodeKind kind, const std::string &text = "") {
-  auto n = std::make_unique<ASTNode>();
-  n->kind = kind;
-  n->text = text;
-  return n;
-}
+// Owns every node, child array and string of one or more trees. Nodes are
+// bump-allocated from large blocks in creation order, so a parse produces a
+// tree laid out about as it is walked, and all of it is freed with the arena.
+class ASTArena {
+ public:
+  ASTArena() = default;
+  ASTArena(const ASTArena &) = delete;
+  ASTArena &operator=(const ASTArena &) = delete;
+
+  ASTNode *Make(NodeKind kind, std::string_view text = {});
+
+  // One copy per distinct string; equal texts share storage.
+  std::string_view Intern(std::string_view s);
+
+  void Append(ASTNode *parent, ASTNode *child);
+  // Grows (with null children) or shrinks the child list to n.
+  void Resize(ASTNode *parent, size_t n);
+
+ private:
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+  char *cur_ = nullptr;
+  char *end_ = nullptr;
+  std::unordered_set<std::string_view> strings_;
+
+  void *Allocate(size_t bytes, size_t align);
+  void Reserve(ChildList &list, size_t n);
+};
 
 #endif // AST_H
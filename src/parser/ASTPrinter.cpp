@@ -19,6 +19,6 @@ void ASTPrinter::Print(const ASTNode *node, std::ostream &out, int indent) {
   out << "\n";
 
   for (auto &child: node->children) {
-    Print(child.get(), out, indent + 1);
+    Print(child, out, indent + 1);
   }
 }
@@ -5,18 +5,27 @@
 //  Parser implementation with error accumulation and basic recovery
 // -----------------------------------------------------------------------------
 
-Parser::Parser(const std::vector<Token> &tokens) : tokens_(tokens), pos_(0) {}
+Parser::Parser(Lexer &lexer, ASTArena &arena) : lexer_(lexer), arena_(arena) {
+    current_ = lexer_.NextToken();
+    previous_ = current_;
+}
 
 // Helpers
-const Token &Parser::Peek() const {
-    if (pos_ < tokens_.size()) return tokens_[pos_];
-    static Token eof{TokenType::END_OF_FILE, "", 0, 0};
-    return eof;
-}
+const Token &Parser::Peek() const { return current_; }
 const Token &Parser::Current() const { return Peek(); }
+const Token &Parser::Previous() const { return previous_; }
 
+// Tokens are pulled from the lexer one at a time; stepping over the final
+// END_OF_FILE leaves a position-less one behind, as running off the end did.
 void Parser::Advance() {
-    if (pos_ < tokens_.size()) ++pos_;
+    if (pastEnd_) return;
+    previous_ = current_;
+    if (current_.type == TokenType::END_OF_FILE) {
+        current_ = Token{TokenType::END_OF_FILE, "", 0, 0};
+        pastEnd_ = true;
+        return;
+    }
+    current_ = lexer_.NextToken();
 }
 
 bool Parser::IsAtEnd() const {
@@ -44,9 +53,8 @@ void Parser::AddError(const std::string &msg) {
 // Expect: не бросает, а добавляет ошибку и продвигается
 const Token &Parser::Expect(TokenType t, const std::string &errMsg) {
     if (Peek().type == t) {
-        const Token &tok = Peek();
         Advance();
-        return tok;
+        return Previous();
     }
     // Ошибка: ожидается другой токен
     std::ostringstream oss;
@@ -62,27 +70,27 @@ const Token &Parser::Expect(TokenType t, const std::string &errMsg) {
         int line = Peek().line;
         int col = Peek().col;
         Advance();
-        static Token dummy{TokenType::UNKNOWN, "", 0, 0};
+        static thread_local Token dummy{TokenType::UNKNOWN, "", 0, 0};
         dummy.line = line;
         dummy.col = col;
         return dummy;
     } else {
-        static Token eofTok{TokenType::END_OF_FILE, "", Peek().line, Peek().col};
+        static thread_local Token eofTok{TokenType::END_OF_FILE, "", Peek().line, Peek().col};
         return eofTok;
     }
 }
 
 // ---------------- Program ----------------
-std::unique_ptr<ASTNode> Parser::ParseProgram() {
-    auto root = make_node(NodeKind::Program, "Program");
+ASTNode *Parser::ParseProgram() {
+    auto root = arena_.Make(NodeKind::Program, "Program");
     while (!IsAtEnd()) {
         if (Match(TokenType::SEMICOLON)) continue;
-        root->children.push_back(ParseTopLevel());
+        arena_.Append(root, ParseTopLevel());
     }
     return root;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseTopLevel() {
+ASTNode *Parser::ParseTopLevel() {
     if (Peek().type == TokenType::KW_FN) {
         return ParseFunction();
     }
@@ -91,7 +99,7 @@ std::unique_ptr<ASTNode> Parser::ParseTopLevel() {
 }
 
 // ---------------- Function ----------------
-std::unique_ptr<ASTNode> Parser::ParseFunction() {
+ASTNode *Parser::ParseFunction() {
     Expect(TokenType::KW_FN, "expected 'fn'");
 
     // return type
@@ -101,16 +109,16 @@ std::unique_ptr<ASTNode> Parser::ParseFunction() {
         // use default int token (without consuming)
         retTok = Token{TokenType::KW_INT, "int", Peek().line, Peek().col};
     } else {
-        retTok = tokens_[pos_ - 1];
+        retTok = Previous();
     }
-    auto fnNode = make_node(NodeKind::Function, "Function");
+    auto fnNode = arena_.Make(NodeKind::Function, "Function");
 
     // return type child
-    fnNode->children.push_back(MakeTypeNode(retTok));
+    arena_.Append(fnNode, MakeTypeNode(retTok));
 
     // name
     Token nameTok = Expect(TokenType::IDENTIFIER, "expected function name");
-    fnNode->text = nameTok.text; // store function name in text
+    fnNode->text = arena_.Intern(nameTok.text); // store function name in text
 
     // args
     Expect(TokenType::LPAREN, "expected '(' after function name");
@@ -123,27 +131,27 @@ std::unique_ptr<ASTNode> Parser::ParseFunction() {
                 Token argTypeTok{TokenType::KW_INT, "int", Peek().line, Peek().col};
                 // try to recover by not consuming and attempt to parse name
                 Token argNameTok = Expect(TokenType::IDENTIFIER, "expected argument name");
-                auto argNode = make_node(NodeKind::FuncArg);
-                argNode->children.push_back(MakeTypeNode(argTypeTok));
-                argNode->text = argNameTok.text;
+                auto argNode = arena_.Make(NodeKind::FuncArg);
+                arena_.Append(argNode, MakeTypeNode(argTypeTok));
+                argNode->text = arena_.Intern(argNameTok.text);
                 // optional [] after arg name
                 if (Match(TokenType::LBRACKET)) {
                     Expect(TokenType::RBRACKET, "expected ']'");
                     argNode->isArray = true;
                 }
-                fnNode->children.push_back(std::move(argNode));
+                arena_.Append(fnNode, argNode);
             } else {
-                Token argTypeTok = tokens_[pos_ - 1];
+                Token argTypeTok = Previous();
                 Token argNameTok = Expect(TokenType::IDENTIFIER, "expected argument name");
-                auto argNode = make_node(NodeKind::FuncArg);
-                argNode->children.push_back(MakeTypeNode(argTypeTok));
-                argNode->text = argNameTok.text;
+                auto argNode = arena_.Make(NodeKind::FuncArg);
+                arena_.Append(argNode, MakeTypeNode(argTypeTok));
+                argNode->text = arena_.Intern(argNameTok.text);
                 // optional [] after arg name
                 if (Match(TokenType::LBRACKET)) {
                     Expect(TokenType::RBRACKET, "expected ']'");
                     argNode->isArray = true;
                 }
-                fnNode->children.push_back(std::move(argNode));
+                arena_.Append(fnNode, argNode);
             }
 
             if (Match(TokenType::COMMA)) continue;
@@ -154,23 +162,23 @@ std::unique_ptr<ASTNode> Parser::ParseFunction() {
 
     // body (scope)
     auto body = ParseBlock();
-    fnNode->children.push_back(std::move(body));
+    arena_.Append(fnNode, body);
     return fnNode;
 }
 
 // ---------------- Block / Statements ----------------
-std::unique_ptr<ASTNode> Parser::ParseBlock() {
+ASTNode *Parser::ParseBlock() {
     Expect(TokenType::LBRACE, "expected '{'");
-    auto block = make_node(NodeKind::Block, "Block");
+    auto block = arena_.Make(NodeKind::Block, "Block");
     while (!IsAtEnd() && Peek().type != TokenType::RBRACE) {
         if (Match(TokenType::SEMICOLON)) continue;
-        block->children.push_back(ParseStatement());
+        arena_.Append(block, ParseStatement());
     }
     Expect(TokenType::RBRACE, "expected '}'");
     return block;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseStatement() {
+ASTNode *Parser::ParseStatement() {
     switch (Peek().type) {
         case TokenType::LBRACE:
             return ParseBlock();
@@ -199,35 +207,35 @@ std::unique_ptr<ASTNode> Parser::ParseStatement() {
     }
 }
 
-std::unique_ptr<ASTNode> Parser::ParseVarDeclList(TokenType firstTypeTok) {
+ASTNode *Parser::ParseVarDeclList(TokenType firstTypeTok) {
     // consume type
     Expect(firstTypeTok, "expected type");
-    Token typeTok = tokens_[ (pos_>0) ? pos_ - 1 : 0 ];
-    auto listNode = make_node(NodeKind::VarDeclList, "VarDeclList");
+    Token typeTok = Previous();
+    auto listNode = arena_.Make(NodeKind::VarDeclList, "VarDeclList");
     // store type as first child for convenience
-    listNode->children.push_back(MakeTypeNode(typeTok));
+    arena_.Append(listNode, MakeTypeNode(typeTok));
 
     // at least one VarDecl
     while (true) {
         Token idTok = Expect(TokenType::IDENTIFIER, "expected variable name");
-        auto varNode = make_node(NodeKind::VarDecl, idTok.text);
+        auto varNode = arena_.Make(NodeKind::VarDecl, idTok.text);
 
         // VarDeclSuffix = '=' Expression ArraySuffix | ArraySuffix | ε
         if (Match(TokenType::ASSIGN)) {
-            varNode->children.push_back(ParseAssignment()); // init expression
+            arena_.Append(varNode, ParseAssignment()); // init expression
             // optionally array suffix after init
             if (Match(TokenType::LBRACKET)) {
                 varNode->isArray = true;
-                varNode->children.push_back(ParseExpression()); // array size expr
+                arena_.Append(varNode, ParseExpression()); // array size expr
                 Expect(TokenType::RBRACKET, "expected ']'");
             }
         } else if (Match(TokenType::LBRACKET)) {
             // ArraySuffix: '[' Expression ']'
             varNode->isArray = true;
-            varNode->children.push_back(ParseExpression()); // array size
+            arena_.Append(varNode, ParseExpression()); // array size
             Expect(TokenType::RBRACKET, "expected ']'");
         }
-        listNode->children.push_back(std::move(varNode));
+        arena_.Append(listNode, varNode);
         if (Match(TokenType::COMMA)) continue;
         break;
     }
@@ -235,16 +243,16 @@ std::unique_ptr<ASTNode> Parser::ParseVarDeclList(TokenType firstTypeTok) {
     return listNode;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseIf() {
+ASTNode *Parser::ParseIf() {
     Expect(TokenType::KW_IF, "expected 'if'");
     Expect(TokenType::LPAREN, "expected '(' after if");
     auto cond = ParseExpression();
     Expect(TokenType::RPAREN, "expected ')' after if condition");
     auto thenScope = ParseBlock();
 
-    auto ifNode = make_node(NodeKind::If, "If");
-    ifNode->children.push_back(std::move(cond));
-    ifNode->children.push_back(std::move(thenScope));
+    auto ifNode = arena_.Make(NodeKind::If, "If");
+    arena_.Append(ifNode, cond);
+    arena_.Append(ifNode, thenScope);
 
     // ElseIfList and ElseOpt handling
     while (true) {
@@ -258,16 +266,16 @@ std::unique_ptr<ASTNode> Parser::ParseIf() {
                 auto ec = ParseExpression();
                 Expect(TokenType::RPAREN, "expected ')' after else if cond");
                 auto esc = ParseBlock();
-                auto elseifNode = make_node(NodeKind::ElseIf, "ElseIf");
-                elseifNode->children.push_back(std::move(ec));
-                elseifNode->children.push_back(std::move(esc));
-                ifNode->children.push_back(std::move(elseifNode));
+                auto elseifNode = arena_.Make(NodeKind::ElseIf, "ElseIf");
+                arena_.Append(elseifNode, ec);
+                arena_.Append(elseifNode, esc);
+                arena_.Append(ifNode, elseifNode);
                 // continue loop to see further else/else if
                 continue;
             } else {
                 // plain else
                 auto elseScope = ParseBlock();
-                ifNode->children.push_back(std::move(elseScope));
+                arena_.Append(ifNode, elseScope);
                 break; // else is last
             }
         }
@@ -277,19 +285,19 @@ std::unique_ptr<ASTNode> Parser::ParseIf() {
     return ifNode;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseWhile() {
+ASTNode *Parser::ParseWhile() {
     Expect(TokenType::KW_WHILE, "expected 'while'");
     Expect(TokenType::LPAREN, "expected '(' after while");
     auto cond = ParseExpression();
     Expect(TokenType::RPAREN, "expected ')' after while condition");
     auto body = ParseBlock();
-    auto node = make_node(NodeKind::While, "While");
-    node->children.push_back(std::move(cond));
-    node->children.push_back(std::move(body));
+    auto node = arena_.Make(NodeKind::While, "While");
+    arena_.Append(node, cond);
+    arena_.Append(node, body);
     return node;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseDoWhile() {
+ASTNode *Parser::ParseDoWhile() {
     Expect(TokenType::KW_DO, "expected 'do'");
     auto body = ParseBlock();
     Expect(TokenType::KW_WHILE, "expected 'while' after do-block");
@@ -297,21 +305,21 @@ std::unique_ptr<ASTNode> Parser::ParseDoWhile() {
     auto cond = ParseExpression();
     Expect(TokenType::RPAREN, "expected ')'");
     Expect(TokenType::SEMICOLON, "expected ';' after do-while");
-    auto node = make_node(NodeKind::DoWhile, "DoWhile");
-    node->children.push_back(std::move(body));
-    node->children.push_back(std::move(cond));
+    auto node = arena_.Make(NodeKind::DoWhile, "DoWhile");
+    arena_.Append(node, body);
+    arena_.Append(node, cond);
     return node;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseFor() {
+ASTNode *Parser::ParseFor() {
     Expect(TokenType::KW_FOR, "expected 'for'");
     Expect(TokenType::LPAREN, "expected '(' after for");
 
-    auto node = make_node(NodeKind::For, "For");
+    auto node = arena_.Make(NodeKind::For, "For");
 
     // Ensure the for-node always has 4 children: init, cond, step, body.
     // We pre-allocate them as nullptrs.
-    node->children.resize(4);
+    arena_.Resize(node, 4);
 
     // --- 1. Init Part ---
     if (Peek().type == TokenType::KW_INT || Peek().type == TokenType::KW_CHAR ||
@@ -346,52 +354,52 @@ std::unique_ptr<ASTNode> Parser::ParseFor() {
     return node;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseReturn() {
+ASTNode *Parser::ParseReturn() {
     Expect(TokenType::KW_RETURN, "expected 'return'");
-    auto node = make_node(NodeKind::Return, "Return");
+    auto node = arena_.Make(NodeKind::Return, "Return");
     if (Peek().type != TokenType::SEMICOLON) {
-        node->children.push_back(ParseExpression());
+        arena_.Append(node, ParseExpression());
     }
     Expect(TokenType::SEMICOLON, "expected ';' after return");
     return node;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseBreak() {
+ASTNode *Parser::ParseBreak() {
     Expect(TokenType::KW_BREAK, "expected 'break'");
     Expect(TokenType::SEMICOLON, "expected ';' after break");
-    return make_node(NodeKind::Break, "Break");
+    return arena_.Make(NodeKind::Break, "Break");
 }
 
-std::unique_ptr<ASTNode> Parser::ParseContinue() {
+ASTNode *Parser::ParseContinue() {
     Expect(TokenType::KW_CONTINUE, "expected 'continue'");
     Expect(TokenType::SEMICOLON, "expected ';' after continue");
-    return make_node(NodeKind::Continue, "Continue");
+    return arena_.Make(NodeKind::Continue, "Continue");
 }
 
-std::unique_ptr<ASTNode> Parser::ParseExprStmt() {
-    auto n = make_node(NodeKind::ExprStmt, "ExprStmt");
-    n->children.push_back(ParseExpression());
+ASTNode *Parser::ParseExprStmt() {
+    auto n = arena_.Make(NodeKind::ExprStmt, "ExprStmt");
+    arena_.Append(n, ParseExpression());
     Expect(TokenType::SEMICOLON, "expected ';' after expression");
     return n;
 }
 
 // ---------------- Expressions ----------------
 
-std::unique_ptr<ASTNode> Parser::ParseExpression() {
+ASTNode *Parser::ParseExpression() {
     // ExprComma = AssignmentExpr { ',' AssignmentExpr }
     auto left = ParseAssignment();
     while (Match(TokenType::COMMA)) {
         auto right = ParseAssignment();
-        auto comma = make_node(NodeKind::CommaExpr, ",");
-        comma->children.push_back(std::move(left));
-        comma->children.push_back(std::move(right));
-        left = std::move(comma);
+        auto comma = arena_.Make(NodeKind::CommaExpr, ",");
+        arena_.Append(comma, left);
+        arena_.Append(comma, right);
+        left = comma;
     }
     return left;
 }
 
 // AssignmentExpr = Identifier AssignOrExpr | NonIdExpr
-std::unique_ptr<ASTNode> Parser::ParseAssignment() {
+ASTNode *Parser::ParseAssignment() {
     // assignment has the lowest precedence except comma,
     // so first parse normal expression
     auto lhs = ParseEquality();
@@ -407,146 +415,146 @@ std::unique_ptr<ASTNode> Parser::ParseAssignment() {
         AddError("left side of assignment must be variable or array element");
         // still parse RHS to continue
         auto rhs = ParseAssignment();
-        auto as = make_node(NodeKind::Assign, "=");
-        as->children.push_back(std::move(lhs));
-        as->children.push_back(std::move(rhs));
+        auto as = arena_.Make(NodeKind::Assign, "=");
+        arena_.Append(as, lhs);
+        arena_.Append(as, rhs);
         return as;
     }
 
     auto rhs = ParseAssignment(); // right associative
-    auto as = make_node(NodeKind::Assign, "=");
-    as->children.push_back(std::move(lhs));
-    as->children.push_back(std::move(rhs));
+    auto as = arena_.Make(NodeKind::Assign, "=");
+    arena_.Append(as, lhs);
+    arena_.Append(as, rhs);
     return as;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseNonIdExpr() {
+ASTNode *Parser::ParseNonIdExpr() {
     // kept for compatibility; not used now
     return ParseEquality();
 }
 
-std::unique_ptr<ASTNode> Parser::ParseEquality() {
+ASTNode *Parser::ParseEquality() {
     auto node = ParseRelational();
     while (true) {
         if (Match(TokenType::EQ)) {
             auto rhs = ParseRelational();
-            auto b = make_node(NodeKind::Binary, "==");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(rhs));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, "==");
+            arena_.Append(b, node);
+            arena_.Append(b, rhs);
+            node = b;
         } else if (Match(TokenType::NEQ)) {
             auto rhs = ParseRelational();
-            auto b = make_node(NodeKind::Binary, "!=");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(rhs));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, "!=");
+            arena_.Append(b, node);
+            arena_.Append(b, rhs);
+            node = b;
         } else break;
     }
     return node;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseRelational() {
+ASTNode *Parser::ParseRelational() {
     auto node = ParseAdditive();
     while (true) {
         if (Match(TokenType::LT)) {
             auto r = ParseAdditive();
-            auto b = make_node(NodeKind::Binary, "<");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(r));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, "<");
+            arena_.Append(b, node);
+            arena_.Append(b, r);
+            node = b;
         } else if (Match(TokenType::LE)) {
             auto r = ParseAdditive();
-            auto b = make_node(NodeKind::Binary, "<=");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(r));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, "<=");
+            arena_.Append(b, node);
+            arena_.Append(b, r);
+            node = b;
         } else if (Match(TokenType::GT)) {
             auto r = ParseAdditive();
-            auto b = make_node(NodeKind::Binary, ">");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(r));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, ">");
+            arena_.Append(b, node);
+            arena_.Append(b, r);
+            node = b;
         } else if (Match(TokenType::GE)) {
             auto r = ParseAdditive();
-            auto b = make_node(NodeKind::Binary, ">=");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(r));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, ">=");
+            arena_.Append(b, node);
+            arena_.Append(b, r);
+            node = b;
         } else break;
     }
     return node;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseAdditive() {
+ASTNode *Parser::ParseAdditive() {
     auto node = ParseMultiplicative();
     while (true) {
         if (Match(TokenType::PLUS)) {
             auto r = ParseMultiplicative();
-            auto b = make_node(NodeKind::Binary, "+");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(r));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, "+");
+            arena_.Append(b, node);
+            arena_.Append(b, r);
+            node = b;
         } else if (Match(TokenType::MINUS)) {
             auto r = ParseMultiplicative();
-            auto b = make_node(NodeKind::Binary, "-");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(r));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, "-");
+            arena_.Append(b, node);
+            arena_.Append(b, r);
+            node = b;
         } else break;
     }
     return node;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseMultiplicative() {
+ASTNode *Parser::ParseMultiplicative() {
     auto node = ParseUnary();
     while (true) {
         if (Match(TokenType::STAR)) {
             auto r = ParseUnary();
-            auto b = make_node(NodeKind::Binary, "*");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(r));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, "*");
+            arena_.Append(b, node);
+            arena_.Append(b, r);
+            node = b;
         } else if (Match(TokenType::SLASH)) {
             auto r = ParseUnary();
-            auto b = make_node(NodeKind::Binary, "/");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(r));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, "/");
+            arena_.Append(b, node);
+            arena_.Append(b, r);
+            node = b;
         } else if (Match(TokenType::PERCENT)) {
             auto r = ParseUnary();
-            auto b = make_node(NodeKind::Binary, "%");
-            b->children.push_back(std::move(node));
-            b->children.push_back(std::move(r));
-            node = std::move(b);
+            auto b = arena_.Make(NodeKind::Binary, "%");
+            arena_.Append(b, node);
+            arena_.Append(b, r);
+            node = b;
         } else break;
     }
     return node;
 }
 
-std::unique_ptr<ASTNode> Parser::ParseUnary() {
+ASTNode *Parser::ParseUnary() {
     if (Match(TokenType::PLUS)) {
-        auto u = make_node(NodeKind::Unary, "+");
-        u->children.push_back(ParseUnary());
+        auto u = arena_.Make(NodeKind::Unary, "+");
+        arena_.Append(u, ParseUnary());
         return u;
     }
     if (Match(TokenType::MINUS)) {
-        auto u = make_node(NodeKind::Unary, "-");
-        u->children.push_back(ParseUnary());
+        auto u = arena_.Make(NodeKind::Unary, "-");
+        arena_.Append(u, ParseUnary());
         return u;
     }
     return ParsePrimary();
 }
 
-std::unique_ptr<ASTNode> Parser::ParsePrimary() {
+ASTNode *Parser::ParsePrimary() {
     if (Match(TokenType::NUMBER)) {
-        return make_node(NodeKind::Number, tokens_[pos_ - 1].text);
+        return arena_.Make(NodeKind::Number, Previous().text);
     }
     if (Match(TokenType::STRING_LITERAL)) {
-        return make_node(NodeKind::String, tokens_[pos_ - 1].text);
+        return arena_.Make(NodeKind::String, Previous().text);
     }
     if (Match(TokenType::IDENTIFIER)) {
-        auto id = make_node(NodeKind::Identifier, tokens_[pos_ - 1].text);
-        return ParsePrimaryIdTail(std::move(id));
+        auto id = arena_.Make(NodeKind::Identifier, Previous().text);
+        return ParsePrimaryIdTail(id);
     }
     if (Match(TokenType::LPAREN)) {
         auto e = ParseExpression();
@@ -559,32 +567,32 @@ std::unique_ptr<ASTNode> Parser::ParsePrimary() {
     AddError(oss.str());
     // skip the token and return a dummy literal to allow parsing to continue
     if (!IsAtEnd()) Advance();
-    return make_node(NodeKind::Number, "0");
+    return arena_.Make(NodeKind::Number, "0");
 }
 
-std::unique_ptr<ASTNode> Parser::ParsePrimaryIdTail(std::unique_ptr<ASTNode> idNode) {
-    std::unique_ptr<ASTNode> primary = std::move(idNode);
+ASTNode *Parser::ParsePrimaryIdTail(ASTNode *idNode) {
+    ASTNode *primary = idNode;
     while (true) {
         if (Match(TokenType::LPAREN)) {
-            auto call = make_node(NodeKind::Call, "Call");
-            call->children.push_back(std::move(primary));
+            auto call = arena_.Make(NodeKind::Call, "Call");
+            arena_.Append(call, primary);
             if (!Match(TokenType::RPAREN)) {
                 // first arg
-                call->children.push_back(ParseExpression());
+                arena_.Append(call, ParseExpression());
                 while (Match(TokenType::COMMA)) {
-                    call->children.push_back(ParseExpression());
+                    arena_.Append(call, ParseExpression());
                 }
                 Expect(TokenType::RPAREN, "expected ')'");
             }
-            primary = std::move(call);
+            primary = call;
             continue;
         }
         if (Match(TokenType::LBRACKET)) {
-            auto idx = make_node(NodeKind::Index, "Index");
-            idx->children.push_back(std::move(primary));
-            idx->children.push_back(ParseExpression());
+            auto idx = arena_.Make(NodeKind::Index, "Index");
+            arena_.Append(idx, primary);
+            arena_.Append(idx, ParseExpression());
             Expect(TokenType::RBRACKET, "expected ']'");
-            primary = std::move(idx);
+            primary = idx;
             continue;
         }
         break;
@@ -593,8 +601,8 @@ std::unique_ptr<ASTNode> Parser::ParsePrimaryIdTail(std::unique_ptr<ASTNode> idN
 }
 
 // ---------------- Helpers ----------------
-std::unique_ptr<ASTNode> Parser::MakeTypeNode(const Token &typeTok) {
-    auto tn = make_node(NodeKind::TypeNode, typeTok.text);
+ASTNode *Parser::MakeTypeNode(const Token &typeTok) {
+    auto tn = arena_.Make(NodeKind::TypeNode, typeTok.text);
     // array status will be set by surrounding code if needed
     tn->isArray = false;
     return tn;
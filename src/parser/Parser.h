@@ -3,15 +3,18 @@
 
 #include <vector>
 #include <string>
-#include <memory>
+#include "../lexer/Lexer.h"
 #include "../lexer/Token.h"
 #include "AST.h"
 
 class Parser {
 public:
-  Parser(const std::vector<Token> &tokens);
+  // Tokens are pulled from `lexer` as parsing goes, so the token stream is
+  // never held in full. Nodes are allocated from `arena`, which must outlive
+  // the returned tree.
+  Parser(Lexer &lexer, ASTArena &arena);
 
-  std::unique_ptr<ASTNode> ParseProgram();
+  ASTNode *ParseProgram();
 
   const std::vector<std::string>& GetErrors() const { return errors_; }
 
@@ -20,6 +23,7 @@ public:
 private:
   const Token &Peek() const;
   const Token &Current() const;
+  const Token &Previous() const;  // the token last stepped over
   void Advance();
   bool IsAtEnd() const;
   bool Match(TokenType t);
@@ -28,35 +32,38 @@ private:
 
   void AddError(const std::string &msg);
 
-  std::unique_ptr<ASTNode> ParseTopLevel();
-  std::unique_ptr<ASTNode> ParseFunction();
-  std::unique_ptr<ASTNode> ParseBlock();
-  std::unique_ptr<ASTNode> ParseStatement();
-  std::unique_ptr<ASTNode> ParseVarDeclList(TokenType firstTypeTok);
-  std::unique_ptr<ASTNode> ParseIf();
-  std::unique_ptr<ASTNode> ParseWhile();
-  std::unique_ptr<ASTNode> ParseDoWhile();
-  std::unique_ptr<ASTNode> ParseFor();
-  std::unique_ptr<ASTNode> ParseReturn();
-  std::unique_ptr<ASTNode> ParseBreak();
-  std::unique_ptr<ASTNode> ParseContinue();
-  std::unique_ptr<ASTNode> ParseExprStmt();
-
-  std::unique_ptr<ASTNode> ParseExpression();
-  std::unique_ptr<ASTNode> ParseAssignment();
-  std::unique_ptr<ASTNode> ParseNonIdExpr();
-  std::unique_ptr<ASTNode> ParseEquality();
-  std::unique_ptr<ASTNode> ParseRelational();
-  std::unique_ptr<ASTNode> ParseAdditive();
-  std::unique_ptr<ASTNode> ParseMultiplicative();
-  std::unique_ptr<ASTNode> ParseUnary();
-  std::unique_ptr<ASTNode> ParsePrimary();
-  std::unique_ptr<ASTNode> ParsePrimaryIdTail(std::unique_ptr<ASTNode> idNode);
-
-  std::unique_ptr<ASTNode> MakeTypeNode(const Token &typeTok);
-
-  std::vector<Token> tokens_;
-  size_t pos_;
+  ASTNode *ParseTopLevel();
+  ASTNode *ParseFunction();
+  ASTNode *ParseBlock();
+  ASTNode *ParseStatement();
+  ASTNode *ParseVarDeclList(TokenType firstTypeTok);
+  ASTNode *ParseIf();
+  ASTNode *ParseWhile();
+  ASTNode *ParseDoWhile();
+  ASTNode *ParseFor();
+  ASTNode *ParseReturn();
+  ASTNode *ParseBreak();
+  ASTNode *ParseContinue();
+  ASTNode *ParseExprStmt();
+
+  ASTNode *ParseExpression();
+  ASTNode *ParseAssignment();
+  ASTNode *ParseNonIdExpr();
+  ASTNode *ParseEquality();
+  ASTNode *ParseRelational();
+  ASTNode *ParseAdditive();
+  ASTNode *ParseMultiplicative();
+  ASTNode *ParseUnary();
+  ASTNode *ParsePrimary();
+  ASTNode *ParsePrimaryIdTail(ASTNode *idNode);
+
+  ASTNode *MakeTypeNode(const Token &typeTok);
+
+  Lexer &lexer_;
+  ASTArena &arena_;
+  Token current_{};
+  Token previous_{};
+  bool pastEnd_ = false;
 
 };
 
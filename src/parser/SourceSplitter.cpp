@@ -0,0 +1,49 @@
+#include "SourceSplitter.h"
+
+#include "../lexer/Lexer.h"
+#include "Parser.h"
+
+// Where a token's text starts in the source (a string literal's excludes its quote).
+static const char *SourceOf(const Token &t) {
+  return t.type == TokenType::STRING_LITERAL ? t.text.data() - 1 : t.text.data();
+}
+
+bool SplitTopLevel(std::string_view source, const std::vector<Token> &tokens, std::vector<SourcePiece> &out) {
+  out.clear();
+  const size_t n = tokens.size() - 1;  // without the END_OF_FILE
+  size_t i = 0;
+  while (i < n) {
+    size_t start = i;
+    if (tokens[i].type != TokenType::KW_FN) {
+      while (i < n && tokens[i].type != TokenType::KW_FN) ++i;
+      out.push_back({start, i, false, {}});
+      continue;
+    }
+
+    int depth = 0;
+    bool closed = false;
+    for (++i; i < n && !closed; ++i) {
+      if (tokens[i].type == TokenType::LBRACE)
+        ++depth;
+      else if (tokens[i].type == TokenType::RBRACE && --depth == 0)
+        closed = true;
+    }
+    if (!closed)
+      return false;
+    out.push_back({start, i, true, {}});
+  }
+
+  for (size_t k = 0; k < out.size(); ++k) {
+    const char *begin = k == 0 ? source.data() : SourceOf(tokens[out[k].begin]);
+    const char *end = k + 1 < out.size() ? SourceOf(tokens[out[k + 1].begin]) : source.data() + source.size();
+    out[k].text = std::string_view(begin, static_cast<size_t>(end - begin));
+  }
+  return true;
+}
+
+ASTNode *ParsePieces(std::string_view text, ASTArena &arena) {
+  Lexer lexer(text);
+  Parser parser(lexer, arena);
+  ASTNode *root = parser.ParseProgram();
+  return parser.GetErrors().empty() ? root : nullptr;
+}
@@ -0,0 +1,32 @@
+#ifndef SOURCE_SPLITTER_H
+#define SOURCE_SPLITTER_H
+
+#include <string_view>
+#include <vector>
+
+#include "../lexer/Token.h"
+#include "AST.h"
+
+// A top-level `fn` through the brace that closes its body, or the top-level
+// statements between two such functions. Found from the tokens alone, before
+// anything is parsed, for the front ends that take functions one at a time
+// (CompileServer) or several at once (Compile on more than one thread).
+struct SourcePiece {
+  size_t begin = 0;  // [begin, end) of the token stream
+  size_t end = 0;
+  bool isFunction = false;
+  // the source it came from, up to where the next piece starts: the pieces'
+  // texts partition the source, so any run of them parses as it would in place
+  std::string_view text;
+};
+
+// Cuts `tokens` (Lexer(source).Tokenize()) at the `fn`s outside any function.
+// False if a function's body does not close before the end, which only the
+// parser can explain.
+bool SplitTopLevel(std::string_view source, const std::vector<Token> &tokens, std::vector<SourcePiece> &out);
+
+// The Program `text` parses to, in `arena`; null if it has syntax errors
+// (whose positions would be off anyway, counted from the start of `text`).
+ASTNode *ParsePieces(std::string_view text, ASTArena &arena);
+
+#endif // SOURCE_SPLITTER_H
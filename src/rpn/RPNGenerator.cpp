@@ -1,69 +1,193 @@
 #include "RPNGenerator.h"
 #include <cctype>
+#include <iterator>
+#include <stdexcept>
 
-static bool IsFloatingLiteral(const std::string &s) {
+static bool IsFloatingLiteral(std::string_view s) {
   for (char c : s) {
     if (c == '.' || c == 'e' || c == 'E') return true;
   }
   return false;
 }
 
-std::vector<Instruction> RPNGenerator::Generate(ASTNode *root) {
+std::vector<Instruction> RPNGenerator::Generate(ASTNode *root, const ExprTypes *types) {
+  std::vector<Instruction> code;
+  if (!root)
+    return code;
+
+  std::unordered_set<std::string_view> functions;
+  std::vector<ASTNode *> topLevel;
+  for (auto &child: root->children) {
+    if (!child) continue;
+    if (child->kind == NodeKind::Function)
+      functions.insert(child->text);
+    else
+      topLevel.push_back(child);
+  }
+
+  code = GenerateTopLevel(topLevel, functions, types);
+  for (auto &child: root->children) {
+    if (!child || child->kind != NodeKind::Function) continue;
+    auto fn = GenerateFunction(child, functions, types);
+    code.insert(code.end(), std::make_move_iterator(fn.begin()), std::make_move_iterator(fn.end()));
+  }
+  return code;
+}
+
+std::vector<Instruction> RPNGenerator::GenerateTopLevel(const std::vector<ASTNode *> &stmts,
+                                                        const std::unordered_set<std::string_view> &functions,
+                                                        const ExprTypes *types) {
+  Begin(functions, types, {});
+  if (stmts.empty())
+    return std::move(code_);
+
+  // top-level statements run in the bottom frame, which needs its own prologue
+  code_.emplace_back(OpCode::ENTER);
+  for (auto *stmt: stmts)
+    GenStatement(stmt);
+  code_[0].operand = static_cast<int64_t>(slots_.size());
+
+  // the functions follow; without a main the program ends here instead of running into them
+  if (!functions.empty()) {
+    code_.emplace_back(OpCode::PUSH_INT, "0");
+    code_.emplace_back(OpCode::RET);
+  }
+  return std::move(code_);
+}
+
+std::vector<Instruction> RPNGenerator::GenerateFunction(ASTNode *function,
+                                                        const std::unordered_set<std::string_view> &functions,
+                                                        const ExprTypes *types) {
+  Begin(functions, types, function->text);
+  GenFunction(function);
+  return std::move(code_);
+}
+
+void RPNGenerator::Begin(const std::unordered_set<std::string_view> &functions, const ExprTypes *types,
+                         std::string_view unit) {
   code_.clear();
+  types_ = types;
+  functions_ = &functions;
+  unit_ = unit;
   labelCounter_ = 0;
   breakLabels_.clear();
   continueLabels_.clear();
+  slots_.clear();
+  arrays_.clear();
+}
 
-  if (!root)
-    return code_;
-
-  for (auto &child: root->children)
-    GenNode(child.get());
+// "<function>.L<n>" (".L<n>" at the top level): no identifier contains a dot,
+// so these never meet a function's own label or another function's.
+std::string RPNGenerator::NewLabel() {
+  return unit_ + ".L" + std::to_string(labelCounter_++);
+}
 
-  return code_;
+// Every name gets one slot per function, so same-named variables in sibling
+// blocks share storage exactly like the old per-frame name map did.
+int RPNGenerator::SlotOf(std::string_view name) {
+  auto it = slots_.find(name);
+  if (it != slots_.end())
+    return it->second;
+  int slot = static_cast<int>(slots_.size());
+  slots_.emplace(name, slot);
+  return slot;
 }
 
-std::string RPNGenerator::NewLabel() {
-  return "L" + std::to_string(labelCounter_++);
+TypeKind RPNGenerator::TypeOf(const ASTNode *node) const {
+  if (!types_) return TypeKind::UNKNOWN;
+  auto it = types_->find(node);
+  return it != types_->end() ? it->second : TypeKind::UNKNOWN;
 }
 
-void RPNGenerator::GenNode(ASTNode *node) {
-  if (!node)
-    return;
+// Whether an expression statement has to POP a result. Assignments leave
+// nothing; user functions always return a value, builtins only when they are
+// not VOID (which needs the sema types).
+bool RPNGenerator::LeavesValue(const ASTNode *expr) const {
+  if (expr->kind == NodeKind::Assign)
+    return false;
+  if (expr->kind == NodeKind::Call) {
+    if (functions_->count(expr->children[0]->text))
+      return true;
+    TypeKind t = TypeOf(expr);
+    return t != TypeKind::VOID && t != TypeKind::UNKNOWN;
+  }
+  return true;
+}
 
-  if (node->kind == NodeKind::Function)
-    GenFunction(node);
-  else
-    GenStatement(node);
+// Picks the opcode for a binary operator: *_I64 when both sides are int,
+// *_F64 when both are numeric and one is double, otherwise the generic op.
+// == / != on doubles stay generic since they compare textual forms.
+OpCode RPNGenerator::BinaryOpCode(ASTNode *node) const {
+  struct Ops { const char *text; OpCode generic, i64, f64; };
+  static const Ops kOps[] = {
+    {"+", OpCode::ADD, OpCode::ADD_I64, OpCode::ADD_F64},
+    {"-", OpCode::SUB, OpCode::SUB_I64, OpCode::SUB_F64},
+    {"*", OpCode::MUL, OpCode::MUL_I64, OpCode::MUL_F64},
+    {"/", OpCode::DIV, OpCode::DIV_I64, OpCode::DIV_F64},
+    {"%", OpCode::MOD, OpCode::MOD_I64, OpCode::MOD},
+    {"==", OpCode::EQ, OpCode::EQ_I64, OpCode::EQ},
+    {"!=", OpCode::NEQ, OpCode::NEQ_I64, OpCode::NEQ},
+    {"<", OpCode::LT, OpCode::LT_I64, OpCode::LT_F64},
+    {">", OpCode::GT, OpCode::GT_I64, OpCode::GT_F64},
+    {"<=", OpCode::LE, OpCode::LE_I64, OpCode::LE_F64},
+    {">=", OpCode::GE, OpCode::GE_I64, OpCode::GE_F64},
+  };
+
+  TypeKind l = TypeOf(node->children[0]);
+  TypeKind r = TypeOf(node->children[1]);
+  bool lNum = l == TypeKind::INT || l == TypeKind::DOUBLE;
+  bool rNum = r == TypeKind::INT || r == TypeKind::DOUBLE;
+
+  for (const auto &ops : kOps) {
+    if (node->text != ops.text) continue;
+    if (l == TypeKind::INT && r == TypeKind::INT) return ops.i64;
+    if (lNum && rNum) return ops.f64;
+    return ops.generic;
+  }
+  throw std::runtime_error("unknown binary operator: " + std::string(node->text));
 }
 
 void RPNGenerator::GenFunction(ASTNode *node) {
   // function label
   code_.emplace_back(OpCode::LABEL, node->text);
 
+  // frame size is known only after the body has been generated
+  auto outerSlots = std::move(slots_);
+  auto outerArrays = std::move(arrays_);
+  slots_.clear();
+  arrays_.clear();
+  size_t enterIdx = code_.size();
+  code_.emplace_back(OpCode::ENTER);
+
   // collect parameter names (children[1..n-2]) — child 0 is return type, last child is body
-  std::vector<std::string> paramNames;
+  std::vector<std::string_view> paramNames;
   for (size_t i = 1; i + 1 < node->children.size(); ++i) {
     paramNames.push_back(node->children[i]->text);
+    if (node->children[i]->isArray)
+      arrays_.insert(node->children[i]->text);
   }
 
   // At function entry arguments are on the stack in call order (arg0, arg1, ...).
   // To bind them to local names we emit STORE for parameters in reverse order so
   // the top of stack (last argument) goes to the last parameter.
   for (int i = static_cast<int>(paramNames.size()) - 1; i >= 0; --i) {
-    code_.emplace_back(OpCode::STORE, paramNames[i]);
+    code_.emplace_back(OpCode::STORE, paramNames[i], SlotOf(paramNames[i]));
   }
 
   // generate body (the last child)
   if (!node->children.empty()) {
-    GenStatement(node->children.back().get());
+    GenStatement(node->children.back());
   }
 
   // add RET if not present at the end
-  if (code_.empty() || code_.back().op != OpCode::RET) {
+  if (code_.empty() || (code_.back().op != OpCode::RET && code_.back().op != OpCode::TAIL_CALL)) {
     code_.emplace_back(OpCode::PUSH_INT, "0");
     code_.emplace_back(OpCode::RET);
   }
+
+  code_[enterIdx].operand = static_cast<int64_t>(slots_.size());
+  slots_ = std::move(outerSlots);
+  arrays_ = std::move(outerArrays);
 }
 
 void RPNGenerator::GenStatement(ASTNode *node) {
@@ -73,16 +197,16 @@ void RPNGenerator::GenStatement(ASTNode *node) {
   switch (node->kind) {
     case NodeKind::Block:
       for (auto &stmt: node->children)
-        GenStatement(stmt.get());
+        GenStatement(stmt);
       break;
 
     case NodeKind::ExprStmt:
       if (!node->children.empty()) {
-        auto *expr = node->children[0].get();
+        auto *expr = node->children[0];
         GenExpression(expr);
-        // Если выражение само не потребляет результат (CALL и ASSIGN — потребляют),
-        // то нужно сбросить результат, иначе он накапливается на стеке.
-        if (expr->kind != NodeKind::Call && expr->kind != NodeKind::Assign)
+        // Если выражение оставляет результат (всё, кроме ASSIGN и VOID-builtin),
+        // то нужно сбросить его, иначе он накапливается на стеке.
+        if (LeavesValue(expr))
           code_.emplace_back(OpCode::POP);
       }
       break;
@@ -91,26 +215,27 @@ void RPNGenerator::GenStatement(ASTNode *node) {
     case NodeKind::VarDeclList:
       // children[0] — TypeNode
       for (size_t i = 1; i < node->children.size(); ++i) {
-        auto *var = node->children[i].get();
+        auto *var = node->children[i];
 
         if (var->isArray) {
+          arrays_.insert(var->text);
           // array declaration: expect size expression; if missing use 0
           if (!var->children.empty()) {
-            GenExpression(var->children[0].get());
+            GenExpression(var->children[0]);
           } else {
             code_.emplace_back(OpCode::PUSH_INT, "0");
           }
-          code_.emplace_back(OpCode::NEW_ARRAY);
-          code_.emplace_back(OpCode::STORE, var->text);
+          code_.emplace_back(OpCode::NEW_ARRAY, node->children[0]->text);
+          code_.emplace_back(OpCode::STORE, var->text, SlotOf(var->text));
         } else {
           // scalar variable
           if (!var->children.empty()) {
-            GenExpression(var->children[0].get());
+            GenExpression(var->children[0]);
           } else {
             // initialize plain variable with 0
             code_.emplace_back(OpCode::PUSH_INT, "0");
           }
-          code_.emplace_back(OpCode::STORE, var->text);
+          code_.emplace_back(OpCode::STORE, var->text, SlotOf(var->text));
         }
       }
       break;
@@ -136,10 +261,10 @@ void RPNGenerator::GenStatement(ASTNode *node) {
 
       code_.emplace_back(OpCode::LABEL, start);
 
-      GenExpression(node->children[0].get());
+      GenExpression(node->children[0]);
       code_.emplace_back(OpCode::JZ, end);
 
-      GenStatement(node->children[1].get());
+      GenStatement(node->children[1]);
       code_.emplace_back(OpCode::JMP, start);
 
       code_.emplace_back(OpCode::LABEL, end);
@@ -158,8 +283,8 @@ void RPNGenerator::GenStatement(ASTNode *node) {
 
       code_.emplace_back(OpCode::LABEL, start);
 
-      GenStatement(node->children[0].get());
-      GenExpression(node->children[1].get());
+      GenStatement(node->children[0]);
+      GenExpression(node->children[1]);
 
       code_.emplace_back(OpCode::JZ, end);
       code_.emplace_back(OpCode::JMP, start);
@@ -181,30 +306,30 @@ void RPNGenerator::GenStatement(ASTNode *node) {
 
       // 1. Init part
       if (node->children[0]) {
-        GenStatement(node->children[0].get());
+        GenStatement(node->children[0]);
       }
 
       code_.emplace_back(OpCode::LABEL, startLabel);
 
       // 2. Condition part
       if (node->children[1]) {
-        GenExpression(node->children[1].get());
+        GenExpression(node->children[1]);
         code_.emplace_back(OpCode::JZ, endLabel); // If condition is false, jump to end
       }
 
       // 4. Body part
       if (node->children[3]) {
-        GenStatement(node->children[3].get());
+        GenStatement(node->children[3]);
       }
 
       // 3. Step part
       code_.emplace_back(OpCode::LABEL, stepLabel);
       if (node->children[2]) {
-        auto* stepExpr = node->children[2].get();
+        auto* stepExpr = node->children[2];
         GenExpression(stepExpr);
 
-        // Pop result of step expression if it's not an assignment or call
-        if (stepExpr->kind != NodeKind::Call && stepExpr->kind != NodeKind::Assign) {
+        // Pop result of step expression if it leaves one
+        if (LeavesValue(stepExpr)) {
           code_.emplace_back(OpCode::POP);
         }
       }
@@ -230,8 +355,20 @@ void RPNGenerator::GenStatement(ASTNode *node) {
       break;
 
     case NodeKind::Return:
-      if (!node->children.empty())
-        GenExpression(node->children[0].get());
+      if (!node->children.empty()) {
+        auto *expr = node->children[0];
+        if (expr->kind == NodeKind::Call && functions_->count(expr->children[0]->text)) {
+          // return f(...): the callee takes over this frame and returns straight to our caller
+          for (size_t i = 1; i < expr->children.size(); ++i)
+            GenExpression(expr->children[i]);
+          code_.emplace_back(OpCode::TAIL_CALL, expr->children[0]->text);
+          break;
+        }
+        GenExpression(expr);
+      } else {
+        // a bare return still hands the caller one value to pop
+        code_.emplace_back(OpCode::PUSH_INT, "0");
+      }
       code_.emplace_back(OpCode::RET);
       break;
 
@@ -247,26 +384,26 @@ void RPNGenerator::GenIf(ASTNode *node) {
   // --- основной if ---
   nextLabel = NewLabel();
 
-  GenExpression(node->children[0].get());
+  GenExpression(node->children[0]);
   code_.emplace_back(OpCode::JZ, nextLabel);
 
-  GenStatement(node->children[1].get());
+  GenStatement(node->children[1]);
   code_.emplace_back(OpCode::JMP, endLabel);
 
   code_.emplace_back(OpCode::LABEL, nextLabel);
 
   // --- обработка остальных детей ---
   for (size_t i = 2; i < node->children.size(); ++i) {
-    ASTNode *child = node->children[i].get();
+    ASTNode *child = node->children[i];
 
     // else-if
     if (child->kind == NodeKind::ElseIf) {
       std::string elseIfNext = NewLabel();
 
-      GenExpression(child->children[0].get());
+      GenExpression(child->children[0]);
       code_.emplace_back(OpCode::JZ, elseIfNext);
 
-      GenStatement(child->children[1].get());
+      GenStatement(child->children[1]);
       code_.emplace_back(OpCode::JMP, endLabel);
 
       code_.emplace_back(OpCode::LABEL, elseIfNext);
@@ -298,49 +435,46 @@ void RPNGenerator::GenExpression(ASTNode *node) {
       break;
 
     case NodeKind::Identifier:
-      code_.emplace_back(OpCode::LOAD, node->text);
+      code_.emplace_back(OpCode::LOAD, node->text, SlotOf(node->text));
       break;
 
     case NodeKind::Unary:
-      GenExpression(node->children[0].get());
-      if (node->text == "-")
-        code_.emplace_back(OpCode::NEG);
+      GenExpression(node->children[0]);
+      if (node->text == "-") {
+        TypeKind t = TypeOf(node->children[0]);
+        if (t == TypeKind::INT) code_.emplace_back(OpCode::NEG_I64);
+        else if (t == TypeKind::DOUBLE) code_.emplace_back(OpCode::NEG_F64);
+        else code_.emplace_back(OpCode::NEG);
+      }
       else if (node->text == "!")
         code_.emplace_back(OpCode::NOT);
       break;
 
     case NodeKind::Binary:
-      GenExpression(node->children[0].get());
-      GenExpression(node->children[1].get());
-
-      if (node->text == "+") code_.emplace_back(OpCode::ADD);
-      else if (node->text == "-") code_.emplace_back(OpCode::SUB);
-      else if (node->text == "*") code_.emplace_back(OpCode::MUL);
-      else if (node->text == "/") code_.emplace_back(OpCode::DIV);
-      else if (node->text == "%") code_.emplace_back(OpCode::MOD);
-      else if (node->text == "==") code_.emplace_back(OpCode::EQ);
-      else if (node->text == "!=") code_.emplace_back(OpCode::NEQ);
-      else if (node->text == "<") code_.emplace_back(OpCode::LT);
-      else if (node->text == ">") code_.emplace_back(OpCode::GT);
-      else if (node->text == "<=") code_.emplace_back(OpCode::LE);
-      else if (node->text == ">=") code_.emplace_back(OpCode::GE);
-      break;
-
-    case NodeKind::Call: {
-      auto *callee = node->children[0].get();
+      GenExpression(node->children[0]);
+      GenExpression(node->children[1]);
 
-      for (size_t i = 1; i < node->children.size(); ++i)
-        GenExpression(node->children[i].get());
+      code_.emplace_back(BinaryOpCode(node));
+      break;
 
-      code_.emplace_back(OpCode::CALL, callee->text);
+    case NodeKind::Call:
+      GenCall(node);
       break;
-    }
 
     case NodeKind::Index:
-      // push array, then index, then LOAD_INDEX will consume them
-      GenExpression(node->children[0].get());
-      GenExpression(node->children[1].get());
-      code_.emplace_back(OpCode::LOAD_INDEX);
+      if (node->children[0]->kind == NodeKind::Identifier) {
+        // a simple variable index like tree[i]: read the element in place
+        // without pushing the array itself
+        auto *arrExpr = node->children[0];
+        GenExpression(node->children[1]);
+        code_.emplace_back(node->inBounds ? OpCode::LOAD_INDEX_UNSAFE : OpCode::LOAD_INDEX, arrExpr->text,
+                           SlotOf(arrExpr->text));
+      } else {
+        // push array, then index, then LOAD_INDEX will consume them
+        GenExpression(node->children[0]);
+        GenExpression(node->children[1]);
+        code_.emplace_back(OpCode::LOAD_INDEX);
+      }
       break;
 
     case NodeKind::Assign:
@@ -348,34 +482,97 @@ void RPNGenerator::GenExpression(ASTNode *node) {
       // evaluate RHS first (so it sits under array/index if needed)
       if (node->children[0]->kind == NodeKind::Index) {
         // special-case: a simple variable index like pref[i]
-        auto *idxNode = node->children[0].get();
-        auto *arrExpr = idxNode->children[0].get();
-        auto *indexExpr = idxNode->children[1].get();
+        auto *idxNode = node->children[0];
+        auto *arrExpr = idxNode->children[0];
+        auto *indexExpr = idxNode->children[1];
 
         if (arrExpr->kind == NodeKind::Identifier) {
           // emit: RHS, index, STORE_INDEX <varname>
-          GenExpression(node->children[1].get());   // RHS value
+          GenExpression(node->children[1]);   // RHS value
           GenExpression(indexExpr);                 // index
-          code_.emplace_back(OpCode::STORE_INDEX, arrExpr->text);
+          code_.emplace_back(idxNode->inBounds ? OpCode::STORE_INDEX_UNSAFE : OpCode::STORE_INDEX, arrExpr->text,
+                             SlotOf(arrExpr->text));
         } else {
           // fallback to previous behaviour: rhs, array, index, STORE_INDEX
-          GenExpression(node->children[1].get());
+          GenExpression(node->children[1]);
           GenExpression(arrExpr);
           GenExpression(indexExpr);
           code_.emplace_back(OpCode::STORE_INDEX);
         }
       } else {
-        GenExpression(node->children[1].get());
-        code_.emplace_back(OpCode::STORE, node->children[0]->text);
+        if (MovesIntoCall(node))
+          GenCall(node->children[1], true);
+        else
+          GenExpression(node->children[1]);
+        code_.emplace_back(OpCode::STORE, node->children[0]->text, SlotOf(node->children[0]->text));
       }
       break;
 
     case NodeKind::CommaExpr:
       for (auto &ch: node->children)
-        GenExpression(ch.get());
+        GenExpression(ch);
       break;
 
     default:
       break;
   }
-}
\ No newline at end of file
+}
+// Arguments in call order; the parser nests them in CommaExprs.
+static void CollectArgs(ASTNode *node, std::vector<ASTNode *> &out) {
+  if (!node) return;
+  if (node->kind == NodeKind::CommaExpr) {
+    for (auto *ch : node->children)
+      CollectArgs(ch, out);
+  } else {
+    out.push_back(node);
+  }
+}
+
+static bool Mentions(const ASTNode *node, std::string_view name) {
+  if (!node) return false;
+  if (node->kind == NodeKind::Identifier && node->text == name) return true;
+  for (auto *ch : node->children)
+    if (Mentions(ch, name)) return true;
+  return false;
+}
+
+// `a = f(a, ...)` for an array a that no other argument reads: a is
+// overwritten with the result anyway, so the call may take over its
+// reference and write the elements in place instead of copying them.
+bool RPNGenerator::MovesIntoCall(ASTNode *assign) const {
+  ASTNode *target = assign->children[0];
+  ASTNode *call = assign->children[1];
+  if (!call || call->kind != NodeKind::Call || !arrays_.count(target->text))
+    return false;
+  std::vector<ASTNode *> args;
+  for (size_t i = 1; i < call->children.size(); ++i)
+    CollectArgs(call->children[i], args);
+  if (args.empty() || args[0]->kind != NodeKind::Identifier || args[0]->text != target->text)
+    return false;
+  for (size_t i = 1; i < args.size(); ++i)
+    if (Mentions(args[i], target->text))
+      return false;
+  return true;
+}
+
+// With moveFirst the first argument (a variable) is cleared once it is
+// loaded, see MovesIntoCall.
+void RPNGenerator::GenCall(ASTNode *node, bool moveFirst) {
+  auto *callee = node->children[0];
+
+  std::vector<ASTNode *> args;
+  for (size_t i = 1; i < node->children.size(); ++i)
+    CollectArgs(node->children[i], args);
+  for (size_t i = 0; i < args.size(); ++i) {
+    GenExpression(args[i]);
+    if (i == 0 && moveFirst) {
+      code_.emplace_back(OpCode::PUSH_INT, "0");
+      code_.emplace_back(OpCode::STORE, args[0]->text, SlotOf(args[0]->text));
+    }
+  }
+
+  if (functions_->count(callee->text))
+    code_.emplace_back(OpCode::CALL, callee->text);
+  else
+    code_.emplace_back(OpCode::CALL_BUILTIN, callee->text);
+}
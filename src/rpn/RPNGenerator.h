@@ -2,29 +2,66 @@
 #define RPNGENERATOR_H
 
 #include "../parser/AST.h"
+#include "../semantics/SemanticAnalyzer.h"
 #include "RPNInstruction.h"
 #include <vector>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 
 class RPNGenerator {
  public:
-  std::vector<Instruction> Generate(ASTNode *root);
+  // With expression types from SemanticAnalyzer, arithmetic and comparisons
+  // are emitted as their *_I64 / *_F64 specializations where possible.
+  std::vector<Instruction> Generate(ASTNode *root, const ExprTypes *types = nullptr);
+
+  // The pieces Generate concatenates: the top-level statements first, then
+  // every function in order. Labels are local to the piece they are made in,
+  // so CompileServer can regenerate one function and relink it with the rest.
+  // `functions` names all of the program's functions.
+  std::vector<Instruction> GenerateTopLevel(const std::vector<ASTNode *> &stmts,
+                                            const std::unordered_set<std::string_view> &functions,
+                                            const ExprTypes *types = nullptr);
+  std::vector<Instruction> GenerateFunction(ASTNode *function,
+                                            const std::unordered_set<std::string_view> &functions,
+                                            const ExprTypes *types = nullptr);
 
  private:
   std::vector<Instruction> code_;
+  const ExprTypes *types_ = nullptr;
   int labelCounter_ = 0;
+  std::string unit_;  // the function labels are made for, empty at the top level
 
   std::vector<std::string> breakLabels_;
   std::vector<std::string> continueLabels_;
 
+  // variable name -> frame slot in the function being generated
+  // (names are views into the AST's arena, valid while generating)
+  std::unordered_map<std::string_view, int> slots_;
+
+  // user functions of the program; only these can be tail-called
+  const std::unordered_set<std::string_view> *functions_ = nullptr;
+
+  // names declared as arrays in the function being generated
+  std::unordered_set<std::string_view> arrays_;
+
+  void Begin(const std::unordered_set<std::string_view> &functions, const ExprTypes *types, std::string_view unit);
   std::string NewLabel();
 
-  void GenNode(ASTNode *node);
+  int SlotOf(std::string_view name);
 
   void GenStatement(ASTNode *node);
 
   void GenExpression(ASTNode *node);
 
+  TypeKind TypeOf(const ASTNode *node) const;
+  bool LeavesValue(const ASTNode *expr) const;
+  OpCode BinaryOpCode(ASTNode *node) const;
+
+  void GenCall(ASTNode *node, bool moveFirst = false);
+  bool MovesIntoCall(ASTNode *assign) const;
+
   void GenFunction(ASTNode *node);
 
   void GenIf(ASTNode *node);
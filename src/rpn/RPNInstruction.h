@@ -1,7 +1,9 @@
 #pragma once
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
-enum class OpCode {
+enum class OpCode : uint8_t {
   PUSH_INT,
   PUSH_DOUBLE,
   PUSH_STRING,
@@ -13,6 +15,11 @@ enum class OpCode {
   STORE_INDEX,
   NEW_ARRAY,
 
+  // LOAD_INDEX / STORE_INDEX <var> whose subscript LoopOptimizer proved to be
+  // inside the array: no bounds check, and a store never grows or replaces it.
+  LOAD_INDEX_UNSAFE,
+  STORE_INDEX_UNSAFE,
+
   ADD,
   SUB,
   MUL,
@@ -29,24 +36,111 @@ enum class OpCode {
 
   NOT,
 
+  // Specialized by static operand types. Each checks its fast-path tags
+  // and falls back to the generic operator when they do not hold.
+  ADD_I64,
+  SUB_I64,
+  MUL_I64,
+  DIV_I64,
+  MOD_I64,
+  NEG_I64,
+  EQ_I64,
+  NEQ_I64,
+  LT_I64,
+  GT_I64,
+  LE_I64,
+  GE_I64,
+
+  ADD_F64,
+  SUB_F64,
+  MUL_F64,
+  DIV_F64,
+  NEG_F64,
+  LT_F64,
+  GT_F64,
+  LE_F64,
+  GE_F64,
+
   JMP,
   JZ,
 
   CALL,
   RET,
+  // `return f(...)`: jumps to f reusing the current frame, f's RET returns to our caller.
+  TAIL_CALL,
+  // Native function from the VM's BuiltinTable, resolved to its id by VM::Link.
+  CALL_BUILTIN,
 
   POP,
 
-  LABEL
+  LABEL,
+
+  // Sizes the current frame to `operand` local slots (function prologue).
+  ENTER,
+
+  // Superinstructions formed by PeepholeOptimizer.
+  INC_LOCAL,      // x += imm                     (LOAD x; PUSH_INT c; ADD_I64/SUB_I64; STORE x)
+  ADD_LOCAL_IMM,  // push x + imm                 (LOAD x; PUSH_INT c; ADD_I64)
+  LOAD_LOAD_ADD,  // push x + y, y's slot in imm  (LOAD x; LOAD y; ADD_I64)
+
+  // LOAD x; PUSH_INT c; <cmp>_I64; JZ label  ->  jump to label unless x <cmp> imm
+  JZ_EQ_IMM,
+  JZ_NEQ_IMM,
+  JZ_LT_IMM,
+  JZ_GT_IMM,
+  JZ_LE_IMM,
+  JZ_GE_IMM,
+
+  // LOAD x; LOAD y; <cmp>_I64; JZ label  ->  jump to label unless x <cmp> y
+  JZ_EQ_LOCAL,
+  JZ_NEQ_LOCAL,
+  JZ_LT_LOCAL,
+  JZ_GT_LOCAL,
+  JZ_LE_LOCAL,
+  JZ_GE_LOCAL
 };
 
+constexpr size_t kOpCodeCount = static_cast<size_t>(OpCode::JZ_GE_LOCAL) + 1;
+
 struct Instruction {
   OpCode op;
   std::string arg;
-
-  Instruction(OpCode o, const std::string &a = "") : op(o), arg(a) {}
+  // LOAD / STORE / *_INDEX[_UNSAFE] <var>: frame slot of the variable named by arg.
+  // ENTER: number of slots in the frame.
+  // NEW_ARRAY: arg is the declared element type ("int", "double", ...).
+  // Superinstructions: the (first) local's slot; for JZ_* arg is the label.
+  int64_t operand = 0;
+  // Superinstructions only: the immediate, or the second local's slot.
+  int64_t imm = 0;
+
+  Instruction(OpCode o, std::string_view a = {}, int64_t n = 0) : op(o), arg(a), operand(n) {}
 };
 
+// Value of a PUSH_INT literal; malformed literals evaluate to 0.
+inline int64_t ParseIntLiteral(std::string_view arg) {
+  try { return static_cast<int64_t>(std::stoll(std::string(arg))); } catch (...) { return 0; }
+}
+
+// Opcodes that address a local through a frame slot in `operand`.
+inline bool IsSlotOp(OpCode op) {
+  return op == OpCode::LOAD || op == OpCode::STORE || op == OpCode::LOAD_INDEX || op == OpCode::STORE_INDEX ||
+         op == OpCode::LOAD_INDEX_UNSAFE || op == OpCode::STORE_INDEX_UNSAFE;
+}
+
+// LOAD x; PUSH_INT c / LOAD y; <cmp>; JZ fusions, which branch to arg.
+inline bool IsFusedJump(OpCode op) {
+  return op >= OpCode::JZ_EQ_IMM && op <= OpCode::JZ_GE_LOCAL;
+}
+
+inline bool IsLocalCompareJump(OpCode op) {
+  return op >= OpCode::JZ_EQ_LOCAL && op <= OpCode::JZ_GE_LOCAL;
+}
+
+// Instructions whose arg names a label to jump to.
+inline bool IsJump(OpCode op) {
+  return op == OpCode::JMP || op == OpCode::JZ || IsFusedJump(op);
+}
+
 
 inline std::string OpCodeToString(OpCode op) {
   switch (op) {
@@ -60,6 +154,8 @@ inline std::string OpCodeToString(OpCode op) {
     case OpCode::LOAD_INDEX: return "LOAD_INDEX";
     case OpCode::STORE_INDEX: return "STORE_INDEX";
     case OpCode::NEW_ARRAY: return "NEW_ARRAY";
+    case OpCode::LOAD_INDEX_UNSAFE: return "LOAD_INDEX_UNSAFE";
+    case OpCode::STORE_INDEX_UNSAFE: return "STORE_INDEX_UNSAFE";
 
     case OpCode::ADD: return "ADD";
     case OpCode::SUB: return "SUB";
@@ -77,15 +173,78 @@ inline std::string OpCodeToString(OpCode op) {
 
     case OpCode::NOT: return "NOT";
 
+    case OpCode::ADD_I64: return "ADD_I64";
+    case OpCode::SUB_I64: return "SUB_I64";
+    case OpCode::MUL_I64: return "MUL_I64";
+    case OpCode::DIV_I64: return "DIV_I64";
+    case OpCode::MOD_I64: return "MOD_I64";
+    case OpCode::NEG_I64: return "NEG_I64";
+    case OpCode::EQ_I64: return "EQ_I64";
+    case OpCode::NEQ_I64: return "NEQ_I64";
+    case OpCode::LT_I64: return "LT_I64";
+    case OpCode::GT_I64: return "GT_I64";
+    case OpCode::LE_I64: return "LE_I64";
+    case OpCode::GE_I64: return "GE_I64";
+
+    case OpCode::ADD_F64: return "ADD_F64";
+    case OpCode::SUB_F64: return "SUB_F64";
+    case OpCode::MUL_F64: return "MUL_F64";
+    case OpCode::DIV_F64: return "DIV_F64";
+    case OpCode::NEG_F64: return "NEG_F64";
+    case OpCode::LT_F64: return "LT_F64";
+    case OpCode::GT_F64: return "GT_F64";
+    case OpCode::LE_F64: return "LE_F64";
+    case OpCode::GE_F64: return "GE_F64";
+
     case OpCode::JMP: return "JMP";
     case OpCode::JZ: return "JZ";
 
     case OpCode::CALL: return "CALL";
     case OpCode::RET: return "RET";
+    case OpCode::TAIL_CALL: return "TAIL_CALL";
+    case OpCode::CALL_BUILTIN: return "CALL_BUILTIN";
 
     case OpCode::POP: return "POP";
 
     case OpCode::LABEL: return "LABEL";
+    case OpCode::ENTER: return "ENTER";
+
+    case OpCode::INC_LOCAL: return "INC_LOCAL";
+    case OpCode::ADD_LOCAL_IMM: return "ADD_LOCAL_IMM";
+    case OpCode::LOAD_LOAD_ADD: return "LOAD_LOAD_ADD";
+
+    case OpCode::JZ_EQ_IMM: return "JZ_EQ_IMM";
+    case OpCode::JZ_NEQ_IMM: return "JZ_NEQ_IMM";
+    case OpCode::JZ_LT_IMM: return "JZ_LT_IMM";
+    case OpCode::JZ_GT_IMM: return "JZ_GT_IMM";
+    case OpCode::JZ_LE_IMM: return "JZ_LE_IMM";
+    case OpCode::JZ_GE_IMM: return "JZ_GE_IMM";
+
+    case OpCode::JZ_EQ_LOCAL: return "JZ_EQ_LOCAL";
+    case OpCode::JZ_NEQ_LOCAL: return "JZ_NEQ_LOCAL";
+    case OpCode::JZ_LT_LOCAL: return "JZ_LT_LOCAL";
+    case OpCode::JZ_GT_LOCAL: return "JZ_GT_LOCAL";
+    case OpCode::JZ_LE_LOCAL: return "JZ_LE_LOCAL";
+    case OpCode::JZ_GE_LOCAL: return "JZ_GE_LOCAL";
   }
   return "UNKNOWN";
+}
+
+// One line of the res_poliz.txt listing.
+inline std::string InstructionToString(const Instruction &ins) {
+  std::string out = OpCodeToString(ins.op);
+  if (!ins.arg.empty())
+    out += " " + ins.arg;
+
+  if (ins.op == OpCode::ENTER) {
+    out += " " + std::to_string(ins.operand);
+  } else if (IsSlotOp(ins.op) && !ins.arg.empty()) {
+    out += " @" + std::to_string(ins.operand);
+  } else if (ins.op == OpCode::INC_LOCAL || ins.op == OpCode::ADD_LOCAL_IMM ||
+             (IsFusedJump(ins.op) && !IsLocalCompareJump(ins.op))) {
+    out += " @" + std::to_string(ins.operand) + " " + std::to_string(ins.imm);
+  } else if (ins.op == OpCode::LOAD_LOAD_ADD || IsLocalCompareJump(ins.op)) {
+    out += " @" + std::to_string(ins.operand) + " @" + std::to_string(ins.imm);
+  }
+  return out;
 }
\ No newline at end of file
@@ -1,9 +1,10 @@
 #include "SemanticAnalyzer.h"
+#include "../vm/Builtins.h"
 #include <sstream>
 #include <cctype>
 
 // helper: is numeric literal floating (contains '.' or 'e' / 'E')
-static bool IsFloatingLiteral(const std::string &s) {
+static bool IsFloatingLiteral(std::string_view s) {
   for (char c : s) {
     if (c == '.' || c == 'e' || c == 'E') return true;
   }
@@ -14,19 +15,42 @@ static bool IsFloatingLiteral(const std::string &s) {
 // Scope
 // =============================
 
-bool Scope::Declare(const Symbol &sym) {
-  if (symbols.count(sym.name))
+void SymbolTable::EnterScope() {
+  scopeStarts_.push_back(entries_.size());
+}
+
+void SymbolTable::ExitScope() {
+  size_t start = scopeStarts_.back();
+  scopeStarts_.pop_back();
+  while (entries_.size() > start) {
+    const Entry &e = entries_.back();
+    if (e.shadowed)
+      visible_[e.sym.name] = e.shadowed;
+    else
+      visible_.erase(e.sym.name);
+    entries_.pop_back();
+  }
+}
+
+void SymbolTable::Clear() {
+  entries_.clear();
+  visible_.clear();
+  scopeStarts_.clear();
+}
+
+bool SymbolTable::Declare(Symbol sym) {
+  auto it = visible_.find(sym.name);
+  const Entry *shadowed = it != visible_.end() ? it->second : nullptr;
+  if (shadowed && shadowed->depth == scopeStarts_.size())
     return false;
-  symbols[sym.name] = sym;
+  const Entry &added = entries_.emplace_back(Entry{std::move(sym), scopeStarts_.size(), shadowed});
+  visible_[added.sym.name] = &added;
   return true;
 }
 
-std::optional<Symbol> Scope::Lookup(const std::string &name) {
-  if (symbols.count(name))
-    return symbols[name];
-  if (parent)
-    return parent->Lookup(name);
-  return std::nullopt;
+const Symbol *SymbolTable::Lookup(std::string_view name) const {
+  auto it = visible_.find(name);
+  return it != visible_.end() ? &it->second->sym : nullptr;
 }
 
 // =============================
@@ -44,8 +68,8 @@ void SemanticAnalyzer::CollectArgs(ASTNode *node,
   if (node->kind == NodeKind::CommaExpr) {
     // CommaExpr is always binary in your grammar
     if (node->children.size() == 2) {
-      CollectArgs(node->children[0].get(), out);
-      CollectArgs(node->children[1].get(), out);
+      CollectArgs(node->children[0], out);
+      CollectArgs(node->children[1], out);
     }
     return;
   }
@@ -58,13 +82,11 @@ void SemanticAnalyzer::Error(const std::string &msg) {
 }
 
 void SemanticAnalyzer::EnterScope() {
-  currentScope = new Scope(currentScope);
+  symbols_.EnterScope();
 }
 
 void SemanticAnalyzer::ExitScope() {
-  Scope *old = currentScope;
-  currentScope = currentScope->parent;
-  delete old;
+  symbols_.ExitScope();
 }
 
 TypeKind SemanticAnalyzer::NodeToType(const ASTNode *t) {
@@ -83,110 +105,118 @@ TypeKind SemanticAnalyzer::NodeToType(const ASTNode *t) {
 }
 
 void SemanticAnalyzer::Analyze(ASTNode *root) {
-  currentScope = new Scope(nullptr);
-
-  // --- predeclare builtin functions (I/O) ---
-  {
-    Symbol s;
-
-    s = Symbol{"printInt", TypeKind::VOID, false, true};
-    s.paramTypes = { TypeKind::INT }; s.paramIsArray = { false };
-    currentScope->Declare(s);
-
-    s = Symbol{"printDouble", TypeKind::VOID, false, true};
-    s.paramTypes = { TypeKind::DOUBLE }; s.paramIsArray = { false };
-    currentScope->Declare(s);
-
-    s = Symbol{"printStr", TypeKind::VOID, false, true};
-    s.paramTypes = { TypeKind::STRING }; s.paramIsArray = { false };
-    currentScope->Declare(s);
+  Analyze(root, BuiltinTable::Standard());
+}
 
-    s = Symbol{"inputInt", TypeKind::INT, false, true};
-    s.paramTypes = {}; s.paramIsArray = {};
-    currentScope->Declare(s);
+void SemanticAnalyzer::Analyze(ASTNode *root, const BuiltinTable &builtins) {
+  Analyze(root, builtins, nullptr);
+}
 
-    s = Symbol{"inputDouble", TypeKind::DOUBLE, false, true};
-    s.paramTypes = {}; s.paramIsArray = {};
-    currentScope->Declare(s);
+void SemanticAnalyzer::Analyze(ASTNode *root, const BuiltinTable &builtins,
+                               const std::unordered_set<const ASTNode *> *only) {
+  Declare(root, builtins);
+  for (auto &child: root->children)
+    if (child->kind != NodeKind::Function || !only || only->count(child))
+      Check(child);
 
-    s = Symbol{"inputStr", TypeKind::STRING, false, true};
-    s.paramTypes = {}; s.paramIsArray = {};
-    currentScope->Declare(s);
+  ExitScope();
+  ExitScope();
+}
 
-    s = Symbol{"vsuprun", TypeKind::INT, false, true};
-    s.paramTypes = {}; s.paramIsArray = {};
-    currentScope->Declare(s);
+void SemanticAnalyzer::Declare(ASTNode *root, const BuiltinTable &builtins) {
+  exprTypes_.clear();
+  symbols_.Clear();
+  EnterScope();
 
-    s = Symbol{"binxor", TypeKind::INT, false, true};
-    s.paramTypes = { TypeKind::INT, TypeKind::INT }; s.paramIsArray = { false, false };
-    currentScope->Declare(s);
+  // --- predeclare builtin functions (I/O and host natives) ---
+  // in a scope of their own, so the program's functions and globals may shadow them
+  for (const auto &b : builtins.Entries()) {
+    Symbol s{b.name, b.returnType, b.returnsArray, true};
+    s.paramTypes = b.paramTypes;
+    s.paramIsArray = b.paramIsArray;
+    s.paramIsArray.resize(b.paramTypes.size(), false);
+    symbols_.Declare(std::move(s));
   }
+  EnterScope();
 
   // pre-declare functions (first pass) from AST
   for (auto &child: root->children) {
     if (child->kind == NodeKind::Function) {
-      auto fnName = child->text;
-      auto type = NodeToType(child->children[0].get());
+      std::string fnName(child->text);
+      auto type = NodeToType(child->children[0]);
       Symbol sym{fnName, type, false, true};
       for (size_t i = 1; i + 1 < child->children.size(); i++) {
-        auto *arg = child->children[i].get();
-        sym.paramTypes.push_back(NodeToType(arg->children[0].get()));
+        auto *arg = child->children[i];
+        sym.paramTypes.push_back(NodeToType(arg->children[0]));
         sym.paramIsArray.push_back(arg->isArray);
       }
-      if (!currentScope->Declare(sym))
+      if (!symbols_.Declare(std::move(sym)))
         Error("Duplicate function: " + fnName);
     }
   }
+}
 
-  // second pass analysis
-  for (auto &child: root->children) {
-    if (child->kind == NodeKind::Function)
-      CheckFunction(child.get());
-    else
-      CheckStatement(child.get());
-  }
-
-  ExitScope();
+// second pass analysis
+void SemanticAnalyzer::Check(ASTNode *child) {
+  if (child->kind == NodeKind::Function)
+    CheckFunction(child);
+  else
+    CheckStatement(child);
 }
 
 void SemanticAnalyzer::CheckFunction(ASTNode *node) {
   inFunction = true;
   EnterScope();
 
-  currentReturnType = NodeToType(node->children[0].get());
+  currentReturnType = NodeToType(node->children[0]);
 
   // args are children 1...n-2, last child is body
   for (size_t i = 1; i + 1 < node->children.size(); i++) {
-    auto *arg = node->children[i].get();
-    TypeKind t = NodeToType(arg->children[0].get());
+    auto *arg = node->children[i];
+    TypeKind t = NodeToType(arg->children[0]);
     DeclareVar(arg, t);
   }
 
   // body
-  CheckStatement(node->children.back().get());
+  CheckStatement(node->children.back());
 
   ExitScope();
   currentReturnType = TypeKind::VOID;
   inFunction = false;
 }
 
+// an array variable, or a call of a function returning one
+bool SemanticAnalyzer::IsArrayExpression(const ASTNode *node) const {
+  const ASTNode *name = node->kind == NodeKind::Call ? node->children[0] : node;
+  if (name->kind != NodeKind::Identifier) return false;
+  const Symbol *s = symbols_.Lookup(name->text);
+  return s && s->isArray && s->isFunction == (node->kind == NodeKind::Call);
+}
+
 void SemanticAnalyzer::DeclareVar(const ASTNode *v, TypeKind t) {
-  Symbol sym{v->text, t, v->isArray, false};
+  Symbol sym{std::string(v->text), t, v->isArray, false};
 
-  if (!currentScope->Declare(sym))
-    Error("Duplicate variable: " + v->text);
+  if (!symbols_.Declare(std::move(sym)))
+    Error("Duplicate variable: " + std::string(v->text));
 }
 
 void SemanticAnalyzer::CheckVarDeclList(const ASTNode *node) {
-  auto typeNode = node->children[0].get();
+  auto typeNode = node->children[0];
   TypeKind declared = NodeToType(typeNode);
 
   for (size_t i = 1; i < node->children.size(); i++) {
-    auto *var = node->children[i].get();
+    auto *var = node->children[i];
     DeclareVar(var, declared);
 
     if (!var->children.empty()) {
-      auto initType = CheckExpression(var->children[0].get());
+      auto initType = CheckExpression(var->children[0]);
+
+      // an array's child is its size, whatever the element type
+      if (var->isArray) {
+        if (initType != TypeKind::INT && initType != TypeKind::UNKNOWN)
+          Error("Array size must be int");
+        continue;
+      }
 
       if (declared == TypeKind::UNKNOWN || initType == TypeKind::UNKNOWN)
         continue;
@@ -205,6 +235,12 @@ void SemanticAnalyzer::CheckVarDeclList(const ASTNode *node) {
 // =============================
 
 TypeKind SemanticAnalyzer::CheckExpression(const ASTNode *node) {
+  TypeKind t = InferExpression(node);
+  exprTypes_[node] = t;
+  return t;
+}
+
+TypeKind SemanticAnalyzer::InferExpression(const ASTNode *node) {
   switch (node->kind) {
     case NodeKind::Number:
       // detect floating literal
@@ -215,29 +251,28 @@ TypeKind SemanticAnalyzer::CheckExpression(const ASTNode *node) {
       return TypeKind::STRING;
 
     case NodeKind::Identifier: {
-      auto opt = currentScope->Lookup(node->text);
-      if (!opt) {
-        Error("Undeclared variable: " + node->text);
+      const Symbol *s = symbols_.Lookup(node->text);
+      if (!s) {
+        Error("Undeclared variable: " + std::string(node->text));
         return TypeKind::UNKNOWN;
       }
-      Symbol s = *opt;
-      if (s.isFunction) {
-        Error("Function used as value: " + node->text);
+      if (s->isFunction) {
+        Error("Function used as value: " + std::string(node->text));
         return TypeKind::UNKNOWN;
       }
-      return s.type;
+      return s->type;
     }
 
     case NodeKind::Unary:
-      return CheckExpression(node->children[0].get());
+      return CheckExpression(node->children[0]);
 
     case NodeKind::CommaExpr:
-      CheckExpression(node->children[0].get());
-      return CheckExpression(node->children[1].get());
+      CheckExpression(node->children[0]);
+      return CheckExpression(node->children[1]);
 
     case NodeKind::Assign: {
-      auto lhs = node->children[0].get();
-      auto rhs = node->children[1].get();
+      auto lhs = node->children[0];
+      auto rhs = node->children[1];
 
       if (lhs->kind != NodeKind::Identifier && lhs->kind != NodeKind::Index)
         Error("Invalid assignment target");
@@ -254,13 +289,13 @@ TypeKind SemanticAnalyzer::CheckExpression(const ASTNode *node) {
     }
 
     case NodeKind::Binary: {
-      auto l = CheckExpression(node->children[0].get());
-      auto r = CheckExpression(node->children[1].get());
+      auto l = CheckExpression(node->children[0]);
+      auto r = CheckExpression(node->children[1]);
 
       if (l == TypeKind::UNKNOWN || r == TypeKind::UNKNOWN)
         return TypeKind::UNKNOWN;
 
-      const std::string &op = node->text;
+      std::string_view op = node->text;
 
       // ---------- RELATIONAL + EQUALITY ----------
       if (op == "<" || op == "<=" || op == ">" || op == ">=" ||
@@ -301,8 +336,8 @@ TypeKind SemanticAnalyzer::CheckExpression(const ASTNode *node) {
     }
 
     case NodeKind::Index: {
-      auto base = node->children[0].get();
-      auto idx = node->children[1].get();
+      auto base = node->children[0];
+      auto idx = node->children[1];
 
       auto bt = CheckExpression(base);
       auto it = CheckExpression(idx);
@@ -311,9 +346,9 @@ TypeKind SemanticAnalyzer::CheckExpression(const ASTNode *node) {
         Error("Array index must be int");
 
       if (base->kind == NodeKind::Identifier) {
-        auto sOpt = currentScope->Lookup(base->text);
-        if (sOpt && !sOpt->isArray)
-          Error("Indexing non-array variable: " + base->text);
+        const Symbol *s = symbols_.Lookup(base->text);
+        if (s && !s->isArray)
+          Error("Indexing non-array variable: " + std::string(base->text));
       }
 
       return bt;
@@ -323,21 +358,21 @@ TypeKind SemanticAnalyzer::CheckExpression(const ASTNode *node) {
     //             FUNCTION CALL
     // ======================================
     case NodeKind::Call: {
-      auto callee = node->children[0].get();
+      auto callee = node->children[0];
 
       if (callee->kind != NodeKind::Identifier) {
         Error("Call target must be a function name");
         return TypeKind::UNKNOWN;
       }
 
-      auto sOpt = currentScope->Lookup(callee->text);
-      if (!sOpt) {
-        Error("Call to undeclared function: " + callee->text);
+      const Symbol *sym = symbols_.Lookup(callee->text);
+      if (!sym) {
+        Error("Call to undeclared function: " + std::string(callee->text));
         return TypeKind::UNKNOWN;
       }
-      Symbol s = *sOpt;
+      const Symbol &s = *sym;
       if (!s.isFunction) {
-        Error("Call of non-function: " + callee->text);
+        Error("Call of non-function: " + std::string(callee->text));
         return TypeKind::UNKNOWN;
       }
 
@@ -345,7 +380,7 @@ TypeKind SemanticAnalyzer::CheckExpression(const ASTNode *node) {
 
       // old behaviour: children [1..n-1] = arguments
       if (node->children.size() > 1) {
-        auto argRoot = node->children[1].get();
+        auto argRoot = node->children[1];
         CollectArgs(const_cast<ASTNode *>(argRoot), args);
       }
 
@@ -374,6 +409,13 @@ TypeKind SemanticAnalyzer::CheckExpression(const ASTNode *node) {
                 << callee->text;
             Error(oss.str());
           }
+          if (s.paramIsArray[i] && !IsArrayExpression(args[i])) {
+            std::ostringstream oss;
+            oss << "argument " << (i + 1)
+                << " must be an array in call to "
+                << callee->text;
+            Error(oss.str());
+          }
         }
       }
 
@@ -391,13 +433,13 @@ TypeKind SemanticAnalyzer::CheckExpression(const ASTNode *node) {
 
 void SemanticAnalyzer::CheckStatement(const ASTNode *node) {
   if (node->kind == NodeKind::ExprStmt) {
-    node = node->children[0].get();
+    node = node->children[0];
   }
   switch (node->kind) {
     case NodeKind::Block:
       EnterScope();
       for (auto &c: node->children)
-        CheckStatement(c.get());
+        CheckStatement(c);
       ExitScope();
       return;
 
@@ -411,7 +453,7 @@ void SemanticAnalyzer::CheckStatement(const ASTNode *node) {
         return;
       }
       if (!node->children.empty()) {
-        auto t = CheckExpression(node->children[0].get());
+        auto t = CheckExpression(node->children[0]);
         if (t != currentReturnType &&
             !(currentReturnType == TypeKind::DOUBLE && t == TypeKind::INT)) {
           Error("Return type mismatch");
@@ -431,7 +473,7 @@ void SemanticAnalyzer::CheckStatement(const ASTNode *node) {
     case NodeKind::While: {
       // children[0] — условие
       if (!node->children.empty()) {
-        auto cond = CheckExpression(node->children[0].get());
+        auto cond = CheckExpression(node->children[0]);
         if (cond != TypeKind::INT &&
             cond != TypeKind::UNKNOWN)
         {
@@ -442,7 +484,7 @@ void SemanticAnalyzer::CheckStatement(const ASTNode *node) {
       loopDepth++;
       // тело — остальные узлы
       for (size_t i = 1; i < node->children.size(); i++)
-        CheckStatement(node->children[i].get());
+        CheckStatement(node->children[i]);
       loopDepth--;
       return;
     }
@@ -452,13 +494,13 @@ void SemanticAnalyzer::CheckStatement(const ASTNode *node) {
       loopDepth++;
       if (!node->children.empty()) {
         for (size_t i = 0; i + 1 < node->children.size(); i++)
-          CheckStatement(node->children[i].get());
+          CheckStatement(node->children[i]);
       }
       loopDepth--;
 
       // условие — последний ребенок
       if (!node->children.empty()) {
-        auto cond = CheckExpression(node->children.back().get());
+        auto cond = CheckExpression(node->children.back());
         if (cond != TypeKind::INT &&
             cond != TypeKind::UNKNOWN)
         {
@@ -481,12 +523,12 @@ void SemanticAnalyzer::CheckStatement(const ASTNode *node) {
 
       // 1. Init statement
       if (node->children[0]) {
-        CheckStatement(node->children[0].get());
+        CheckStatement(node->children[0]);
       }
 
       // 2. Condition expression
       if (node->children[1]) {
-        auto condType = CheckExpression(node->children[1].get());
+        auto condType = CheckExpression(node->children[1]);
         if (condType != TypeKind::INT && condType != TypeKind::UNKNOWN) {
           Error("For loop condition must be an integer expression");
         }
@@ -494,13 +536,13 @@ void SemanticAnalyzer::CheckStatement(const ASTNode *node) {
 
       // 3. Step expression (checked as an expression, value is discarded)
       if (node->children[2]) {
-        CheckExpression(node->children[2].get());
+        CheckExpression(node->children[2]);
       }
 
       // 4. Body
       loopDepth++;
       if (node->children[3]) {
-        CheckStatement(node->children[3].get());
+        CheckStatement(node->children[3]);
       }
       loopDepth--;
 
@@ -511,7 +553,7 @@ void SemanticAnalyzer::CheckStatement(const ASTNode *node) {
     case NodeKind::If:
     case NodeKind::ElseIf: {
       if (!node->children.empty()) {
-        auto condType = CheckExpression(node->children[0].get());
+        auto condType = CheckExpression(node->children[0]);
 
         if (condType != TypeKind::INT &&
             condType != TypeKind::UNKNOWN)
@@ -521,7 +563,7 @@ void SemanticAnalyzer::CheckStatement(const ASTNode *node) {
       }
 
       for (auto &c: node->children)
-        CheckStatement(c.get());
+        CheckStatement(c);
       return;
     }
 
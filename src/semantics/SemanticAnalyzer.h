@@ -1,13 +1,14 @@
 #ifndef SEMANTIC_ANALYZER_H
 #define SEMANTIC_ANALYZER_H
 
-#include <map>
+#include <deque>
 
 #include "../parser/AST.h"
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
-#include <optional>
 
 enum class TypeKind {
   INT,
@@ -18,34 +19,71 @@ enum class TypeKind {
   UNKNOWN
 };
 
+// Static type of every checked expression node, for code generation.
+using ExprTypes = std::unordered_map<const ASTNode *, TypeKind>;
+
 struct Symbol {
   std::string name;
   TypeKind type;          // return type
-  bool isArray = false, isFunction = false;
+  bool isArray = false, isFunction = false;  // a function's isArray: it returns one
   std::vector<TypeKind> paramTypes;
   std::vector<bool> paramIsArray;
 };
 
-class Scope {
+// Scoped symbol table kept flat: one hash map from a name to its innermost
+// visible declaration, plus an undo log of the declarations each open scope
+// made. Lookup is a single probe however deep the nesting, and returns the
+// stored symbol itself rather than a copy.
+class SymbolTable {
  public:
-  Scope *parent;
-  std::map<std::string, Symbol> symbols;
+  void EnterScope();
+  // Forgets the scope's declarations, making what they shadowed visible again.
+  void ExitScope();
+  void Clear();
 
-  explicit Scope(Scope *parent = nullptr) : parent(parent) {}
+  // False if `name` is already declared in the current scope.
+  bool Declare(Symbol sym);
+  [[nodiscard]] const Symbol *Lookup(std::string_view name) const;
 
-  bool Declare(const Symbol &sym);
-  std::optional<Symbol> Lookup(const std::string &name);
+ private:
+  struct Entry {
+    Symbol sym;
+    size_t depth;
+    const Entry *shadowed;  // the declaration of the same name it hides, if any
+  };
+
+  // deque: entries (and the names the map's keys view) never move
+  std::deque<Entry> entries_;
+  std::unordered_map<std::string_view, const Entry *> visible_;
+  std::vector<size_t> scopeStarts_;  // entries_.size() when each scope opened
 };
 
+class BuiltinTable;
+
 class SemanticAnalyzer {
  public:
+  // Builtins other than BuiltinTable::Standard() are declared from `builtins`.
   void Analyze(ASTNode *root);
+  void Analyze(ASTNode *root, const BuiltinTable &builtins);
+  // Checks the bodies of `only` and every top-level statement; the other
+  // functions are declared from their signatures but taken as already checked
+  // (CompileServer's unchanged ones), and get no expression types.
+  void Analyze(ASTNode *root, const BuiltinTable &builtins, const std::unordered_set<const ASTNode *> *only);
+
+  // Analyze in steps, for checking one program on several threads with an
+  // analyzer each: Declare the builtins and the program's functions, then
+  // Check its top-level children in order. Functions may be left out, the
+  // statements not, since they declare the globals later children see.
+  void Declare(ASTNode *root, const BuiltinTable &builtins);
+  void Check(ASTNode *child);
 
   [[nodiscard]] const std::vector<std::string> &GetErrors() const { return errors_; }
+  [[nodiscard]] const ExprTypes &GetExprTypes() const { return exprTypes_; }
 
  private:
-  Scope *currentScope = nullptr;
+  SymbolTable symbols_;
   std::vector<std::string> errors_;
+  ExprTypes exprTypes_;
 
   bool inFunction = false;
   // for tracking loops
@@ -63,6 +101,8 @@ class SemanticAnalyzer {
   // type checking
   TypeKind NodeToType(const ASTNode *t);
   TypeKind CheckExpression(const ASTNode *node);
+  TypeKind InferExpression(const ASTNode *node);
+  bool IsArrayExpression(const ASTNode *node) const;
   void CheckStatement(const ASTNode *node);
   void CheckFunction(ASTNode *node);
 
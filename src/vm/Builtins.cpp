@@ -0,0 +1,303 @@
+#include "Builtins.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "VM.h"
+
+int BuiltinTable::Register(Builtin builtin) {
+  auto it = ids_.find(builtin.name);
+  if (it != ids_.end()) {
+    entries_[static_cast<size_t>(it->second)] = std::move(builtin);
+    return it->second;
+  }
+  int id = static_cast<int>(entries_.size());
+  ids_.emplace(builtin.name, id);
+  entries_.push_back(std::move(builtin));
+  return id;
+}
+
+int BuiltinTable::Find(const std::string &name) const {
+  auto it = ids_.find(name);
+  return it != ids_.end() ? it->second : -1;
+}
+
+static Value PrintInt(VM &vm, const Value *args) {
+  vm.Output().WriteInt(args[0].AsInt());
+  return Value();
+}
+
+static Value PrintDouble(VM &vm, const Value *args) {
+  vm.Output().WriteDouble(args[0].AsDouble());
+  return Value();
+}
+
+static Value PrintStr(VM &vm, const Value *args) {
+  if (args[0].type == ValueType::kString) vm.Output().Write(args[0].Str());
+  else vm.Output().Write(args[0].AsString());
+  return Value();
+}
+
+static Value InputInt(VM &vm, const Value *) { return Value::MakeInt(vm.Input().ReadInt()); }
+
+static Value InputDouble(VM &vm, const Value *) { return Value::MakeDouble(vm.Input().ReadDouble()); }
+
+// a newline left by a previous number read is skipped inside ReadLine
+static Value InputStr(VM &vm, const Value *) { return Value::MakeString(vm.Input().ReadLine()); }
+
+// substr(s, from, count): count characters from `from` on, clamped to s.
+// Long ones are slices sharing s's text.
+static Value Substr(VM &, Value *args) {
+  Value s = args[0].type == ValueType::kString ? args[0] : Value::MakeString(args[0].AsString());
+  int64_t size = static_cast<int64_t>(s.str->size);
+  int64_t from = std::clamp<int64_t>(args[1].AsInt(), 0, size);
+  int64_t count = std::clamp<int64_t>(args[2].AsInt(), 0, size - from);
+  if (count == size) return s;
+  if (count == 0) return Value::MakeChar(-1);
+  if (count == 1) return Value::MakeChar(static_cast<unsigned char>(s.str->At(static_cast<size_t>(from))));
+  return Value::OfString(StringObject::Slice(s.str, static_cast<size_t>(from), static_cast<size_t>(count)));
+}
+
+static Value Length(VM &, Value *args) {
+  if (args[0].type == ValueType::kString) return Value::MakeInt(static_cast<int64_t>(args[0].str->size));
+  return Value::MakeInt(static_cast<int64_t>(args[0].AsString().size()));
+}
+
+// true once the run has used up its 1.95 s CPU budget
+static Value Vsuprun(VM &vm, const Value *) {
+  return Value::MakeInt(vm.CpuTime() >= 1.95);
+}
+
+static Value BinXorBuiltin(VM &, const Value *args) {
+  auto BinXor = [&](auto&& self, int64_t base, int64_t power) -> int {
+    if (power == 0) {
+      return 0;
+    } else if (power & 1) {
+      return self(self, base, power - 1) ^ base;
+    } else {
+      int res = self(self, base, power / 2);
+      return (res ^ res);
+    }
+  };
+  return Value::MakeInt(BinXor(BinXor, args[0].AsInt(), args[1].AsInt()));
+}
+
+// Array kernels. They run over the whole range natively instead of one
+// interpreted LOAD_INDEX / STORE_INDEX per element, directly on the int64
+// buffer of int arrays (other element kinds take a per-element loop).
+// fill, sum, minOf and maxOf work two elements at a time in GNU vector
+// types, which GCC and Clang lower to SSE2 / NEON registers (minOf / maxOf
+// need a 64-bit compare, SSE4.2 or NEON, and otherwise compare lane by lane);
+// copy is a memmove, and prefixSum stays a serial scan, as each sum needs the
+// one before it. Callers that write
+// `a = fill(a, ...)` hand over their only reference (see RPNGenerator), so
+// the update happens in place.
+//
+// fill and copy do exactly what the loop storing each element would,
+// growing the array past its end and skipping negative indices, so
+// LoopOptimizer can replace such loops with them. Element reads outside the
+// array (or from a non-array) give 0.
+
+// two int64 lanes, one SSE2 / NEON register
+typedef int64_t Int64x2 __attribute__((vector_size(16)));
+typedef uint64_t UInt64x2 __attribute__((vector_size(16)));
+constexpr size_t kLanes = 2;
+
+template <typename V>
+static V LoadLanes(const int64_t *p) {
+  V v;
+  std::memcpy(&v, p, sizeof v);  // the buffer is only 8-byte aligned
+  return v;
+}
+
+static void FillInts(int64_t *p, size_t n, int64_t v) {
+  Int64x2 lanes = Int64x2{} + v;
+  size_t k = 0;
+  for (; k + kLanes <= n; k += kLanes) std::memcpy(p + k, &lanes, sizeof lanes);
+  for (; k < n; ++k) p[k] = v;
+}
+
+// wrapping, like ADD_I64; two accumulators keep two adds in flight
+static uint64_t SumInts(const int64_t *p, size_t n) {
+  UInt64x2 a{}, b{};
+  size_t k = 0;
+  for (; k + 2 * kLanes <= n; k += 2 * kLanes) {
+    a += LoadLanes<UInt64x2>(p + k);
+    b += LoadLanes<UInt64x2>(p + k + kLanes);
+  }
+  a += b;
+  uint64_t total = a[0] + a[1];
+  for (; k < n; ++k) total += static_cast<uint64_t>(p[k]);
+  return total;
+}
+
+// n >= 1
+template <bool kMax>
+static int64_t ExtremumInts(const int64_t *p, size_t n) {
+  int64_t best = p[0];
+  size_t k = 1;
+  if (n >= kLanes) {
+    Int64x2 lanes = LoadLanes<Int64x2>(p);
+    for (k = kLanes; k + kLanes <= n; k += kLanes) {
+      Int64x2 v = LoadLanes<Int64x2>(p + k);
+      lanes = (kMax ? v > lanes : v < lanes) ? v : lanes;
+    }
+    best = kMax ? std::max(lanes[0], lanes[1]) : std::min(lanes[0], lanes[1]);
+  }
+  for (; k < n; ++k) best = kMax ? std::max(best, p[k]) : std::min(best, p[k]);
+  return best;
+}
+
+// [from, to) clamped to the elements of arr; false if that leaves nothing
+static bool ElemRange(const Value &arr, int64_t &from, int64_t &to) {
+  if (arr.type != ValueType::kArray) return false;
+  from = std::max<int64_t>(from, 0);
+  to = std::min(to, static_cast<int64_t>(arr.Array().Size()));
+  return from < to;
+}
+
+// The array a loop storing to var[from .. to) leaves behind, var turned into
+// an array if it was not one; nullptr if no store lands. from is raised to
+// the first index stored, as negative ones are skipped.
+static ArrayObject *StoreRange(Value &var, int64_t &from, int64_t to) {
+  if (from >= to) return nullptr;
+  if (var.type != ValueType::kArray) var = Value::MakeArray(0);
+  if (to <= 0) return nullptr;
+  ArrayObject &elems = var.MutableArray();
+  if (static_cast<size_t>(to) > elems.Size()) elems.Resize(static_cast<size_t>(to));
+  from = std::max<int64_t>(from, 0);
+  return &elems;
+}
+
+// count stores from `at` on, saturated so at + count cannot overflow
+static int64_t RangeEnd(int64_t at, int64_t count) {
+  if (count <= 0) return at;
+  return at > std::numeric_limits<int64_t>::max() - count ? std::numeric_limits<int64_t>::max() : at + count;
+}
+
+static void FillRange(ArrayObject &elems, int64_t from, int64_t to, const Value &v) {
+  if (elems.kind == ElemKind::kInt && v.type == ValueType::kInt) {
+    FillInts(elems.ints.data() + from, static_cast<size_t>(to - from), v.i);
+    return;
+  }
+  for (int64_t k = from; k < to; ++k) elems.Set(static_cast<size_t>(k), v);
+}
+
+// fill(a, from, to, v): a with a[from .. to) set to v
+static Value Fill(VM &, Value *args) {
+  Value arr = std::move(args[0]);
+  int64_t from = args[1].AsInt(), to = args[2].AsInt();
+  if (ArrayObject *elems = StoreRange(arr, from, to)) FillRange(*elems, from, to, args[3]);
+  return arr;
+}
+
+// copy(dst, at, src, from, count): dst with dst[at + k] = src[from + k] for k < count
+static Value Copy(VM &, Value *args) {
+  Value dst = std::move(args[0]);
+  int64_t at = args[1].AsInt(), from = args[3].AsInt();
+  int64_t to = RangeEnd(at, args[4].AsInt());
+  int64_t first = at;
+  ArrayObject *out = StoreRange(dst, first, to);
+  if (!out) return dst;
+
+  // the sources of the m stores start at `start`; those before 0 (lead)
+  // and from the end of src on read as 0
+  int64_t m = to - first;
+  int64_t start = RangeEnd(from, first - at);
+  int64_t lead = start >= 0 ? 0 : start < -m ? m : -start;
+  int64_t begin = start + lead;
+  int64_t avail = 0;
+  const Value &src = args[2];
+  if (src.type == ValueType::kArray && lead < m) {
+    // dst was detached above if it shared src's elements, so src still holds the old ones
+    const ArrayObject &in = src.Array();
+    int64_t n = static_cast<int64_t>(in.Size());
+    if (begin < n) avail = std::min(n - begin, m - lead);
+    int64_t pos = first + lead;
+    if (out->kind == ElemKind::kInt && in.kind == ElemKind::kInt) {
+      std::copy(in.ints.begin() + begin, in.ints.begin() + begin + avail, out->ints.begin() + pos);
+    } else {
+      for (int64_t j = 0; j < avail; ++j)
+        out->Set(static_cast<size_t>(pos + j), in.Get(static_cast<size_t>(begin + j)));
+    }
+  }
+  FillRange(*out, first, first + lead, Value::MakeInt(0));
+  FillRange(*out, first + lead + avail, to, Value::MakeInt(0));
+  return dst;
+}
+
+// sum(a, from, to), wrapping like ADD_I64
+static Value Sum(VM &, Value *args) {
+  int64_t from = args[1].AsInt(), to = args[2].AsInt();
+  if (!ElemRange(args[0], from, to)) return Value::MakeInt(0);
+  const ArrayObject &elems = args[0].Array();
+  uint64_t acc = 0;
+  if (elems.kind == ElemKind::kInt) {
+    acc = SumInts(elems.ints.data() + from, static_cast<size_t>(to - from));
+  } else {
+    for (int64_t k = from; k < to; ++k) acc += static_cast<uint64_t>(elems.Get(static_cast<size_t>(k)).AsInt());
+  }
+  return Value::MakeInt(static_cast<int64_t>(acc));
+}
+
+// minOf / maxOf(a, from, to); 0 for an empty range
+template <bool kMax>
+static Value Extremum(VM &, Value *args) {
+  int64_t from = args[1].AsInt(), to = args[2].AsInt();
+  if (!ElemRange(args[0], from, to)) return Value::MakeInt(0);
+  const ArrayObject &elems = args[0].Array();
+  if (elems.kind == ElemKind::kInt)
+    return Value::MakeInt(ExtremumInts<kMax>(elems.ints.data() + from, static_cast<size_t>(to - from)));
+  int64_t best = elems.Get(static_cast<size_t>(from)).AsInt();
+  for (int64_t k = from + 1; k < to; ++k) {
+    int64_t v = elems.Get(static_cast<size_t>(k)).AsInt();
+    best = kMax ? std::max(best, v) : std::min(best, v);
+  }
+  return Value::MakeInt(best);
+}
+
+// prefixSum(a): an array of the same size with p[k] = a[0] + ... + a[k]
+static Value PrefixSum(VM &, Value *args) {
+  Value arr = std::move(args[0]);
+  if (arr.type != ValueType::kArray) return Value::MakeArray(0);
+  ArrayObject &elems = arr.MutableArray();
+  uint64_t acc = 0;
+  if (elems.kind == ElemKind::kInt) {
+    for (int64_t &e : elems.ints) {
+      acc += static_cast<uint64_t>(e);
+      e = static_cast<int64_t>(acc);
+    }
+  } else {
+    for (size_t k = 0; k < elems.Size(); ++k) {
+      acc += static_cast<uint64_t>(elems.Get(k).AsInt());
+      elems.Set(k, Value::MakeInt(static_cast<int64_t>(acc)));
+    }
+  }
+  return arr;
+}
+
+const BuiltinTable &BuiltinTable::Standard() {
+  static const BuiltinTable table = [] {
+    BuiltinTable t;
+    t.Register({"printInt", TypeKind::VOID, {TypeKind::INT}, PrintInt});
+    t.Register({"printDouble", TypeKind::VOID, {TypeKind::DOUBLE}, PrintDouble});
+    t.Register({"printStr", TypeKind::VOID, {TypeKind::STRING}, PrintStr});
+    t.Register({"inputInt", TypeKind::INT, {}, InputInt});
+    t.Register({"inputDouble", TypeKind::DOUBLE, {}, InputDouble});
+    t.Register({"inputStr", TypeKind::STRING, {}, InputStr});
+    t.Register({"substr", TypeKind::STRING, {TypeKind::STRING, TypeKind::INT, TypeKind::INT}, Substr});
+    t.Register({"length", TypeKind::INT, {TypeKind::STRING}, Length});
+    t.Register({"vsuprun", TypeKind::INT, {}, Vsuprun});
+    t.Register({"binxor", TypeKind::INT, {TypeKind::INT, TypeKind::INT}, BinXorBuiltin});
+    const TypeKind kInt = TypeKind::INT;
+    t.Register({"fill", kInt, {kInt, kInt, kInt, kInt}, Fill, {true}, true});
+    t.Register({"copy", kInt, {kInt, kInt, kInt, kInt, kInt}, Copy, {true, false, true}, true});
+    t.Register({"sum", kInt, {kInt, kInt, kInt}, Sum, {true}});
+    t.Register({"prefixSum", kInt, {kInt}, PrefixSum, {true}, true});
+    t.Register({"minOf", kInt, {kInt, kInt, kInt}, Extremum<false>, {true}});
+    t.Register({"maxOf", kInt, {kInt, kInt, kInt}, Extremum<true>, {true}});
+    return t;
+  }();
+  return table;
+}
@@ -0,0 +1,57 @@
+#ifndef PETUKH_BUILTINS_H
+#define PETUKH_BUILTINS_H
+
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../semantics/SemanticAnalyzer.h"
+#include "Value.h"
+
+class VM;
+
+// A native function callable from PetukhPlusPlus. `args` holds the
+// paramTypes.size() arguments in call order and is only valid during the
+// call; the function must not touch the VM's stack, but may move arguments
+// out (an array it was handed the only reference to is then updated in
+// place). The result is pushed unless returnType is VOID.
+using BuiltinFn = std::function<Value(VM &vm, Value *args)>;
+
+struct Builtin {
+  std::string name;
+  TypeKind returnType = TypeKind::VOID;
+  std::vector<TypeKind> paramTypes;
+  BuiltinFn fn;
+  // Parameters that take an array, of their paramTypes element type (those
+  // past the end take scalars), and whether the result is one.
+  std::vector<bool> paramIsArray;
+  bool returnsArray = false;
+};
+
+// Builtins by name for SemanticAnalyzer and by numeric id for the VM:
+// VM::Link resolves every CALL_BUILTIN to its id once, so a call is a
+// single indexed lookup. Hosts copy Standard(), Register() their own
+// functions and hand the table to both.
+class BuiltinTable {
+ public:
+  // printInt / printDouble / printStr, inputInt / inputDouble / inputStr, substr / length,
+  // vsuprun, binxor,
+  // and the int array kernels fill / copy / sum / prefixSum / minOf / maxOf
+  static const BuiltinTable &Standard();
+
+  // Returns the id; a builtin of the same name is replaced and keeps its id.
+  int Register(Builtin builtin);
+
+  // id of `name`, or -1
+  int Find(const std::string &name) const;
+
+  const Builtin &Get(int id) const { return entries_[static_cast<size_t>(id)]; }
+  const std::vector<Builtin> &Entries() const { return entries_; }
+
+ private:
+  std::vector<Builtin> entries_;
+  std::unordered_map<std::string, int> ids_;
+};
+
+#endif // PETUKH_BUILTINS_H
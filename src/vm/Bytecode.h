@@ -0,0 +1,46 @@
+#ifndef PETUKH_BYTECODE_H
+#define PETUKH_BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "../rpn/RPNInstruction.h"
+
+// Lowered, fixed-width form of the POLIZ stream that the VM executes.
+// Operands are decoded once at link time, so nothing is parsed per execution.
+struct BytecodeOp {
+  OpCode op = OpCode::POP;
+  // LOAD / STORE / *_INDEX[_UNSAFE]: frame slot (-1 for the stack forms of *_INDEX)
+  // JMP / JZ / CALL / TAIL_CALL: target index in code
+  // CALL_BUILTIN: id in the VM's BuiltinTable
+  // PUSH_STRING: index into the string pool
+  // ENTER: frame size
+  // NEW_ARRAY: ElemKind of the elements
+  // INC_LOCAL / ADD_LOCAL_IMM / LOAD_LOAD_ADD: slot of the (first) local
+  // JZ_<cmp>_IMM / JZ_<cmp>_LOCAL: jump target
+  int32_t a = 0;
+  union {
+    int64_t i;  // PUSH_INT value, INC_LOCAL / ADD_LOCAL_IMM immediate
+    double d;   // PUSH_DOUBLE value
+    struct {
+      int32_t x;  // JZ_<cmp>_*: slot of the compared local; LOAD_LOAD_ADD: second slot
+      int32_t y;  // JZ_<cmp>_IMM: immediate; JZ_<cmp>_LOCAL: second slot
+    } pair;
+  } imm{0};
+};
+
+static_assert(sizeof(BytecodeOp) == 16, "BytecodeOp must stay 16 bytes");
+
+struct BytecodeFunction {
+  std::string name;
+  size_t entry = 0;  // index of its first instruction (the ENTER)
+};
+
+struct BytecodeModule {
+  std::vector<BytecodeOp> code;
+  std::vector<std::string> strings;  // constant pool, quotes already stripped
+  std::vector<BytecodeFunction> functions;  // called functions and main, by entry
+  size_t entry = 0;
+};
+
+#endif  // PETUKH_BYTECODE_H
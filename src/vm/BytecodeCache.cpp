@@ -0,0 +1,207 @@
+#include "BytecodeCache.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include <unistd.h>
+
+namespace {
+
+constexpr char kMagic[8] = {'P', 'E', 'T', 'U', 'K', 'H', 'B', 'C'};
+constexpr uint32_t kFormatVersion = 3;
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t opCodeCount;  // a build with other opcodes must not run this code
+  uint32_t opSize;
+  uint32_t reserved;
+  uint64_t build;  // Fingerprint() of the writer
+  uint64_t key;
+  uint64_t entry;
+  uint64_t codeCount;
+  uint64_t stringCount;
+  uint64_t functionCount;
+  uint64_t builtinCount;
+  uint64_t checksum;  // FNV-1a of everything after the header
+};
+
+constexpr uint64_t kFnvBasis = 14695981039346656037ull;
+
+uint64_t Fnv1a(const char *data, size_t n, uint64_t h = kFnvBasis) {
+  for (size_t i = 0; i < n; ++i) {
+    h ^= static_cast<unsigned char>(data[i]);
+    h *= 1099511628211ull;
+  }
+  return h;
+}
+
+void PutU32(std::string &out, uint32_t v) { out.append(reinterpret_cast<const char *>(&v), sizeof v); }
+void PutU64(std::string &out, uint64_t v) { out.append(reinterpret_cast<const char *>(&v), sizeof v); }
+
+void PutString(std::string &out, const std::string &s) {
+  PutU32(out, static_cast<uint32_t>(s.size()));
+  out.append(s);
+}
+
+// The opcode table and the builtin signatures the code was compiled and
+// linked against: a build that renumbers opcodes or retypes a builtin reads
+// a miss instead of running code checked against something else.
+uint64_t Fingerprint(const BuiltinTable &builtins) {
+  uint64_t h = kFnvBasis;
+  for (size_t i = 0; i < kOpCodeCount; ++i) {
+    std::string name = OpCodeToString(static_cast<OpCode>(i));
+    h = Fnv1a(name.c_str(), name.size() + 1, h);
+  }
+  for (const Builtin &b : builtins.Entries()) {
+    h = Fnv1a(b.name.c_str(), b.name.size() + 1, h);
+    std::vector<char> types{static_cast<char>(b.returnType), static_cast<char>(b.returnsArray)};
+    for (size_t i = 0; i < b.paramTypes.size(); ++i)
+      types.push_back(static_cast<char>(static_cast<int>(b.paramTypes[i]) * 2 +
+                                        (i < b.paramIsArray.size() && b.paramIsArray[i])));
+    h = Fnv1a(types.data(), types.size(), Fnv1a("(", 1, h));
+  }
+  return h;
+}
+
+// Bounds-checked reader over the file's bytes; any overrun marks it bad.
+struct Reader {
+  const char *pos;
+  const char *end;
+  bool ok = true;
+
+  bool Take(void *dst, size_t n) {
+    if (!ok || static_cast<size_t>(end - pos) < n) return ok = false;
+    std::memcpy(dst, pos, n);
+    pos += n;
+    return true;
+  }
+
+  uint32_t U32() { uint32_t v = 0; Take(&v, sizeof v); return v; }
+  uint64_t U64() { uint64_t v = 0; Take(&v, sizeof v); return v; }
+
+  std::string String() {
+    uint32_t n = U32();
+    if (!ok || static_cast<size_t>(end - pos) < n) { ok = false; return {}; }
+    std::string s(pos, n);
+    pos += n;
+    return s;
+  }
+};
+
+}  // namespace
+
+uint64_t BytecodeCache::Key(std::string_view source, int optLevel) {
+  char level = static_cast<char>(optLevel);
+  return Fnv1a(&level, 1, Fnv1a(source.data(), source.size()));
+}
+
+std::string BytecodeCache::PathFor(const std::string &dir, uint64_t key) {
+  char name[32];
+  std::snprintf(name, sizeof name, "%016llx.pbc", static_cast<unsigned long long>(key));
+  return dir + "/" + name;
+}
+
+bool BytecodeCache::Save(const std::string &path, const CompiledModule &module, uint64_t key) {
+  const BytecodeModule &bc = module.Bytecode();
+  const auto &builtins = module.Builtins().Entries();
+
+  Header h{};
+  std::memcpy(h.magic, kMagic, sizeof kMagic);
+  h.version = kFormatVersion;
+  h.opCodeCount = static_cast<uint32_t>(kOpCodeCount);
+  h.opSize = sizeof(BytecodeOp);
+  h.build = Fingerprint(module.Builtins());
+  h.key = key;
+  h.entry = bc.entry;
+  h.codeCount = bc.code.size();
+  h.stringCount = bc.strings.size();
+  h.functionCount = bc.functions.size();
+  h.builtinCount = builtins.size();
+
+  std::string out(sizeof h, '\0');
+  out.append(reinterpret_cast<const char *>(bc.code.data()), bc.code.size() * sizeof(BytecodeOp));
+  for (const auto &s : bc.strings)
+    PutString(out, s);
+  for (const auto &f : bc.functions) {
+    PutString(out, f.name);
+    PutU64(out, f.entry);
+  }
+  for (const auto &b : builtins)
+    PutString(out, b.name);
+
+  h.checksum = Fnv1a(out.data() + sizeof h, out.size() - sizeof h);
+  std::memcpy(out.data(), &h, sizeof h);
+
+  std::string tmp = path + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream f(tmp, std::ios::binary | std::ios::trunc);
+    if (!f.write(out.data(), static_cast<std::streamsize>(out.size())))
+      return false;
+  }
+  if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::shared_ptr<const CompiledModule> BytecodeCache::Load(const std::string &path, uint64_t key,
+                                                          const BuiltinTable &builtins) {
+  // everything ends up in the module's own vectors, so a plain read is all it takes
+  std::ifstream f(path, std::ios::binary);
+  if (!f) return nullptr;
+  std::string file((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+  if (file.size() < sizeof(Header)) return nullptr;
+  size_t size = file.size();
+
+  Reader in{file.data(), file.data() + size};
+  std::shared_ptr<const CompiledModule> module;
+  Header h{};
+  in.Take(&h, sizeof h);
+
+  if (std::memcmp(h.magic, kMagic, sizeof kMagic) == 0 && h.version == kFormatVersion &&
+      h.opCodeCount == kOpCodeCount && h.opSize == sizeof(BytecodeOp) && h.key == key &&
+      h.build == Fingerprint(builtins) &&
+      h.codeCount <= (size - sizeof h) / sizeof(BytecodeOp) &&
+      h.checksum == Fnv1a(in.pos, size - sizeof h)) {
+    BytecodeModule bc;
+    bc.entry = h.entry;
+    bc.code.resize(h.codeCount);
+    in.Take(bc.code.data(), h.codeCount * sizeof(BytecodeOp));
+    for (uint64_t i = 0; in.ok && i < h.stringCount; ++i)
+      bc.strings.push_back(in.String());
+    for (uint64_t i = 0; in.ok && i < h.functionCount; ++i) {
+      BytecodeFunction f;
+      f.name = in.String();
+      f.entry = in.U64();
+      bc.functions.push_back(std::move(f));
+    }
+
+    // builtin ids were assigned by the table the module was linked against
+    std::vector<int32_t> remap;
+    for (uint64_t i = 0; in.ok && i < h.builtinCount; ++i)
+      remap.push_back(builtins.Find(in.String()));
+
+    bool valid = in.ok && bc.entry <= bc.code.size();
+    for (auto &op : bc.code) {
+      if (!valid) break;
+      if (static_cast<size_t>(op.op) >= kOpCodeCount) valid = false;
+      else if (IsJump(op.op) || op.op == OpCode::CALL || op.op == OpCode::TAIL_CALL) {
+        if (op.a < 0 || static_cast<size_t>(op.a) > bc.code.size()) valid = false;
+      } else if (op.op == OpCode::CALL_BUILTIN) {
+        if (op.a < 0 || static_cast<size_t>(op.a) >= remap.size() || remap[static_cast<size_t>(op.a)] < 0) valid = false;
+        else op.a = remap[static_cast<size_t>(op.a)];
+      } else if (op.op == OpCode::PUSH_STRING && (op.a < 0 || static_cast<size_t>(op.a) >= bc.strings.size())) {
+        valid = false;
+      }
+    }
+    if (valid)
+      module = CompiledModule::FromBytecode(std::move(bc), builtins);
+  }
+
+  return module;
+}
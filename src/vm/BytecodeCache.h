@@ -0,0 +1,42 @@
+#ifndef PETUKH_BYTECODE_CACHE_H
+#define PETUKH_BYTECODE_CACHE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "Builtins.h"
+#include "CompiledModule.h"
+
+// On-disk form of a linked module, so a cache hit starts the VM without
+// running Lexer, Parser, SemanticAnalyzer or RPNGenerator. The file is
+// native-endian and tied to this build's OpCode set and builtin signatures:
+//
+//   header    magic, format version, kOpCodeCount, sizeof(BytecodeOp),
+//             fingerprint of the opcode names and builtin signatures, key, entry,
+//             section sizes, checksum of the rest
+//   code      BytecodeOp[codeCount], exactly as the VM runs them
+//   strings   constant pool, each as u32 length + bytes
+//   functions name (u32 length + bytes) + u64 entry, for diagnostics
+//   builtins  names in link-time id order, to remap CALL_BUILTIN ids on load
+class BytecodeCache {
+ public:
+  // FNV-1a over the source, salted with the optimization level it was compiled at.
+  static uint64_t Key(std::string_view source, int optLevel);
+
+  // Where the module for `key` lives inside `dir`.
+  static std::string PathFor(const std::string &dir, uint64_t key);
+
+  // Writes through a temporary file and a rename, so readers never see a
+  // half-written cache. Returns false if the file could not be written.
+  static bool Save(const std::string &path, const CompiledModule &module, uint64_t key);
+
+  // Reads the file once and rebuilds the module. Returns null when the file is
+  // missing or malformed, was written for another key or build, or calls a
+  // builtin that `builtins` does not provide.
+  static std::shared_ptr<const CompiledModule> Load(const std::string &path, uint64_t key,
+                                                    const BuiltinTable &builtins = BuiltinTable::Standard());
+};
+
+#endif // PETUKH_BYTECODE_CACHE_H
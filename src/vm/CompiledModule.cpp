@@ -0,0 +1,145 @@
+#include "CompiledModule.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+// Parses a literal operand once; malformed literals become 0 like before.
+static double ParseDoubleLiteral(const std::string &arg) {
+  try { return std::stod(arg); } catch (...) { return 0.0; }
+}
+
+static std::string StripQuotes(const std::string &arg) {
+  if (arg.size() >= 2 && ((arg.front() == '"' && arg.back() == '"') || (arg.front() == '\'' && arg.back() == '\''))) {
+    return arg.substr(1, arg.size() - 2);
+  }
+  return arg;
+}
+
+std::shared_ptr<const CompiledModule> CompiledModule::Link(std::vector<Instruction> poliz, BuiltinTable builtins) {
+  std::shared_ptr<CompiledModule> module(new CompiledModule);
+  module->poliz_ = std::move(poliz);
+  module->builtins_ = std::move(builtins);
+  module->Lower();
+  module->registers_ = RegisterModule::Translate(module->bytecode_, module->builtins_);
+  return module;
+}
+
+std::shared_ptr<const CompiledModule> CompiledModule::FromBytecode(BytecodeModule bytecode, BuiltinTable builtins) {
+  std::shared_ptr<CompiledModule> module(new CompiledModule);
+  module->bytecode_ = std::move(bytecode);
+  module->builtins_ = std::move(builtins);
+  module->registers_ = RegisterModule::Translate(module->bytecode_, module->builtins_);
+  return module;
+}
+
+// Lowers the POLIZ stream into bytecode_: LABEL pseudo-instructions are
+// dropped, JMP / JZ / CALL / TAIL_CALL get the index of their target,
+// CALL_BUILTIN its builtin id, literals are decoded into immediates and
+// strings go to a deduplicated constant pool.
+void CompiledModule::Lower() {
+  const std::vector<Instruction> &code = poliz_;
+  std::unordered_map<std::string, size_t> labels;
+  size_t pos = 0;
+  for (const auto &ins : code) {
+    if (ins.op == OpCode::LABEL) labels[ins.arg] = pos;
+    else pos++;
+  }
+
+  std::unordered_map<std::string, int32_t> pool;
+  auto intern = [&](const std::string &s) {
+    auto [it, inserted] = pool.emplace(s, static_cast<int32_t>(bytecode_.strings.size()));
+    if (inserted) bytecode_.strings.push_back(s);
+    return it->second;
+  };
+  auto target = [&](const Instruction &ins) {
+    auto it = labels.find(ins.arg);
+    if (it == labels.end())
+      throw std::runtime_error("unknown label for " + OpCodeToString(ins.op) + ": " + ins.arg);
+    return static_cast<int32_t>(it->second);
+  };
+
+  bytecode_ = BytecodeModule{};
+  bytecode_.code.reserve(pos);
+  std::unordered_map<std::string, size_t> functions;
+  for (const auto &ins : code) {
+    if (ins.op == OpCode::LABEL) continue;
+    BytecodeOp out;
+    out.op = ins.op;
+
+    switch (ins.op) {
+      case OpCode::PUSH_INT: out.imm.i = ParseIntLiteral(ins.arg); break;
+      case OpCode::PUSH_DOUBLE: out.imm.d = ParseDoubleLiteral(ins.arg); break;
+      case OpCode::PUSH_STRING: out.a = intern(StripQuotes(ins.arg)); break;
+
+      case OpCode::ENTER:
+      case OpCode::LOAD:
+      case OpCode::STORE:
+      case OpCode::LOAD_INDEX_UNSAFE:
+      case OpCode::STORE_INDEX_UNSAFE:
+        out.a = static_cast<int32_t>(ins.operand);
+        break;
+      case OpCode::LOAD_INDEX:
+      case OpCode::STORE_INDEX:
+        out.a = ins.arg.empty() ? -1 : static_cast<int32_t>(ins.operand);
+        break;
+      case OpCode::NEW_ARRAY:
+        out.a = static_cast<int32_t>(ElemKindOf(ins.arg));
+        break;
+
+      case OpCode::JMP:
+      case OpCode::JZ:
+        out.a = target(ins);
+        break;
+      case OpCode::TAIL_CALL:
+        out.a = target(ins);
+        functions.emplace(ins.arg, static_cast<size_t>(out.a));
+        break;
+
+      case OpCode::INC_LOCAL:
+      case OpCode::ADD_LOCAL_IMM:
+        out.a = static_cast<int32_t>(ins.operand);
+        out.imm.i = ins.imm;
+        break;
+      case OpCode::LOAD_LOAD_ADD:
+        out.a = static_cast<int32_t>(ins.operand);
+        out.imm.pair.x = static_cast<int32_t>(ins.imm);
+        break;
+      case OpCode::CALL:
+        if (labels.count(ins.arg)) {
+          out.a = target(ins);
+          functions.emplace(ins.arg, static_cast<size_t>(out.a));
+          break;
+        }
+        // POLIZ that calls builtins through plain CALL still links
+        out.op = OpCode::CALL_BUILTIN;
+        [[fallthrough]];
+      case OpCode::CALL_BUILTIN:
+        out.a = builtins_.Find(ins.arg);
+        if (out.a < 0)
+          throw std::runtime_error("unknown function: " + ins.arg);
+        break;
+
+      default:
+        if (IsFusedJump(ins.op)) {
+          out.a = target(ins);
+          out.imm.pair.x = static_cast<int32_t>(ins.operand);
+          out.imm.pair.y = static_cast<int32_t>(ins.imm);
+        }
+        break;
+    }
+    bytecode_.code.push_back(out);
+  }
+
+  // start at "main" if present
+  auto main = labels.find("main");
+  bytecode_.entry = main != labels.end() ? main->second : 0;
+  if (main != labels.end())
+    functions.emplace("main", main->second);
+
+  for (auto &[name, entry] : functions)
+    bytecode_.functions.push_back({name, entry});
+  std::sort(bytecode_.functions.begin(), bytecode_.functions.end(),
+            [](const BytecodeFunction &a, const BytecodeFunction &b) { return a.entry < b.entry; });
+}
@@ -0,0 +1,44 @@
+#ifndef PETUKH_COMPILED_MODULE_H
+#define PETUKH_COMPILED_MODULE_H
+
+#include <memory>
+#include <vector>
+#include "../rpn/RPNInstruction.h"
+#include "Builtins.h"
+#include "Bytecode.h"
+#include "RegisterCode.h"
+
+// One compiled program: the linked bytecode together with the POLIZ it came
+// from and the builtins it was linked against. Immutable once built, so a
+// single module can be shared by any number of VMs, also across threads.
+class CompiledModule {
+ public:
+  // Lowers POLIZ (from RPNGenerator) into bytecode; throws std::runtime_error
+  // for unknown labels or functions.
+  static std::shared_ptr<const CompiledModule> Link(std::vector<Instruction> poliz,
+                                                    BuiltinTable builtins = BuiltinTable::Standard());
+
+  // Wraps bytecode that is already linked against `builtins` (a cache load);
+  // such a module has no POLIZ.
+  static std::shared_ptr<const CompiledModule> FromBytecode(BytecodeModule bytecode,
+                                                            BuiltinTable builtins = BuiltinTable::Standard());
+
+  const BytecodeModule &Bytecode() const { return bytecode_; }
+  const BuiltinTable &Builtins() const { return builtins_; }
+  const std::vector<Instruction> &Poliz() const { return poliz_; }
+  // the bytecode in three-address form, for VM::Backend::kRegister; empty
+  // if it could not be translated
+  const RegisterModule &Registers() const { return registers_; }
+
+ private:
+  CompiledModule() = default;
+
+  std::vector<Instruction> poliz_;
+  BuiltinTable builtins_;
+  BytecodeModule bytecode_;
+  RegisterModule registers_;
+
+  void Lower();
+};
+
+#endif  // PETUKH_COMPILED_MODULE_H
@@ -0,0 +1,257 @@
+#include "FastIO.h"
+
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// ---------------- FastOutput ----------------
+
+FastOutput::FastOutput(int fd) : fd_(fd), interactive_(isatty(fd) != 0), buf_(kBufferSize) {}
+
+FastOutput::~FastOutput() { Flush(); }
+
+void FastOutput::Flush() {
+  const char *p = buf_.data();
+  size_t left = used_;
+  while (left > 0) {
+    ssize_t n = ::write(fd_, p, left);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      break;  // nowhere to report it; drop the rest like a closed stream would
+    }
+    p += n;
+    left -= static_cast<size_t>(n);
+  }
+  used_ = 0;
+}
+
+void FastOutput::Reset(int fd) {
+  Flush();
+  fd_ = fd;
+  interactive_ = isatty(fd) != 0;
+}
+
+void FastOutput::Reserve(size_t n) {
+  if (used_ + n > buf_.size()) Flush();
+}
+
+void FastOutput::Commit() {
+  if (interactive_) Flush();
+}
+
+void FastOutput::Write(std::string_view s) {
+  if (s.size() > buf_.size()) {
+    // too big to buffer: push out what is pending, then the string itself
+    Flush();
+    buf_.assign(s.begin(), s.end());
+    used_ = s.size();
+    Flush();
+    buf_.resize(kBufferSize);
+    return;
+  }
+  Reserve(s.size());
+  std::memcpy(buf_.data() + used_, s.data(), s.size());
+  used_ += s.size();
+  Commit();
+}
+
+void FastOutput::WriteInt(int64_t v) {
+  Reserve(24);
+  char *p = buf_.data() + used_;
+  used_ += static_cast<size_t>(std::to_chars(p, p + 24, v).ptr - p);
+  Commit();
+}
+
+void FastOutput::WriteDouble(double v) {
+  // std::ostream's default floatfield is %g with precision 6
+  Reserve(32);
+  int n = std::snprintf(buf_.data() + used_, 32, "%g", v);
+  if (n > 0) used_ += static_cast<size_t>(n);
+  Commit();
+}
+
+// ---------------- FastInput ----------------
+
+FastInput::FastInput(int fd) { Open(fd); }
+
+FastInput::~FastInput() { Close(); }
+
+void FastInput::Reset(int fd) {
+  Close();
+  Open(fd);
+}
+
+void FastInput::Open(int fd) {
+  fd_ = fd;
+  eof_ = false;
+  failed_ = false;
+  struct stat st{};
+  if (fstat(fd_, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    off_t at = lseek(fd_, 0, SEEK_CUR);
+    if (at < 0) at = 0;
+    if (at < st.st_size) {
+      void *m = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd_, 0);
+      if (m != MAP_FAILED) {
+        map_ = m;
+        mapSize_ = static_cast<size_t>(st.st_size);
+        pos_ = static_cast<const char *>(m) + at;
+        end_ = static_cast<const char *>(m) + mapSize_;
+        return;
+      }
+    }
+  }
+  buf_.resize(kBufferSize);
+  pos_ = end_ = buf_.data();
+}
+
+void FastInput::Close() {
+  if (map_) munmap(map_, mapSize_);
+  map_ = nullptr;
+  mapSize_ = 0;
+  pos_ = end_ = nullptr;
+}
+
+bool FastInput::Refill() {
+  if (map_ || eof_) return false;
+  if (tie_) tie_->Flush();
+  while (true) {
+    ssize_t n = ::read(fd_, buf_.data(), buf_.size());
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    pos_ = buf_.data();
+    end_ = pos_ + n;
+    return true;
+  }
+}
+
+int FastInput::Peek() {
+  if (pos_ == end_ && !Refill()) {
+    eof_ = true;
+    return -1;
+  }
+  return static_cast<unsigned char>(*pos_);
+}
+
+void FastInput::SkipSpace() {
+  int c;
+  while ((c = Peek()) >= 0 && std::isspace(c)) pos_++;
+}
+
+// Like `std::cin >> long long`: optional sign, then digits; no digits or a value
+// out of range fails.
+int64_t FastInput::ReadInt() {
+  if (failed_) return 0;
+  SkipSpace();
+
+  bool neg = false;
+  int c = Peek();
+  if (c == '+' || c == '-') {
+    neg = c == '-';
+    pos_++;
+    c = Peek();
+  }
+  if (c < '0' || c > '9') {
+    failed_ = true;
+    return 0;
+  }
+
+  const uint64_t limit = neg ? uint64_t{1} << 63 : static_cast<uint64_t>(std::numeric_limits<int64_t>::max());
+  uint64_t v = 0;
+  bool overflow = false;
+  while ((c = Peek()) >= '0' && c <= '9') {
+    uint64_t d = static_cast<uint64_t>(c - '0');
+    if (v > (limit - d) / 10) overflow = true;
+    else v = v * 10 + d;
+    pos_++;
+  }
+  if (overflow) {
+    failed_ = true;
+    return 0;
+  }
+  return neg ? static_cast<int64_t>(0 - v) : static_cast<int64_t>(v);
+}
+
+// Like `std::cin >> double`: [sign] digits [. digits] [e [sign] digits].
+double FastInput::ReadDouble() {
+  if (failed_) return 0.0;
+  SkipSpace();
+
+  char text[128];
+  size_t len = 0;
+  bool digits = false;
+  auto take = [&]() {
+    if (len + 1 < sizeof text) text[len++] = static_cast<char>(*pos_);
+    pos_++;
+  };
+  auto takeDigits = [&]() {
+    int c;
+    while ((c = Peek()) >= '0' && c <= '9') {
+      take();
+      digits = true;
+    }
+  };
+
+  int c = Peek();
+  if (c == '+' || c == '-') take();
+  takeDigits();
+  if (Peek() == '.') {
+    take();
+    takeDigits();
+  }
+  if (digits && ((c = Peek()) == 'e' || c == 'E')) {
+    take();
+    if ((c = Peek()) == '+' || c == '-') take();
+    takeDigits();
+  }
+  if (!digits) {
+    failed_ = true;
+    return 0.0;
+  }
+
+  text[len] = '\0';
+  errno = 0;
+  double d = std::strtod(text, nullptr);
+  if (errno == ERANGE && std::isinf(d)) {
+    failed_ = true;
+    return 0.0;
+  }
+  return d;
+}
+
+bool FastInput::GetLine(std::string &out) {
+  out.clear();
+  if (Peek() < 0) return false;
+  while (true) {
+    if (pos_ == end_ && Peek() < 0) return true;  // last line without '\n'
+    const char *nl = static_cast<const char *>(std::memchr(pos_, '\n', static_cast<size_t>(end_ - pos_)));
+    if (nl) {
+      out.append(pos_, nl);
+      pos_ = nl + 1;
+      return true;
+    }
+    out.append(pos_, end_);
+    pos_ = end_;
+  }
+}
+
+std::string FastInput::ReadLine() {
+  std::string s;
+  if (failed_) return s;
+  if (!GetLine(s)) {
+    failed_ = true;
+    return s;
+  }
+  // a number read just before leaves its newline behind; take the next line
+  if (s.empty() && !eof_ && !GetLine(s))
+    failed_ = true;
+  return s;
+}
@@ -0,0 +1,85 @@
+#ifndef PETUKH_FAST_IO_H
+#define PETUKH_FAST_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Buffered output on a raw file descriptor. Flushed when the buffer fills,
+// on Flush() and on destruction; on a terminal every write goes out at once.
+class FastOutput {
+ public:
+  explicit FastOutput(int fd = 1);
+  ~FastOutput();
+
+  FastOutput(const FastOutput &) = delete;
+  FastOutput &operator=(const FastOutput &) = delete;
+
+  void Write(std::string_view s);
+  void WriteInt(int64_t v);
+  void WriteDouble(double v);  // same text as std::ostream's default format
+  void Flush();
+
+  // Flushes, then writes to `fd` from now on.
+  void Reset(int fd);
+
+ private:
+  static constexpr size_t kBufferSize = 1 << 16;
+
+  int fd_;
+  bool interactive_;
+  std::vector<char> buf_;
+  size_t used_ = 0;
+
+  void Reserve(size_t n);
+  void Commit();
+};
+
+// Input scanner for the input* builtins. A regular file is mmap'ed whole,
+// anything else (pipes, terminals) is read in large chunks. Parsing follows
+// std::cin: a failed read yields 0 / "" and, like the stream's failbit,
+// makes every later read fail too.
+class FastInput {
+ public:
+  explicit FastInput(int fd = 0);
+  ~FastInput();
+
+  FastInput(const FastInput &) = delete;
+  FastInput &operator=(const FastInput &) = delete;
+
+  // Output flushed before blocking for more input, as with std::cin.tie().
+  void Tie(FastOutput *out) { tie_ = out; }
+
+  int64_t ReadInt();
+  double ReadDouble();
+  std::string ReadLine();  // inputStr: skips one empty line left by a number
+
+  // Drops everything buffered (and a failed state) and reads `fd` from now on.
+  void Reset(int fd);
+
+ private:
+  static constexpr size_t kBufferSize = 1 << 20;
+
+  int fd_;
+  FastOutput *tie_ = nullptr;
+
+  const char *pos_ = nullptr;
+  const char *end_ = nullptr;
+  void *map_ = nullptr;  // whole file when mmap'ed
+  size_t mapSize_ = 0;
+  std::vector<char> buf_;
+
+  bool eof_ = false;
+  bool failed_ = false;
+
+  void Open(int fd);
+  void Close();
+  bool Refill();
+  int Peek();
+  void SkipSpace();
+  bool GetLine(std::string &out);
+};
+
+#endif // PETUKH_FAST_IO_H
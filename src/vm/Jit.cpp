@@ -0,0 +1,411 @@
+#include "Jit.h"
+
+#include "StackDepth.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <map>
+#include <utility>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+Jit::Jit(const BytecodeModule &code, const BuiltinTable &builtins)
+    : code_(code), builtins_(builtins), entries_(code.code.size()), heat_(code.code.size(), 0),
+      starts_(FunctionStarts(code)), compiled_(starts_.size(), false) {}
+
+Jit::~Jit() {
+#if defined(__x86_64__)
+  for (const Region &r : regions_) munmap(r.base, r.size);
+#endif
+}
+
+bool Jit::Supported() {
+#if defined(__x86_64__)
+  return true;
+#else
+  return false;
+#endif
+}
+
+void Jit::Compile(size_t ip) {
+  size_t k = static_cast<size_t>(std::upper_bound(starts_.begin(), starts_.end(), ip) - starts_.begin()) - 1;
+  if (compiled_[k]) return;
+  compiled_[k] = true;
+  size_t end = k + 1 < starts_.size() ? starts_[k + 1] : code_.code.size();
+  CompileFunction(starts_[k], end);
+}
+
+#if defined(__x86_64__)
+
+namespace {
+
+// Items of the native operand stack at depth k live at stack[k]; the depth
+// before every instruction is known at compile time, so native code never
+// moves a stack pointer. Registers: rbx = frame slots, r13 = operand stack.
+enum Reg : int { RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSI = 6, RDI = 7, R13 = 13 };
+
+// condition codes, the low nibble of Jcc / SETcc
+enum Cond : uint8_t { kAE = 0x3, kE = 0x4, kNE = 0x5, kL = 0xC, kGE = 0xD, kLE = 0xE, kG = 0xF };
+
+constexpr uint8_t kIntTag = static_cast<uint8_t>(ValueType::kInt);
+constexpr uint8_t kFirstRefcountedTag = static_cast<uint8_t>(ValueType::kString);
+static_assert(ValueType::kArray > ValueType::kString, "refcounted tags must be the last ones");
+static_assert(sizeof(Value) == 16 && offsetof(Value, type) == 0 && offsetof(Value, i) == 8,
+              "native code reads Value's tag at +0 and its payload at +8");
+
+int32_t TagOf(int32_t slot) { return slot * 16; }
+int32_t PayloadOf(int32_t slot) { return slot * 16 + 8; }
+int32_t Operand(int depth) { return depth * 8; }
+
+bool FitsInt32(int64_t v) { return v >= INT32_MIN && v <= INT32_MAX; }
+
+class Assembler {
+ public:
+  std::vector<uint8_t> bytes;
+
+  size_t Size() const { return bytes.size(); }
+  void Byte(uint8_t b) { bytes.push_back(b); }
+  void Bytes(std::initializer_list<uint8_t> bs) { bytes.insert(bytes.end(), bs); }
+  void Imm32(int32_t v) { Raw(&v, sizeof(v)); }
+  void Imm64(int64_t v) { Raw(&v, sizeof(v)); }
+
+  // <op> reg, [base + disp32]; 64-bit operand size unless `wide` is false
+  void Mem(std::initializer_list<uint8_t> op, int reg, int base, int32_t disp, bool wide = true) {
+    uint8_t rex = static_cast<uint8_t>(0x40 | (wide ? 8 : 0) | ((reg >> 3) << 2) | (base >> 3));
+    if (rex != 0x40) Byte(rex);
+    Bytes(op);
+    Byte(static_cast<uint8_t>(0x80 | ((reg & 7) << 3) | (base & 7)));
+    Imm32(disp);
+  }
+
+  void MovImm64(int reg, int64_t v) {
+    Byte(static_cast<uint8_t>(0x48 | (reg >> 3)));
+    Byte(static_cast<uint8_t>(0xB8 + (reg & 7)));
+    Imm64(v);
+  }
+
+  // rel32 branches; the returned offset is for Patch
+  size_t Jcc(Cond c) { Bytes({0x0F, static_cast<uint8_t>(0x80 | c)}); Imm32(0); return Size() - 4; }
+  size_t Jmp() { Byte(0xE9); Imm32(0); return Size() - 4; }
+  void Patch(size_t at, size_t target) {
+    int32_t rel = static_cast<int32_t>(static_cast<int64_t>(target) - static_cast<int64_t>(at + 4));
+    std::memcpy(bytes.data() + at, &rel, sizeof(rel));
+  }
+
+ private:
+  void Raw(const void *p, size_t n) {
+    const auto *b = static_cast<const uint8_t *>(p);
+    bytes.insert(bytes.end(), b, b + n);
+  }
+};
+
+// *_INDEX on a frame slot, called from native code. They do what
+// VM::HandleLoadIndex / HandleStoreIndex do for int elements and return 0,
+// changing nothing, for whatever needs the interpreter instead. Nothing may
+// unwind through native code, so they never throw: a store that would is left
+// to the interpreter, which redoes it and throws from its own frames.
+int LoadIndex(const Value *arr, int64_t i, int64_t *out) noexcept {
+  if (arr->type != ValueType::kArray) return 0;
+  const ArrayObject &elems = arr->Array();
+  if (i < 0 || static_cast<size_t>(i) >= elems.Size()) { *out = 0; return 1; }
+  size_t k = static_cast<size_t>(i);
+  switch (elems.kind) {
+    case ElemKind::kInt: *out = elems.ints[k]; return 1;
+    case ElemKind::kChar: *out = elems.chars[k]; return 1;
+    case ElemKind::kValue:
+      if (elems.values[k].type != ValueType::kInt) return 0;
+      *out = elems.values[k].i;
+      return 1;
+    default:
+      return 0;
+  }
+}
+
+int StoreIndex(Value *arr, int64_t i, int64_t v) noexcept {
+  if (arr->type != ValueType::kArray) return 0;
+  if (i < 0) return 1;
+  // the copy on write or the growth can hit HeapUsage's limit or run out of
+  // memory; either throws before it changes the array
+  try {
+    ArrayObject &elems = arr->MutableArray();
+    if (static_cast<size_t>(i) >= elems.Size()) elems.Resize(static_cast<size_t>(i) + 1);
+    elems.Set(static_cast<size_t>(i), Value::MakeInt(v));
+  } catch (...) {
+    return 0;
+  }
+  return 1;
+}
+
+// comparison an opcode tests, and for the JZ_<cmp>_* forms the one that jumps
+Cond Holds(OpCode op) {
+  switch (op) {
+    case OpCode::EQ: case OpCode::EQ_I64: case OpCode::JZ_EQ_IMM: case OpCode::JZ_EQ_LOCAL: return kE;
+    case OpCode::NEQ: case OpCode::NEQ_I64: case OpCode::JZ_NEQ_IMM: case OpCode::JZ_NEQ_LOCAL: return kNE;
+    case OpCode::LT: case OpCode::LT_I64: case OpCode::JZ_LT_IMM: case OpCode::JZ_LT_LOCAL: return kL;
+    case OpCode::GT: case OpCode::GT_I64: case OpCode::JZ_GT_IMM: case OpCode::JZ_GT_LOCAL: return kG;
+    case OpCode::LE: case OpCode::LE_I64: case OpCode::JZ_LE_IMM: case OpCode::JZ_LE_LOCAL: return kLE;
+    default: return kGE;
+  }
+}
+
+Cond Fails(OpCode op) { return static_cast<Cond>(Holds(op) ^ 1); }
+
+}  // namespace
+
+bool Jit::CompileFunction(size_t begin, size_t end) {
+  const auto &code = code_.code;
+  const size_t n = end - begin;
+
+  // Every instruction is followed, not only the ones native code runs, so
+  // that loops after a call still get a known depth to be entered at.
+  std::vector<int32_t> depth;
+  if (!StackDepths(code_, builtins_, begin, end, kMaxDepth, depth)) return false;
+  size_t first = code[begin].op == OpCode::ENTER ? begin + 1 : begin;
+  size_t params = first != begin ? EntryArity(code_, begin) : 0;
+
+  // entry points: the function body, and loop headers at an empty operand stack
+  std::vector<std::pair<size_t, uint32_t>> entries;
+  if (code[begin].op == OpCode::ENTER) entries.emplace_back(first, static_cast<uint32_t>(params));
+  for (size_t ip = begin; ip < end; ++ip) {
+    if (code[ip].op != OpCode::JMP || depth[ip - begin] != 0) continue;
+    size_t target = static_cast<size_t>(code[ip].a);
+    if (target <= ip && target >= begin && target != first) entries.emplace_back(target, 0);
+  }
+  std::sort(entries.begin(), entries.end());
+  entries.erase(std::unique(entries.begin(), entries.end()), entries.end());
+
+  Assembler as;
+  std::vector<size_t> label(n, 0);
+  std::vector<std::pair<size_t, size_t>> jumps;                 // (displacement, target ip)
+  std::map<std::pair<size_t, int32_t>, std::vector<size_t>> exits;  // (ip, depth) -> displacements
+
+  auto jumpTo = [&](size_t at, size_t target) { jumps.emplace_back(at, target); };
+  auto exitAt = [&](size_t at, size_t ip, int32_t d) { exits[{ip, d}].push_back(at); };
+  auto guardInt = [&](size_t ip, int32_t d, int32_t slot) {
+    as.Mem({0x80}, 7, RBX, TagOf(slot), false);  // cmp byte [slot], kInt
+    as.Byte(kIntTag);
+    exitAt(as.Jcc(kNE), ip, d);
+  };
+  auto storeTop = [&](int reg, int32_t d) { as.Mem({0x89}, reg, R13, Operand(d)); };
+  auto loadTop = [&](int reg, int32_t d) { as.Mem({0x8B}, reg, R13, Operand(d)); };
+
+  for (size_t ip = begin; ip < end; ++ip) {
+    label[ip - begin] = as.Size();
+    int32_t d = depth[ip - begin];
+    if (d < 0) continue;  // native code never gets here
+    const BytecodeOp &ins = code[ip];
+    switch (ins.op) {
+      case OpCode::PUSH_INT:
+        if (FitsInt32(ins.imm.i)) {
+          as.Mem({0xC7}, 0, R13, Operand(d));  // mov qword [top], imm32
+          as.Imm32(static_cast<int32_t>(ins.imm.i));
+        } else {
+          as.MovImm64(RAX, ins.imm.i);
+          storeTop(RAX, d);
+        }
+        break;
+      case OpCode::LOAD:
+        guardInt(ip, d, ins.a);
+        as.Mem({0x8B}, RAX, RBX, PayloadOf(ins.a));
+        storeTop(RAX, d);
+        break;
+      case OpCode::STORE:
+        // overwriting a string or an array has to release it
+        as.Mem({0x0F, 0xB6}, RAX, RBX, TagOf(ins.a), false);  // movzx eax, byte [slot]
+        as.Bytes({0x3C, kFirstRefcountedTag});                // cmp al, kString
+        exitAt(as.Jcc(kAE), ip, d);
+        loadTop(RAX, d - 1);
+        as.Mem({0xC6}, 0, RBX, TagOf(ins.a), false);  // mov byte [slot], kInt
+        as.Byte(kIntTag);
+        as.Mem({0x89}, RAX, RBX, PayloadOf(ins.a));
+        break;
+      case OpCode::POP:
+        break;
+
+      // the native stack only ever holds ints, so the generic operators take
+      // the int path of their VM counterparts
+      case OpCode::ADD: case OpCode::ADD_I64:
+      case OpCode::SUB: case OpCode::SUB_I64:
+      case OpCode::MUL: case OpCode::MUL_I64: {
+        uint8_t op = ins.op == OpCode::ADD || ins.op == OpCode::ADD_I64 ? 0x03
+                   : ins.op == OpCode::SUB || ins.op == OpCode::SUB_I64 ? 0x2B : 0;
+        loadTop(RAX, d - 2);
+        if (op) as.Mem({op}, RAX, R13, Operand(d - 1));
+        else as.Mem({0x0F, 0xAF}, RAX, R13, Operand(d - 1));  // imul
+        storeTop(RAX, d - 2);
+        break;
+      }
+      case OpCode::DIV: case OpCode::DIV_I64:
+      case OpCode::MOD: case OpCode::MOD_I64: {
+        bool mod = ins.op == OpCode::MOD || ins.op == OpCode::MOD_I64;
+        // x / 0 and x % 0 are 0
+        loadTop(RCX, d - 1);
+        as.Bytes({0x48, 0x85, 0xC9});  // test rcx, rcx
+        size_t nonZero = as.Jcc(kNE);
+        as.Bytes({0x31, 0xC0});        // xor eax, eax
+        as.Bytes({0x31, 0xD2});        // xor edx, edx
+        size_t done = as.Jmp();
+        as.Patch(nonZero, as.Size());
+        loadTop(RAX, d - 2);
+        as.Bytes({0x48, 0x99, 0x48, 0xF7, 0xF9});  // cqo; idiv rcx
+        as.Patch(done, as.Size());
+        storeTop(mod ? RDX : RAX, d - 2);
+        break;
+      }
+      case OpCode::NEG: case OpCode::NEG_I64:
+        as.Mem({0xF7}, 3, R13, Operand(d - 1));  // neg qword [top]
+        break;
+      case OpCode::NOT:
+        as.Mem({0x83}, 7, R13, Operand(d - 1));  // cmp qword [top], 0
+        as.Byte(0);
+        as.Bytes({0x0F, static_cast<uint8_t>(0x90 | kE), 0xC0, 0x0F, 0xB6, 0xC0});  // sete al; movzx eax, al
+        storeTop(RAX, d - 1);
+        break;
+      case OpCode::EQ: case OpCode::NEQ: case OpCode::LT: case OpCode::GT: case OpCode::LE: case OpCode::GE:
+      case OpCode::EQ_I64: case OpCode::NEQ_I64: case OpCode::LT_I64:
+      case OpCode::GT_I64: case OpCode::LE_I64: case OpCode::GE_I64:
+        loadTop(RAX, d - 2);
+        as.Mem({0x3B}, RAX, R13, Operand(d - 1));  // cmp rax, [top]
+        as.Bytes({0x0F, static_cast<uint8_t>(0x90 | Holds(ins.op)), 0xC0, 0x0F, 0xB6, 0xC0});
+        storeTop(RAX, d - 2);
+        break;
+
+      case OpCode::JMP:
+        jumpTo(as.Jmp(), static_cast<size_t>(ins.a));
+        break;
+      case OpCode::JZ:
+        as.Mem({0x83}, 7, R13, Operand(d - 1));  // cmp qword [top], 0
+        as.Byte(0);
+        jumpTo(as.Jcc(kE), static_cast<size_t>(ins.a));
+        break;
+
+      case OpCode::INC_LOCAL:
+        guardInt(ip, d, ins.a);
+        if (FitsInt32(ins.imm.i)) {
+          as.Mem({0x81}, 0, RBX, PayloadOf(ins.a));  // add qword [slot], imm32
+          as.Imm32(static_cast<int32_t>(ins.imm.i));
+        } else {
+          as.MovImm64(RAX, ins.imm.i);
+          as.Mem({0x01}, RAX, RBX, PayloadOf(ins.a));
+        }
+        break;
+      case OpCode::ADD_LOCAL_IMM:
+        guardInt(ip, d, ins.a);
+        as.Mem({0x8B}, RAX, RBX, PayloadOf(ins.a));
+        if (FitsInt32(ins.imm.i)) {
+          as.Bytes({0x48, 0x05});  // add rax, imm32
+          as.Imm32(static_cast<int32_t>(ins.imm.i));
+        } else {
+          as.MovImm64(RCX, ins.imm.i);
+          as.Bytes({0x48, 0x01, 0xC8});  // add rax, rcx
+        }
+        storeTop(RAX, d);
+        break;
+      case OpCode::LOAD_LOAD_ADD:
+        guardInt(ip, d, ins.a);
+        guardInt(ip, d, ins.imm.pair.x);
+        as.Mem({0x8B}, RAX, RBX, PayloadOf(ins.a));
+        as.Mem({0x03}, RAX, RBX, PayloadOf(ins.imm.pair.x));
+        storeTop(RAX, d);
+        break;
+      case OpCode::JZ_EQ_IMM: case OpCode::JZ_NEQ_IMM: case OpCode::JZ_LT_IMM:
+      case OpCode::JZ_GT_IMM: case OpCode::JZ_LE_IMM: case OpCode::JZ_GE_IMM:
+        guardInt(ip, d, ins.imm.pair.x);
+        as.Mem({0x8B}, RAX, RBX, PayloadOf(ins.imm.pair.x));
+        as.Bytes({0x48, 0x3D});  // cmp rax, imm32
+        as.Imm32(ins.imm.pair.y);
+        jumpTo(as.Jcc(Fails(ins.op)), static_cast<size_t>(ins.a));
+        break;
+      case OpCode::JZ_EQ_LOCAL: case OpCode::JZ_NEQ_LOCAL: case OpCode::JZ_LT_LOCAL:
+      case OpCode::JZ_GT_LOCAL: case OpCode::JZ_LE_LOCAL: case OpCode::JZ_GE_LOCAL:
+        guardInt(ip, d, ins.imm.pair.x);
+        guardInt(ip, d, ins.imm.pair.y);
+        as.Mem({0x8B}, RAX, RBX, PayloadOf(ins.imm.pair.x));
+        as.Mem({0x3B}, RAX, RBX, PayloadOf(ins.imm.pair.y));
+        jumpTo(as.Jcc(Fails(ins.op)), static_cast<size_t>(ins.a));
+        break;
+
+      // the unsafe forms share the checked helpers: next to the call, the checks cost nothing
+      case OpCode::LOAD_INDEX: case OpCode::LOAD_INDEX_UNSAFE:
+      case OpCode::STORE_INDEX: case OpCode::STORE_INDEX_UNSAFE: {
+        if (ins.a < 0) {
+          exitAt(as.Jmp(), ip, d);
+          break;
+        }
+        bool load = ins.op == OpCode::LOAD_INDEX || ins.op == OpCode::LOAD_INDEX_UNSAFE;
+        as.Mem({0x8D}, RDI, RBX, TagOf(ins.a));  // lea rdi, [slot]
+        loadTop(RSI, d - 1);                     // index
+        if (load) as.Mem({0x8D}, RDX, R13, Operand(d - 1));  // the element replaces it
+        else loadTop(RDX, d - 2);                            // value
+        as.MovImm64(RAX, load ? reinterpret_cast<int64_t>(&LoadIndex) : reinterpret_cast<int64_t>(&StoreIndex));
+        as.Bytes({0xFF, 0xD0, 0x85, 0xC0});  // call rax; test eax, eax
+        exitAt(as.Jcc(kE), ip, d);
+        break;
+      }
+
+      default:
+        // calls, returns, strings, doubles, arrays on the stack
+        exitAt(as.Jmp(), ip, d);
+        break;
+    }
+  }
+
+  // one stub per distinct exit, then the shared epilogue
+  size_t epilogue = 0;
+  std::vector<size_t> toEpilogue;
+  for (const auto &[where, sites] : exits) {
+    for (size_t at : sites) as.Patch(at, as.Size());
+    as.Byte(0xB8);  // mov eax, ip
+    as.Imm32(static_cast<int32_t>(where.first));
+    as.Byte(0xBA);  // mov edx, depth
+    as.Imm32(where.second);
+    toEpilogue.push_back(as.Jmp());
+  }
+  epilogue = as.Size();
+  as.Bytes({0x41, 0x5D, 0x41, 0x5C, 0x5B, 0xC3});  // pop r13; pop r12; pop rbx; ret
+  for (size_t at : toEpilogue) as.Patch(at, epilogue);
+
+  // per-entry prologues; r12 is saved just to keep the stack aligned for the helper calls
+  std::vector<std::pair<size_t, size_t>> prologues;  // (code offset, ip)
+  for (const auto &[ip, d] : entries) {
+    prologues.emplace_back(as.Size(), ip);
+    as.Bytes({0x53, 0x41, 0x54, 0x41, 0x55});  // push rbx; push r12; push r13
+    as.Bytes({0x48, 0x89, 0xFB, 0x49, 0x89, 0xF5});  // mov rbx, rdi; mov r13, rsi
+    jumpTo(as.Jmp(), ip);
+  }
+
+  for (const auto &[at, target] : jumps) {
+    // every target was reached by the depth pass, so it lies in the function
+    as.Patch(at, label[target - begin]);
+  }
+
+  long page = sysconf(_SC_PAGESIZE);
+  size_t size = (as.Size() + static_cast<size_t>(page) - 1) / static_cast<size_t>(page) * static_cast<size_t>(page);
+  void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) return false;
+  std::memcpy(mem, as.bytes.data(), as.Size());
+  if (mprotect(mem, size, PROT_READ | PROT_EXEC) != 0) {
+    munmap(mem, size);
+    return false;
+  }
+  regions_.push_back({mem, size});
+
+  for (size_t k = 0; k < entries.size(); ++k) {
+    Entry &e = entries_[entries[k].first];
+    e.code = reinterpret_cast<Code>(static_cast<uint8_t *>(mem) + prologues[k].first);
+    e.depth = entries[k].second;
+  }
+  return true;
+}
+
+#else
+
+// no code generator for this target: everything stays interpreted
+bool Jit::CompileFunction(size_t, size_t) { return false; }
+
+#endif
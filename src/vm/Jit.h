@@ -0,0 +1,93 @@
+#ifndef PETUKH_JIT_H
+#define PETUKH_JIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Builtins.h"
+#include "Bytecode.h"
+#include "Value.h"
+
+#ifndef PETUKH_JIT
+#define PETUKH_JIT 0
+#endif
+
+// Baseline tier of VM::Run, compiled in only with PETUKH_JIT. The interpreter
+// counts function entries (after ENTER) and loop headers (targets of backward
+// JMPs); once one of them has been reached kHotThreshold times, the whole
+// function around it is translated, one template per instruction, to x86-64
+// code. Other targets keep interpreting.
+//
+// Native code works on the frame's slots in place and keeps the operand
+// stack as plain int64s. It covers int arithmetic and comparisons, JMP / JZ,
+// the fused locals ops and *_INDEX on local arrays; everything else (calls,
+// returns, strings, doubles) and every failed type guard exits back to the
+// interpreter at that instruction, with the operand stack handed over.
+class Jit {
+ public:
+  static constexpr uint32_t kHotThreshold = 1000;
+  // deepest operand stack native code may build
+  static constexpr size_t kMaxDepth = 256;
+
+  // where native code stopped: the interpreter resumes at `ip` with the
+  // first `depth` entries of the int stack pushed onto its own
+  struct Exit {
+    uint64_t ip;
+    uint64_t depth;
+  };
+  using Code = Exit (*)(Value *locals, int64_t *stack);
+
+  struct Entry {
+    Code code = nullptr;
+    uint32_t depth = 0;   // operands (all ints) it takes over from the interpreter
+    uint32_t stalls = 0;  // runs that exited right where they started
+  };
+
+  // `code` and `builtins` must outlive the Jit.
+  Jit(const BytecodeModule &code, const BuiltinTable &builtins);
+  ~Jit();
+  Jit(const Jit &) = delete;
+  Jit &operator=(const Jit &) = delete;
+
+  // Native code starting at `ip`, if there is any by now. Counts the visit
+  // and compiles the enclosing function when `ip` turns hot.
+  Entry *Lookup(size_t ip) {
+    Entry &e = entries_[ip];
+    if (e.code) return &e;
+    if (heat_[ip] < kHotThreshold && ++heat_[ip] == kHotThreshold) {
+      Compile(ip);
+      if (e.code) return &e;
+    }
+    return nullptr;
+  }
+
+  // Native code that cannot get past its first instruction (a guard that
+  // always fails) only costs an extra call; it is dropped after a few tries.
+  void Stalled(Entry &e) {
+    if (++e.stalls == kMaxStalls) e.code = nullptr;
+  }
+
+  // x86-64 only
+  static bool Supported();
+
+ private:
+  static constexpr uint32_t kMaxStalls = 64;
+
+  struct Region {
+    void *base;
+    size_t size;
+  };
+
+  const BytecodeModule &code_;
+  const BuiltinTable &builtins_;
+  std::vector<Entry> entries_;
+  std::vector<uint32_t> heat_;
+  std::vector<size_t> starts_;     // function boundaries, ascending
+  std::vector<bool> compiled_;     // per function, tried already
+  std::vector<Region> regions_;    // executable memory, one per function
+
+  void Compile(size_t ip);
+  bool CompileFunction(size_t begin, size_t end);
+};
+
+#endif  // PETUKH_JIT_H
@@ -0,0 +1,218 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+uint64_t Profiler::Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t v;
+  asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+  return v;
+#else
+  return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+void Profiler::Begin(const BytecodeModule &code) {
+  code_ = &code;
+  names_.clear();
+  for (const auto &f : code.functions)
+    names_.push_back(f.name);
+  names_.push_back("<top-level>");
+
+  functionAt_.assign(code.code.size() + 1, -1);
+  for (size_t i = 0; i < code.functions.size(); ++i)
+    functionAt_[code.functions[i].entry] = static_cast<int32_t>(i);
+
+  ops_.assign(kOpCodeCount, OpStats{});
+  functions_.assign(names_.size(), FunctionStats{});
+  backEdges_.assign(code.code.size() + 1, 0);
+  paths_.clear();
+  frames_.clear();
+  started_ = false;
+  allocationsLast_ = HeapUsage::Current().allocations;
+
+  // the bottom frame: main, or the top-level code before it
+  int32_t bottom = functionAt_[code.entry];
+  Push(bottom >= 0 ? bottom : static_cast<int32_t>(names_.size() - 1), Ticks());
+  last_ = Ticks();
+}
+
+void Profiler::Account(uint64_t now) {
+  uint64_t spent = now - last_;
+  last_ = now;
+  uint64_t allocations = HeapUsage::Current().allocations;
+  uint64_t made = allocations - allocationsLast_;
+  allocationsLast_ = allocations;
+  if (!started_) return;
+  ops_[static_cast<size_t>(lastOp_)].ticks += spent;
+  ops_[static_cast<size_t>(lastOp_)].allocations += made;
+  if (!frames_.empty()) {
+    functions_[static_cast<size_t>(frames_.back().function)].exclusive += spent;
+    paths_[static_cast<size_t>(frames_.back().path)].ticks += spent;
+  }
+}
+
+void Profiler::Transition(size_t ip, OpCode op, uint64_t now) {
+  if (started_) {
+    switch (lastOp_) {
+      case OpCode::CALL:
+        Push(functionAt_[ip], now);
+        break;
+      case OpCode::TAIL_CALL:
+        // the callee takes over the frame, as it does in the VM
+        Pop(now);
+        Push(functionAt_[ip], now);
+        break;
+      case OpCode::RET:
+        Pop(now);
+        break;
+      default:
+        if (IsJump(lastOp_) && ip <= lastIp_)
+          backEdges_[ip]++;
+        break;
+    }
+  }
+  started_ = true;
+  ops_[static_cast<size_t>(op)].count++;
+  lastIp_ = ip;
+  lastOp_ = op;
+}
+
+void Profiler::End() {
+  if (!code_) return;
+  uint64_t now = Ticks();
+  Account(now);
+  while (!frames_.empty())
+    Pop(now);
+}
+
+uint64_t Profiler::Instructions() const {
+  uint64_t n = 0;
+  for (const auto &s : ops_)
+    n += s.count;
+  return n;
+}
+
+void Profiler::Push(int32_t function, uint64_t now) {
+  if (function < 0) function = static_cast<int32_t>(names_.size() - 1);
+  FunctionStats &f = functions_[static_cast<size_t>(function)];
+  f.calls++;
+  f.active++;
+  int32_t parent = frames_.empty() ? -1 : frames_.back().path;
+  frames_.push_back({function, ChildPath(parent, function), now});
+}
+
+void Profiler::Pop(uint64_t now) {
+  if (frames_.empty()) return;
+  Frame fr = frames_.back();
+  frames_.pop_back();
+  FunctionStats &f = functions_[static_cast<size_t>(fr.function)];
+  if (--f.active == 0)
+    f.inclusive += now - fr.start;
+}
+
+// Direct recursion stays on its caller's node, so a deep recursive descent
+// is one frame in the flamegraph rather than thousands of nested ones.
+int32_t Profiler::ChildPath(int32_t parent, int32_t function) {
+  if (parent >= 0 && paths_[static_cast<size_t>(parent)].function == function)
+    return parent;
+  if (parent >= 0) {
+    for (int32_t child : paths_[static_cast<size_t>(parent)].children)
+      if (paths_[static_cast<size_t>(child)].function == function)
+        return child;
+  }
+  auto id = static_cast<int32_t>(paths_.size());
+  paths_.push_back({function, parent, 0, {}});
+  if (parent >= 0)
+    paths_[static_cast<size_t>(parent)].children.push_back(id);
+  return id;
+}
+
+// functions are sorted by entry, and each one's code runs up to the next entry
+int32_t Profiler::FunctionContaining(size_t ip) const {
+  int32_t found = static_cast<int32_t>(names_.size() - 1);
+  for (size_t i = 0; i < code_->functions.size() && code_->functions[i].entry <= ip; ++i)
+    found = static_cast<int32_t>(i);
+  return found;
+}
+
+void Profiler::Report(std::ostream &out) const {
+  if (!code_) return;
+
+  uint64_t total = 0;
+  for (const auto &s : ops_)
+    total += s.ticks;
+  auto percent = [total](uint64_t t) { return total ? 100.0 * static_cast<double>(t) / static_cast<double>(total) : 0.0; };
+
+  out << "=== Opcodes ===\n";
+  std::vector<size_t> order;
+  for (size_t i = 0; i < ops_.size(); ++i)
+    if (ops_[i].count) order.push_back(i);
+  std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return ops_[a].ticks > ops_[b].ticks; });
+  out << std::left << std::setw(16) << "opcode" << std::right << std::setw(14) << "count"
+      << std::setw(16) << "ticks" << std::setw(8) << "%" << std::setw(12) << "ticks/op" << std::setw(12) << "allocs" << "\n";
+  for (size_t i : order) {
+    const OpStats &s = ops_[i];
+    out << std::left << std::setw(16) << OpCodeToString(static_cast<OpCode>(i)) << std::right
+        << std::setw(14) << s.count << std::setw(16) << s.ticks << std::setw(8) << std::fixed
+        << std::setprecision(1) << percent(s.ticks) << std::setw(12) << std::setprecision(1)
+        << static_cast<double>(s.ticks) / static_cast<double>(s.count) << std::setw(12)
+        << s.allocations << "\n";
+  }
+
+  out << "\n=== Functions ===\n";
+  order.clear();
+  for (size_t i = 0; i < functions_.size(); ++i)
+    if (functions_[i].calls) order.push_back(i);
+  std::sort(order.begin(), order.end(),
+            [this](size_t a, size_t b) { return functions_[a].exclusive > functions_[b].exclusive; });
+  out << std::left << std::setw(24) << "function" << std::right << std::setw(12) << "calls"
+      << std::setw(16) << "inclusive" << std::setw(16) << "exclusive" << std::setw(8) << "excl%" << "\n";
+  for (size_t i : order) {
+    const FunctionStats &f = functions_[i];
+    out << std::left << std::setw(24) << names_[i] << std::right << std::setw(12) << f.calls
+        << std::setw(16) << f.inclusive << std::setw(16) << f.exclusive << std::setw(8)
+        << std::setprecision(1) << percent(f.exclusive) << "\n";
+  }
+
+  out << "\n=== Hot loops (back-edges per jump target) ===\n";
+  order.clear();
+  for (size_t i = 0; i < backEdges_.size(); ++i)
+    if (backEdges_[i]) order.push_back(i);
+  std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return backEdges_[a] > backEdges_[b]; });
+  for (size_t i : order) {
+    int32_t fn = FunctionContaining(i);
+    size_t base = static_cast<size_t>(fn) < code_->functions.size() ? code_->functions[static_cast<size_t>(fn)].entry : 0;
+    out << std::left << std::setw(24) << (names_[static_cast<size_t>(fn)] + "+" + std::to_string(i - base))
+        << std::right << std::setw(14) << backEdges_[i] << "   (code index " << i << ")\n";
+  }
+  out << std::defaultfloat;
+}
+
+void Profiler::WritePath(std::ostream &out, int32_t path) const {
+  std::vector<int32_t> chain;
+  for (int32_t p = path; p >= 0; p = paths_[static_cast<size_t>(p)].parent)
+    chain.push_back(paths_[static_cast<size_t>(p)].function);
+  for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+    if (it != chain.rbegin()) out << ';';
+    out << names_[static_cast<size_t>(*it)];
+  }
+}
+
+void Profiler::WriteFolded(std::ostream &out) const {
+  for (size_t i = 0; i < paths_.size(); ++i) {
+    if (!paths_[i].ticks) continue;
+    WritePath(out, static_cast<int32_t>(i));
+    out << ' ' << paths_[i].ticks << '\n';
+  }
+}
@@ -0,0 +1,97 @@
+#ifndef PETUKH_PROFILER_H
+#define PETUKH_PROFILER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Bytecode.h"
+#include "Value.h"
+
+#ifndef PETUKH_PROFILE
+#define PETUKH_PROFILE 0
+#endif
+
+// Instrumentation for VM::Run, compiled in only with PETUKH_PROFILE. The VM
+// calls Step() before every instruction; everything else (calls, returns,
+// loops) is inferred from which instruction follows which, so the dispatch
+// loop carries a single hook.
+//
+// Times are in ticks of the cheapest monotonic counter available: the TSC on
+// x86-64, the virtual counter on arm64, nanoseconds elsewhere.
+class Profiler {
+ public:
+  // Forgets the previous run; `code` must stay alive until End().
+  void Begin(const BytecodeModule &code);
+  void Step(size_t ip, OpCode op) {
+    uint64_t now = Ticks();
+    Account(now);
+    Transition(ip, op, now);
+  }
+  // Closes the frames still open when the program stops.
+  void End();
+
+  // Opcode, function and hot-loop tables.
+  void Report(std::ostream &out) const;
+  // One "caller;callee ticks" line per call path, the format flamegraph.pl reads.
+  void WriteFolded(std::ostream &out) const;
+
+  // instructions executed by the run
+  [[nodiscard]] uint64_t Instructions() const;
+
+  static uint64_t Ticks();
+
+ private:
+  struct OpStats {
+    uint64_t count = 0;
+    uint64_t ticks = 0;
+    uint64_t allocations = 0;  // strings and arrays made while it ran (HeapUsage)
+  };
+
+  struct FunctionStats {
+    uint64_t calls = 0;
+    uint64_t inclusive = 0;
+    uint64_t exclusive = 0;
+    uint32_t active = 0;  // frames on the stack; recursion counts inclusive time once
+  };
+
+  // A node per distinct call path, for the folded stacks.
+  struct PathNode {
+    int32_t function;
+    int32_t parent;
+    uint64_t ticks = 0;
+    std::vector<int32_t> children;
+  };
+
+  struct Frame {
+    int32_t function;
+    int32_t path;
+    uint64_t start;
+  };
+
+  const BytecodeModule *code_ = nullptr;
+  std::vector<std::string> names_;  // function index -> name; the last one is <top-level>
+  std::vector<int32_t> functionAt_;  // code index -> function entered there, or -1
+  std::vector<OpStats> ops_;
+  std::vector<FunctionStats> functions_;
+  std::vector<uint64_t> backEdges_;  // per jump target
+  std::vector<PathNode> paths_;
+  std::vector<Frame> frames_;
+
+  size_t lastIp_ = 0;
+  OpCode lastOp_ = OpCode::POP;
+  bool started_ = false;
+  uint64_t last_ = 0;
+  uint64_t allocationsLast_ = 0;
+
+  void Account(uint64_t now);
+  void Transition(size_t ip, OpCode op, uint64_t now);
+  void Push(int32_t function, uint64_t now);
+  void Pop(uint64_t now);
+  int32_t ChildPath(int32_t parent, int32_t function);
+  int32_t FunctionContaining(size_t ip) const;
+  void WritePath(std::ostream &out, int32_t path) const;
+};
+
+#endif  // PETUKH_PROFILER_H
@@ -0,0 +1,475 @@
+#include "RegisterCode.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include "StackDepth.h"
+
+// X(name, operands): operators translated one to one from the stack opcode of the same name
+#define PETUKH_REG_OPERATORS(X) \
+  X(ADD, 2) X(SUB, 2) X(MUL, 2) X(DIV, 2) X(MOD, 2) \
+  X(EQ, 2) X(NEQ, 2) X(LT, 2) X(GT, 2) X(LE, 2) X(GE, 2) \
+  X(NEG, 1) X(NOT, 1) \
+  X(ADD_I64, 2) X(SUB_I64, 2) X(MUL_I64, 2) X(DIV_I64, 2) X(MOD_I64, 2) X(NEG_I64, 1) \
+  X(EQ_I64, 2) X(NEQ_I64, 2) X(LT_I64, 2) X(GT_I64, 2) X(LE_I64, 2) X(GE_I64, 2) \
+  X(ADD_F64, 2) X(SUB_F64, 2) X(MUL_F64, 2) X(DIV_F64, 2) X(NEG_F64, 1) \
+  X(LT_F64, 2) X(GT_F64, 2) X(LE_F64, 2) X(GE_F64, 2)
+
+const char *RegOpCodeName(RegOpCode op) {
+  switch (op) {
+    case RegOpCode::MOVE: return "MOVE";
+#define X(name, n) case RegOpCode::name: return #name;
+    PETUKH_REG_OPERATORS(X)
+#undef X
+    case RegOpCode::LOAD_INDEX: return "LOAD_INDEX";
+    case RegOpCode::STORE_INDEX: return "STORE_INDEX";
+    case RegOpCode::LOAD_INDEX_UNSAFE: return "LOAD_INDEX_UNSAFE";
+    case RegOpCode::STORE_INDEX_UNSAFE: return "STORE_INDEX_UNSAFE";
+    case RegOpCode::NEW_ARRAY: return "NEW_ARRAY";
+    case RegOpCode::JMP: return "JMP";
+    case RegOpCode::JZ: return "JZ";
+    case RegOpCode::JZ_EQ: return "JZ_EQ";
+    case RegOpCode::JZ_NEQ: return "JZ_NEQ";
+    case RegOpCode::JZ_LT: return "JZ_LT";
+    case RegOpCode::JZ_GT: return "JZ_GT";
+    case RegOpCode::JZ_LE: return "JZ_LE";
+    case RegOpCode::JZ_GE: return "JZ_GE";
+    case RegOpCode::CALL: return "CALL";
+    case RegOpCode::TAIL_CALL: return "TAIL_CALL";
+    case RegOpCode::CALL_BUILTIN: return "CALL_BUILTIN";
+    case RegOpCode::RET: return "RET";
+    case RegOpCode::ENTER: return "ENTER";
+  }
+  return "?";
+}
+
+namespace {
+
+// Operands of results that may be redirected into the local they get stored to.
+bool WritesOnlyA(RegOpCode op) {
+  return op <= RegOpCode::GE_F64 || op == RegOpCode::LOAD_INDEX || op == RegOpCode::LOAD_INDEX_UNSAFE ||
+         op == RegOpCode::NEW_ARRAY;
+}
+
+// the JZ_<cmp> a comparison turns into when only a jump consumes it
+bool CompareJump(RegOpCode cmp, RegOpCode &jump) {
+  switch (cmp) {
+    case RegOpCode::EQ: case RegOpCode::EQ_I64: jump = RegOpCode::JZ_EQ; return true;
+    case RegOpCode::NEQ: case RegOpCode::NEQ_I64: jump = RegOpCode::JZ_NEQ; return true;
+    case RegOpCode::LT: case RegOpCode::LT_I64: case RegOpCode::LT_F64: jump = RegOpCode::JZ_LT; return true;
+    case RegOpCode::GT: case RegOpCode::GT_I64: case RegOpCode::GT_F64: jump = RegOpCode::JZ_GT; return true;
+    case RegOpCode::LE: case RegOpCode::LE_I64: case RegOpCode::LE_F64: jump = RegOpCode::JZ_LE; return true;
+    case RegOpCode::GE: case RegOpCode::GE_I64: case RegOpCode::GE_F64: jump = RegOpCode::JZ_GE; return true;
+    default: return false;
+  }
+}
+
+RegOpCode FusedJump(OpCode op) {
+  switch (op) {
+    case OpCode::JZ_EQ_IMM: case OpCode::JZ_EQ_LOCAL: return RegOpCode::JZ_EQ;
+    case OpCode::JZ_NEQ_IMM: case OpCode::JZ_NEQ_LOCAL: return RegOpCode::JZ_NEQ;
+    case OpCode::JZ_LT_IMM: case OpCode::JZ_LT_LOCAL: return RegOpCode::JZ_LT;
+    case OpCode::JZ_GT_IMM: case OpCode::JZ_GT_LOCAL: return RegOpCode::JZ_GT;
+    case OpCode::JZ_LE_IMM: case OpCode::JZ_LE_LOCAL: return RegOpCode::JZ_LE;
+    default: return RegOpCode::JZ_GE;
+  }
+}
+
+// The operand stack is simulated symbolically: an entry is the register or
+// constant it would hold, so LOAD and PUSH_* emit nothing and operators read
+// locals directly. An entry only lives in the temporary of its depth when
+// something computed it there, or at block boundaries, where every path
+// must agree on the layout.
+class Translator {
+ public:
+  Translator(const BytecodeModule &bytecode, const BuiltinTable &builtins, RegisterModule &out)
+      : bc_(bytecode), builtins_(builtins), out_(out), pcOf_(bytecode.code.size(), -1) {}
+
+  bool Run() {
+    for (size_t k = 0; k < bc_.functions.size(); ++k) {
+      functionOf_[bc_.functions[k].entry] = static_cast<int32_t>(k);
+      out_.functions.push_back({bc_.functions[k].name, 0, 0});
+    }
+    std::vector<size_t> starts = FunctionStarts(bc_);
+    for (size_t k = 0; k < starts.size(); ++k) {
+      size_t end = k + 1 < starts.size() ? starts[k + 1] : bc_.code.size();
+      if (!Function(starts[k], end)) return false;
+    }
+    for (const auto &[at, target] : jumps_) {
+      if (pcOf_[target] < 0) return false;
+      out_.code[at].a = pcOf_[target];
+    }
+    for (size_t k = 0; k < bc_.functions.size(); ++k) {
+      if (pcOf_[bc_.functions[k].entry] < 0) return false;
+      out_.functions[k].entry = static_cast<uint32_t>(pcOf_[bc_.functions[k].entry]);
+    }
+    if (bc_.entry >= bc_.code.size() || pcOf_[bc_.entry] < 0) return false;
+    out_.entry = static_cast<size_t>(pcOf_[bc_.entry]);
+    return true;
+  }
+
+ private:
+  static constexpr size_t kMaxTemps = 1 << 16;
+
+  const BytecodeModule &bc_;
+  const BuiltinTable &builtins_;
+  RegisterModule &out_;
+  std::vector<int32_t> pcOf_;                     // bytecode index -> register pc
+  std::vector<std::pair<size_t, size_t>> jumps_;  // (register pc, bytecode target)
+  std::unordered_map<size_t, int32_t> functionOf_;
+  std::unordered_map<int64_t, int32_t> intConsts_;
+  std::unordered_map<uint64_t, int32_t> doubleConsts_;
+  std::unordered_map<int32_t, int32_t> stringConsts_;
+
+  // per function
+  int32_t locals_ = 0;
+  std::vector<int32_t> sym_;
+  size_t blockStart_ = 0;
+
+  int32_t Temp(size_t depth) const { return locals_ + static_cast<int32_t>(depth); }
+
+  int32_t Const(RegConst c) {
+    out_.consts.push_back(std::move(c));
+    return -static_cast<int32_t>(out_.consts.size());
+  }
+  int32_t IntConst(int64_t v) {
+    auto it = intConsts_.find(v);
+    if (it != intConsts_.end()) return it->second;
+    return intConsts_[v] = Const({ValueType::kInt, v, 0.0, {}});
+  }
+  int32_t DoubleConst(double v) {
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    auto it = doubleConsts_.find(bits);
+    if (it != doubleConsts_.end()) return it->second;
+    return doubleConsts_[bits] = Const({ValueType::kDouble, 0, v, {}});
+  }
+  int32_t StringConst(int32_t index) {
+    auto it = stringConsts_.find(index);
+    if (it != stringConsts_.end()) return it->second;
+    return stringConsts_[index] = Const({ValueType::kString, 0, 0.0, bc_.strings[static_cast<size_t>(index)]});
+  }
+
+  void Emit(RegOpCode op, int32_t a, int32_t b = 0, int32_t c = 0) { out_.code.push_back({op, a, b, c}); }
+  void EmitJump(RegOpCode op, size_t target, int32_t b = 0, int32_t c = 0) {
+    jumps_.emplace_back(out_.code.size(), target);
+    Emit(op, 0, b, c);
+  }
+
+  int32_t Pop() {
+    int32_t v = sym_.back();
+    sym_.pop_back();
+    return v;
+  }
+
+  // puts the entries from `from` up into their own temporaries
+  void Materialize(size_t from) {
+    for (size_t k = from; k < sym_.size(); ++k) {
+      if (sym_[k] != Temp(k)) {
+        Emit(RegOpCode::MOVE, Temp(k), sym_[k]);
+        sym_[k] = Temp(k);
+      }
+    }
+  }
+
+  // before `reg` is written: entries still reading its old value get a copy
+  void Spill(int32_t reg) {
+    for (size_t k = 0; k < sym_.size(); ++k) {
+      if (sym_[k] == reg) {
+        Emit(RegOpCode::MOVE, Temp(k), reg);
+        sym_[k] = Temp(k);
+      }
+    }
+  }
+
+  // the instruction just emitted in the current block, if it computed `reg`
+  RegOp *ProducerOf(int32_t reg) {
+    if (out_.code.size() <= blockStart_) return nullptr;
+    RegOp &last = out_.code.back();
+    return WritesOnlyA(last.op) && last.a == reg ? &last : nullptr;
+  }
+
+  bool Function(size_t begin, size_t end) {
+    const auto &code = bc_.code;
+    std::vector<int32_t> depth;
+    if (!StackDepths(bc_, builtins_, begin, end, kMaxTemps, depth)) return false;
+    if (code[begin].op != OpCode::ENTER) return false;
+
+    // parameters take the first registers, in call order
+    locals_ = code[begin].a;
+    size_t params = EntryArity(bc_, begin);
+    std::vector<int32_t> reg(static_cast<size_t>(locals_), -1);
+    for (size_t k = 0; k < params; ++k) {
+      int32_t slot = code[begin + 1 + k].a;
+      if (slot < 0 || slot >= locals_ || reg[static_cast<size_t>(slot)] >= 0) return false;
+      reg[static_cast<size_t>(slot)] = static_cast<int32_t>(params - 1 - k);
+    }
+    int32_t next = static_cast<int32_t>(params);
+    for (int32_t &r : reg)
+      if (r < 0) r = next++;
+    auto local = [&](int32_t slot) { return slot >= 0 && slot < locals_ ? reg[static_cast<size_t>(slot)] : -1; };
+
+    int32_t maxDepth = 0;
+    std::vector<bool> target(end - begin, false);
+    for (size_t ip = begin; ip < end; ++ip) {
+      if (depth[ip - begin] < 0) continue;
+      maxDepth = std::max(maxDepth, depth[ip - begin]);
+      if (IsJump(code[ip].op)) target[static_cast<size_t>(code[ip].a) - begin] = true;
+    }
+    // one spare register: a builtin without arguments still gets a valid argument pointer
+    int32_t frameSize = locals_ + maxDepth + 1;
+
+    // the arguments arrive in their registers
+    sym_.clear();
+    for (size_t k = 0; k < params; ++k) sym_.push_back(static_cast<int32_t>(k));
+    auto fn = functionOf_.find(begin);
+    if (fn != functionOf_.end())
+      out_.functions[static_cast<size_t>(fn->second)].frameSize = static_cast<uint32_t>(frameSize);
+    pcOf_[begin] = static_cast<int32_t>(out_.code.size());
+    Emit(RegOpCode::ENTER, frameSize);
+    blockStart_ = out_.code.size();
+    bool fallsThrough = true;
+
+    for (size_t ip = begin + 1; ip < end; ++ip) {
+      int32_t d = depth[ip - begin];
+      if (d < 0) {
+        fallsThrough = false;
+        continue;
+      }
+      if (target[ip - begin]) {
+        if (fallsThrough) Materialize(0);
+        sym_.clear();
+        for (int32_t k = 0; k < d; ++k) sym_.push_back(Temp(static_cast<size_t>(k)));
+        blockStart_ = out_.code.size();
+      }
+      pcOf_[ip] = static_cast<int32_t>(out_.code.size());
+      fallsThrough = true;
+
+      const BytecodeOp &ins = code[ip];
+      switch (ins.op) {
+        case OpCode::PUSH_INT: sym_.push_back(IntConst(ins.imm.i)); break;
+        case OpCode::PUSH_DOUBLE: sym_.push_back(DoubleConst(ins.imm.d)); break;
+        case OpCode::PUSH_STRING: sym_.push_back(StringConst(ins.a)); break;
+        case OpCode::LOAD:
+          if (local(ins.a) < 0) return false;
+          sym_.push_back(local(ins.a));
+          break;
+        case OpCode::STORE: {
+          int32_t r = local(ins.a);
+          if (r < 0) return false;
+          int32_t v = Pop();
+          if (v == r) break;
+          Spill(r);
+          if (RegOp *producer = v == Temp(sym_.size()) ? ProducerOf(v) : nullptr) producer->a = r;
+          else Emit(RegOpCode::MOVE, r, v);
+          break;
+        }
+        case OpCode::POP:
+          Pop();
+          break;
+
+#define X(name, n) \
+        case OpCode::name: { \
+          int32_t rhs = n == 2 ? Pop() : 0; \
+          int32_t lhs = Pop(); \
+          Emit(RegOpCode::name, Temp(sym_.size()), lhs, rhs); \
+          sym_.push_back(Temp(sym_.size())); \
+          break; \
+        }
+        PETUKH_REG_OPERATORS(X)
+#undef X
+
+        case OpCode::LOAD_INDEX: {
+          int32_t index = Pop();
+          int32_t arr = ins.a >= 0 ? local(ins.a) : Pop();
+          if (arr == -1 && ins.a >= 0) return false;
+          Emit(RegOpCode::LOAD_INDEX, Temp(sym_.size()), arr, index);
+          sym_.push_back(Temp(sym_.size()));
+          break;
+        }
+        case OpCode::STORE_INDEX: {
+          int32_t r = local(ins.a);
+          if (r < 0) return false;  // the old stack form is not generated any more
+          int32_t index = Pop();
+          int32_t value = Pop();
+          Spill(r);
+          Emit(RegOpCode::STORE_INDEX, r, index, value);
+          break;
+        }
+        case OpCode::LOAD_INDEX_UNSAFE: {
+          int32_t index = Pop();
+          int32_t arr = local(ins.a);
+          if (arr < 0) return false;
+          Emit(RegOpCode::LOAD_INDEX_UNSAFE, Temp(sym_.size()), arr, index);
+          sym_.push_back(Temp(sym_.size()));
+          break;
+        }
+        case OpCode::STORE_INDEX_UNSAFE: {
+          int32_t r = local(ins.a);
+          if (r < 0) return false;
+          int32_t index = Pop();
+          int32_t value = Pop();
+          Spill(r);
+          Emit(RegOpCode::STORE_INDEX_UNSAFE, r, index, value);
+          break;
+        }
+        case OpCode::NEW_ARRAY: {
+          int32_t n = Pop();
+          Emit(RegOpCode::NEW_ARRAY, Temp(sym_.size()), n, ins.a);
+          sym_.push_back(Temp(sym_.size()));
+          break;
+        }
+
+        case OpCode::JMP:
+          Materialize(0);
+          EmitJump(RegOpCode::JMP, static_cast<size_t>(ins.a));
+          fallsThrough = false;
+          break;
+        case OpCode::JZ: {
+          int32_t v = Pop();
+          RegOpCode jump;
+          if (RegOp *cmp = ProducerOf(v); cmp && v == Temp(sym_.size()) && CompareJump(cmp->op, jump)) {
+            // <cmp>; JZ -> JZ_<cmp>; materializing cannot touch the compared operands,
+            // which sit at or above v's depth
+            RegOp compare = *cmp;
+            out_.code.pop_back();
+            Materialize(0);
+            EmitJump(jump, static_cast<size_t>(ins.a), compare.b, compare.c);
+          } else {
+            Materialize(0);
+            EmitJump(RegOpCode::JZ, static_cast<size_t>(ins.a), v);
+          }
+          break;
+        }
+        case OpCode::JZ_EQ_IMM: case OpCode::JZ_NEQ_IMM: case OpCode::JZ_LT_IMM:
+        case OpCode::JZ_GT_IMM: case OpCode::JZ_LE_IMM: case OpCode::JZ_GE_IMM:
+          if (local(ins.imm.pair.x) < 0) return false;
+          Materialize(0);
+          EmitJump(FusedJump(ins.op), static_cast<size_t>(ins.a), local(ins.imm.pair.x), IntConst(ins.imm.pair.y));
+          break;
+        case OpCode::JZ_EQ_LOCAL: case OpCode::JZ_NEQ_LOCAL: case OpCode::JZ_LT_LOCAL:
+        case OpCode::JZ_GT_LOCAL: case OpCode::JZ_LE_LOCAL: case OpCode::JZ_GE_LOCAL:
+          if (local(ins.imm.pair.x) < 0 || local(ins.imm.pair.y) < 0) return false;
+          Materialize(0);
+          EmitJump(FusedJump(ins.op), static_cast<size_t>(ins.a), local(ins.imm.pair.x), local(ins.imm.pair.y));
+          break;
+
+        case OpCode::INC_LOCAL: {
+          int32_t r = local(ins.a);
+          if (r < 0) return false;
+          Spill(r);
+          Emit(RegOpCode::ADD, r, r, IntConst(ins.imm.i));
+          break;
+        }
+        case OpCode::ADD_LOCAL_IMM:
+          if (local(ins.a) < 0) return false;
+          Emit(RegOpCode::ADD, Temp(sym_.size()), local(ins.a), IntConst(ins.imm.i));
+          sym_.push_back(Temp(sym_.size()));
+          break;
+        case OpCode::LOAD_LOAD_ADD:
+          if (local(ins.a) < 0 || local(ins.imm.pair.x) < 0) return false;
+          Emit(RegOpCode::ADD, Temp(sym_.size()), local(ins.a), local(ins.imm.pair.x));
+          sym_.push_back(Temp(sym_.size()));
+          break;
+
+        case OpCode::CALL:
+        case OpCode::TAIL_CALL: {
+          auto fn = functionOf_.find(static_cast<size_t>(ins.a));
+          if (fn == functionOf_.end()) return false;
+          size_t argc = EntryArity(bc_, static_cast<size_t>(ins.a));
+          size_t first = sym_.size() - argc;
+          Materialize(first);
+          sym_.resize(first);
+          if (ins.op == OpCode::CALL) {
+            Emit(RegOpCode::CALL, Temp(first), fn->second, static_cast<int32_t>(argc));
+            sym_.push_back(Temp(first));
+          } else {
+            Emit(RegOpCode::TAIL_CALL, Temp(first), fn->second, static_cast<int32_t>(argc));
+            fallsThrough = false;
+          }
+          break;
+        }
+        case OpCode::CALL_BUILTIN: {
+          const Builtin &b = builtins_.Get(ins.a);
+          size_t first = sym_.size() - b.paramTypes.size();
+          Materialize(first);
+          sym_.resize(first);
+          Emit(RegOpCode::CALL_BUILTIN, Temp(first), ins.a);
+          if (b.returnType != TypeKind::VOID) sym_.push_back(Temp(first));
+          break;
+        }
+        case OpCode::RET:
+          Emit(RegOpCode::RET, 0, Pop());
+          fallsThrough = false;
+          break;
+
+        default:
+          return false;
+      }
+    }
+    return true;
+  }
+};
+
+}  // namespace
+
+RegisterModule RegisterModule::Translate(const BytecodeModule &bytecode, const BuiltinTable &builtins) {
+  RegisterModule module;
+  if (!Translator(bytecode, builtins, module).Run()) return RegisterModule();
+  return module;
+}
+
+void RegisterModule::Print(std::ostream &out) const {
+  std::vector<const RegFunction *> at(code.size(), nullptr);
+  for (const auto &fn : functions)
+    if (fn.entry < code.size()) at[fn.entry] = &fn;
+
+  auto operand = [&](int32_t x) {
+    if (x >= 0) return "r" + std::to_string(x);
+    const RegConst &c = consts[static_cast<size_t>(-1 - x)];
+    switch (c.type) {
+      case ValueType::kInt: return std::to_string(c.i);
+      case ValueType::kDouble: return Value::MakeDouble(c.d).AsString();
+      default: return "\"" + c.str + "\"";
+    }
+  };
+
+  out << "=== REGISTER CODE ===\n\n";
+  for (size_t pc = 0; pc < code.size(); ++pc) {
+    if (at[pc]) out << at[pc]->name << ":\n";
+    const RegOp &ins = code[pc];
+    out << pc << ": " << RegOpCodeName(ins.op);
+    switch (ins.op) {
+      case RegOpCode::MOVE: case RegOpCode::NEG: case RegOpCode::NOT: case RegOpCode::NEG_I64:
+      case RegOpCode::NEG_F64:
+        out << " r" << ins.a << " " << operand(ins.b);
+        break;
+      case RegOpCode::NEW_ARRAY:
+        out << " r" << ins.a << " " << operand(ins.b) << " " << ElemKindName(static_cast<ElemKind>(ins.c));
+        break;
+      case RegOpCode::JMP: case RegOpCode::ENTER:
+        out << " " << ins.a;
+        break;
+      case RegOpCode::JZ:
+        out << " " << ins.a << " " << operand(ins.b);
+        break;
+      case RegOpCode::JZ_EQ: case RegOpCode::JZ_NEQ: case RegOpCode::JZ_LT:
+      case RegOpCode::JZ_GT: case RegOpCode::JZ_LE: case RegOpCode::JZ_GE:
+        out << " " << ins.a << " " << operand(ins.b) << " " << operand(ins.c);
+        break;
+      case RegOpCode::CALL: case RegOpCode::TAIL_CALL:
+        out << " r" << ins.a << " " << functions[static_cast<size_t>(ins.b)].name << " " << ins.c;
+        break;
+      case RegOpCode::CALL_BUILTIN:
+        out << " r" << ins.a << " #" << ins.b;
+        break;
+      case RegOpCode::RET:
+        out << " " << operand(ins.b);
+        break;
+      default:
+        out << " r" << ins.a << " " << operand(ins.b) << " " << operand(ins.c);
+        break;
+    }
+    out << "\n";
+  }
+}
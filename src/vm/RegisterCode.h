@@ -0,0 +1,89 @@
+#ifndef PETUKH_REGISTER_CODE_H
+#define PETUKH_REGISTER_CODE_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "Builtins.h"
+#include "Bytecode.h"
+#include "Value.h"
+
+// Three-address form of a BytecodeModule, run by VM::Run with
+// Backend::kRegister. Each function's frame is a window of registers on the
+// VM's register file: its locals first (parameters in call order), then one
+// temporary per operand stack depth. `a = b + c` is a single ADD reading
+// both locals and writing the third, where the stack code needs four
+// instructions.
+//
+// Operands (`b`, `c` unless noted) are registers when >= 0 and constants
+// (RegisterModule::consts[-1 - x]) when negative.
+enum class RegOpCode : uint8_t {
+  MOVE,          // a = b
+  // a = b <op> c / a = <op> b, with the semantics of the stack opcodes of the same name
+  ADD, SUB, MUL, DIV, MOD,
+  EQ, NEQ, LT, GT, LE, GE,
+  NEG, NOT,
+  ADD_I64, SUB_I64, MUL_I64, DIV_I64, MOD_I64, NEG_I64,
+  EQ_I64, NEQ_I64, LT_I64, GT_I64, LE_I64, GE_I64,
+  ADD_F64, SUB_F64, MUL_F64, DIV_F64, NEG_F64,
+  LT_F64, GT_F64, LE_F64, GE_F64,
+  LOAD_INDEX,    // a = b[c]
+  STORE_INDEX,   // register a [b] = c
+  // the same without bounds checks, for proven subscripts (see OpCode::LOAD_INDEX_UNSAFE)
+  LOAD_INDEX_UNSAFE,
+  STORE_INDEX_UNSAFE,
+  NEW_ARRAY,     // a = array of b zeros, its ElemKind in c
+  JMP,           // to a
+  JZ,            // to a if b is zero
+  // to a unless b <cmp> c holds
+  JZ_EQ, JZ_NEQ, JZ_LT, JZ_GT, JZ_LE, JZ_GE,
+  CALL,          // a = functions[b](c arguments from register a on)
+  TAIL_CALL,     // return functions[b](c arguments from register a on)
+  CALL_BUILTIN,  // a = builtin b(arguments from register a on)
+  RET,           // return b
+  ENTER,         // frame of a registers, all int 0
+};
+
+inline constexpr size_t kRegOpCodeCount = static_cast<size_t>(RegOpCode::ENTER) + 1;
+
+const char *RegOpCodeName(RegOpCode op);
+
+struct RegOp {
+  RegOpCode op = RegOpCode::MOVE;
+  int32_t a = 0;
+  int32_t b = 0;
+  int32_t c = 0;
+};
+
+static_assert(sizeof(RegOp) == 16, "RegOp must stay 16 bytes");
+
+struct RegFunction {
+  std::string name;
+  uint32_t entry = 0;      // its ENTER; calls start right after it
+  uint32_t frameSize = 0;  // registers, parameters first
+};
+
+// a constant operand, made into a Value by each VM
+struct RegConst {
+  ValueType type = ValueType::kInt;
+  int64_t i = 0;
+  double d = 0.0;
+  std::string str;
+};
+
+struct RegisterModule {
+  std::vector<RegOp> code;  // empty if the bytecode could not be translated
+  std::vector<RegConst> consts;
+  std::vector<RegFunction> functions;  // CALL / TAIL_CALL targets, by index
+  size_t entry = 0;
+
+  // Translates linked bytecode; returns an empty module for stack shapes it
+  // does not handle, which then run on the stack VM.
+  static RegisterModule Translate(const BytecodeModule &bytecode, const BuiltinTable &builtins);
+
+  // one instruction per line, for res_registers.txt
+  void Print(std::ostream &out) const;
+};
+
+#endif  // PETUKH_REGISTER_CODE_H
@@ -0,0 +1,258 @@
+// VM::Run for Backend::kRegister: the interpreter of RegisterModule code.
+// Frames are the same windows on locals_ as in the stack VM, only wider (they
+// also hold the temporaries), and stack_ is not used at all.
+#include "VM.h"
+#include <stdexcept>
+#include <utility>
+
+#if PETUKH_COMPUTED_GOTO
+#define VM_CASE(name) L_##name:
+#define VM_NEXT() do { if (ip >= size) goto halt; goto *threaded[ip]; } while (0)
+#else
+#define VM_CASE(name) case RegOpCode::name:
+#define VM_NEXT() continue
+#endif
+
+// register or constant operand
+#define VM_IN(x) ((x) >= 0 ? regs[x] : consts[-1 - (x)])
+
+int VM::RunRegisters() {
+  const RegisterModule &program = *registers_;
+  const RegOp *code = program.code.data();
+  const size_t size = program.code.size();
+  const Value *consts = reg_consts_.data();
+  size_t ip = program.entry;
+  // the current frame's registers (Run has pushed the bottom frame, the
+  // entry point's ENTER sizes it); re-read whenever locals_ is resized
+  Value *regs = locals_.data();
+
+#if PETUKH_COMPUTED_GOTO
+  // handler addresses in RegOpCode order
+  static const void *const kHandlers[] = {
+    &&L_MOVE,
+    &&L_ADD, &&L_SUB, &&L_MUL, &&L_DIV, &&L_MOD,
+    &&L_EQ, &&L_NEQ, &&L_LT, &&L_GT, &&L_LE, &&L_GE,
+    &&L_NEG, &&L_NOT,
+    &&L_ADD_I64, &&L_SUB_I64, &&L_MUL_I64, &&L_DIV_I64, &&L_MOD_I64, &&L_NEG_I64,
+    &&L_EQ_I64, &&L_NEQ_I64, &&L_LT_I64, &&L_GT_I64, &&L_LE_I64, &&L_GE_I64,
+    &&L_ADD_F64, &&L_SUB_F64, &&L_MUL_F64, &&L_DIV_F64, &&L_NEG_F64,
+    &&L_LT_F64, &&L_GT_F64, &&L_LE_F64, &&L_GE_F64,
+    &&L_LOAD_INDEX, &&L_STORE_INDEX, &&L_LOAD_INDEX_UNSAFE, &&L_STORE_INDEX_UNSAFE, &&L_NEW_ARRAY,
+    &&L_JMP, &&L_JZ,
+    &&L_JZ_EQ, &&L_JZ_NEQ, &&L_JZ_LT, &&L_JZ_GT, &&L_JZ_LE, &&L_JZ_GE,
+    &&L_CALL, &&L_TAIL_CALL, &&L_CALL_BUILTIN, &&L_RET, &&L_ENTER,
+  };
+  static_assert(sizeof(kHandlers) / sizeof(kHandlers[0]) == kRegOpCodeCount,
+                "handler table out of sync with RegOpCode");
+
+  if (reg_threaded_.size() != size) {
+    reg_threaded_.resize(size);
+    for (size_t i = 0; i < size; ++i)
+      reg_threaded_[i] = kHandlers[static_cast<size_t>(code[i].op)];
+  }
+  const void *const *threaded = reg_threaded_.data();
+  VM_NEXT();
+  {
+#else
+  while (ip < size) {
+    switch (code[ip].op) {
+#endif
+      VM_CASE(MOVE) regs[code[ip].a] = VM_IN(code[ip].b); ip++; VM_NEXT();
+
+#define VM_BINARY(name, fn) \
+      VM_CASE(name) { \
+        const RegOp &ins = code[ip]; \
+        regs[ins.a] = fn(VM_IN(ins.b), VM_IN(ins.c)); \
+        ip++; \
+        VM_NEXT(); \
+      }
+#define VM_UNARY(name, fn) \
+      VM_CASE(name) regs[code[ip].a] = fn(VM_IN(code[ip].b)); ip++; VM_NEXT();
+
+      VM_BINARY(ADD, OpAdd)
+      VM_BINARY(SUB, OpSub)
+      VM_BINARY(MUL, OpMul)
+      VM_BINARY(DIV, OpDiv)
+      VM_BINARY(MOD, OpMod)
+      VM_BINARY(EQ, OpEq)
+      VM_BINARY(NEQ, OpNeq)
+      VM_BINARY(LT, OpLt)
+      VM_BINARY(GT, OpGt)
+      VM_BINARY(LE, OpLe)
+      VM_BINARY(GE, OpGe)
+      VM_UNARY(NEG, OpNeg)
+      VM_UNARY(NOT, OpNot)
+
+      VM_BINARY(ADD_I64, OpAddI64)
+      VM_BINARY(SUB_I64, OpSubI64)
+      VM_BINARY(MUL_I64, OpMulI64)
+      VM_BINARY(DIV_I64, OpDivI64)
+      VM_BINARY(MOD_I64, OpModI64)
+      VM_UNARY(NEG_I64, OpNegI64)
+      VM_BINARY(EQ_I64, OpEqI64)
+      VM_BINARY(NEQ_I64, OpNeqI64)
+      VM_BINARY(LT_I64, OpLtI64)
+      VM_BINARY(GT_I64, OpGtI64)
+      VM_BINARY(LE_I64, OpLeI64)
+      VM_BINARY(GE_I64, OpGeI64)
+
+      VM_BINARY(ADD_F64, OpAddF64)
+      VM_BINARY(SUB_F64, OpSubF64)
+      VM_BINARY(MUL_F64, OpMulF64)
+      VM_BINARY(DIV_F64, OpDivF64)
+      VM_UNARY(NEG_F64, OpNegF64)
+      VM_BINARY(LT_F64, OpLtF64)
+      VM_BINARY(GT_F64, OpGtF64)
+      VM_BINARY(LE_F64, OpLeF64)
+      VM_BINARY(GE_F64, OpGeF64)
+
+#undef VM_BINARY
+#undef VM_UNARY
+
+      VM_CASE(LOAD_INDEX) {
+        const RegOp &ins = code[ip];
+        regs[ins.a] = ElementOf(VM_IN(ins.b), VM_IN(ins.c).AsInt());
+        ip++;
+        VM_NEXT();
+      }
+
+      VM_CASE(STORE_INDEX) {
+        const RegOp &ins = code[ip];
+        StoreElement(regs[ins.a], VM_IN(ins.b).AsInt(), VM_IN(ins.c));
+        ip++;
+        VM_NEXT();
+      }
+
+      VM_CASE(LOAD_INDEX_UNSAFE) {
+        const RegOp &ins = code[ip];
+        regs[ins.a] = regs[ins.b].Array().Get(static_cast<size_t>(VM_IN(ins.c).i));
+        ip++;
+        VM_NEXT();
+      }
+
+      VM_CASE(STORE_INDEX_UNSAFE) {
+        const RegOp &ins = code[ip];
+        regs[ins.a].MutableArray().Set(static_cast<size_t>(VM_IN(ins.b).i), VM_IN(ins.c));
+        ip++;
+        VM_NEXT();
+      }
+
+      VM_CASE(NEW_ARRAY) {
+        int64_t n = VM_IN(code[ip].b).AsInt();
+        regs[code[ip].a] = Value::MakeArray(static_cast<size_t>(n < 0 ? 0 : n), static_cast<ElemKind>(code[ip].c));
+        ip++;
+        VM_NEXT();
+      }
+
+      VM_CASE(JMP) ip = static_cast<size_t>(code[ip].a); VM_NEXT();
+
+      VM_CASE(JZ) ip = VM_IN(code[ip].b).IsZero() ? static_cast<size_t>(code[ip].a) : ip + 1; VM_NEXT();
+
+// Falls through when the comparison holds, jumps to the target otherwise.
+#define VM_JZ_CMP(name, CMP, generic) \
+      VM_CASE(name) { \
+        const RegOp &ins = code[ip]; \
+        const Value &x = VM_IN(ins.b); \
+        const Value &y = VM_IN(ins.c); \
+        bool holds = x.type == ValueType::kInt && y.type == ValueType::kInt ? x.i CMP y.i \
+                                                                            : !generic(x, y).IsZero(); \
+        ip = holds ? ip + 1 : static_cast<size_t>(ins.a); \
+        VM_NEXT(); \
+      }
+
+      VM_JZ_CMP(JZ_EQ, ==, OpEq)
+      VM_JZ_CMP(JZ_NEQ, !=, OpNeq)
+      VM_JZ_CMP(JZ_LT, <, OpLt)
+      VM_JZ_CMP(JZ_GT, >, OpGt)
+      VM_JZ_CMP(JZ_LE, <=, OpLe)
+      VM_JZ_CMP(JZ_GE, >=, OpGe)
+
+#undef VM_JZ_CMP
+
+      VM_CASE(CALL) {
+        // the callee's frame goes on top of ours, its parameters moved in from our temporaries
+        const RegOp &ins = code[ip];
+        const RegFunction &fn = program.functions[static_cast<size_t>(ins.b)];
+        size_t callerBase = call_stack_.back().base;
+        Frame frame;
+        frame.ret_ip = ip + 1;
+        frame.base = locals_.size();
+        locals_.resize(frame.base + fn.frameSize, Value::MakeInt(0));
+        Value *args = locals_.data() + callerBase + ins.a;
+        regs = locals_.data() + frame.base;
+        for (int32_t k = 0; k < ins.c; ++k) regs[k] = std::move(args[k]);
+        call_stack_.push_back(frame);
+        NoteCall();
+        ip = fn.entry + 1;
+        VM_NEXT();
+      }
+
+      VM_CASE(TAIL_CALL) {
+        // the arguments sit above their destinations, so moving them up front is safe
+        const RegOp &ins = code[ip];
+        const RegFunction &fn = program.functions[static_cast<size_t>(ins.b)];
+        size_t base = call_stack_.back().base;
+        for (int32_t k = 0; k < ins.c; ++k) regs[k] = std::move(regs[ins.a + k]);
+        locals_.resize(base + static_cast<size_t>(ins.c));
+        locals_.resize(base + fn.frameSize, Value::MakeInt(0));
+        regs = locals_.data() + base;
+        ip = fn.entry + 1;
+        VM_NEXT();
+      }
+
+      VM_CASE(CALL_BUILTIN) {
+        // arguments are read in place, the result replaces the first one
+        const RegOp &ins = code[ip];
+        const Builtin &b = builtins_.Get(ins.b);
+        Value result = b.fn(*this, regs + ins.a);
+        if (b.returnType != TypeKind::VOID) regs[ins.a] = std::move(result);
+        ip++;
+        VM_NEXT();
+      }
+
+      VM_CASE(RET) {
+        Value result = VM_IN(code[ip].b);
+        if (call_stack_.size() <= 1) {
+          call_stack_.clear();
+          locals_.clear();
+          out_.Flush();
+          return static_cast<int>(result.AsInt());
+        }
+        Frame fr = call_stack_.back();
+        call_stack_.pop_back();
+        locals_.resize(fr.base);
+        regs = locals_.data() + call_stack_.back().base;
+        // the CALL being returned from names the register for the result
+        regs[code[fr.ret_ip - 1].a] = std::move(result);
+        ip = fr.ret_ip;
+        VM_NEXT();
+      }
+
+      VM_CASE(ENTER) {
+        // only the entry point's; calls set up their frames themselves
+        size_t base = call_stack_.back().base;
+        locals_.resize(base);
+        locals_.resize(base + static_cast<size_t>(code[ip].a), Value::MakeInt(0));
+        regs = locals_.data() + base;
+        NoteCall();
+        ip++;
+        VM_NEXT();
+      }
+
+#if PETUKH_COMPUTED_GOTO
+  }
+halt:
+#else
+      default:
+        throw std::runtime_error("unhandled opcode");
+    }
+  }
+#endif
+
+  out_.Flush();
+  return 0;
+}
+
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_IN
@@ -0,0 +1,130 @@
+#include "StackDepth.h"
+
+#include <algorithm>
+
+std::vector<size_t> FunctionStarts(const BytecodeModule &code) {
+  std::vector<size_t> starts{0};
+  for (const auto &fn : code.functions) starts.push_back(fn.entry);
+  std::sort(starts.begin(), starts.end());
+  starts.erase(std::unique(starts.begin(), starts.end()), starts.end());
+  return starts;
+}
+
+size_t EntryArity(const BytecodeModule &code, size_t entry) {
+  // the prologue stores the arguments, last one first, before anything else
+  size_t n = 0;
+  for (size_t ip = entry + 1; ip < code.code.size() && code.code[ip].op == OpCode::STORE; ++ip) n++;
+  return n;
+}
+
+bool StackDepths(const BytecodeModule &code, const BuiltinTable &builtins, size_t begin, size_t end,
+                 size_t maxDepth, std::vector<int32_t> &depth) {
+  const auto &ops = code.code;
+  depth.assign(end - begin, -1);
+  std::vector<size_t> work;
+  auto reach = [&](size_t ip, int64_t d) {
+    if (ip < begin || ip >= end || d < 0 || d > static_cast<int64_t>(maxDepth)) return false;
+    int32_t &slot = depth[ip - begin];
+    if (slot == -1) {
+      slot = static_cast<int32_t>(d);
+      work.push_back(ip);
+      return true;
+    }
+    return slot == d;
+  };
+
+  size_t first = begin;
+  size_t params = 0;
+  if (begin < end && ops[begin].op == OpCode::ENTER) {
+    first = begin + 1;
+    params = EntryArity(code, begin);
+  }
+  if (!reach(first, static_cast<int64_t>(params))) return false;
+
+  while (!work.empty()) {
+    size_t ip = work.back();
+    work.pop_back();
+    const BytecodeOp &ins = ops[ip];
+    int64_t d = depth[ip - begin];
+    // operands taken and results left; where control goes is handled below
+    int64_t pops = 0, pushes = 0;
+    switch (ins.op) {
+      case OpCode::PUSH_INT: case OpCode::PUSH_DOUBLE: case OpCode::PUSH_STRING: case OpCode::LOAD:
+      case OpCode::ADD_LOCAL_IMM: case OpCode::LOAD_LOAD_ADD:
+        pushes = 1;
+        break;
+      case OpCode::STORE: case OpCode::POP: case OpCode::JZ:
+        pops = 1;
+        break;
+      case OpCode::STORE_INDEX_UNSAFE:
+        pops = 2;
+        break;
+      case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV: case OpCode::MOD:
+      case OpCode::EQ: case OpCode::NEQ: case OpCode::LT: case OpCode::GT: case OpCode::LE: case OpCode::GE:
+      case OpCode::ADD_I64: case OpCode::SUB_I64: case OpCode::MUL_I64: case OpCode::DIV_I64: case OpCode::MOD_I64:
+      case OpCode::EQ_I64: case OpCode::NEQ_I64: case OpCode::LT_I64: case OpCode::GT_I64: case OpCode::LE_I64:
+      case OpCode::GE_I64:
+      case OpCode::ADD_F64: case OpCode::SUB_F64: case OpCode::MUL_F64: case OpCode::DIV_F64:
+      case OpCode::LT_F64: case OpCode::GT_F64: case OpCode::LE_F64: case OpCode::GE_F64:
+        pops = 2, pushes = 1;
+        break;
+      case OpCode::NEG: case OpCode::NOT: case OpCode::NEG_I64: case OpCode::NEG_F64:
+      case OpCode::NEW_ARRAY: case OpCode::LOAD_INDEX_UNSAFE:
+        pops = 1, pushes = 1;
+        break;
+      case OpCode::LOAD_INDEX:
+        // index (and the array, in the stack form)
+        pops = ins.a >= 0 ? 1 : 2, pushes = 1;
+        break;
+      case OpCode::STORE_INDEX:
+        // value and index; the stack form also takes the array and leaves its update
+        pops = ins.a >= 0 ? 2 : 3, pushes = ins.a >= 0 ? 0 : 1;
+        break;
+      case OpCode::CALL:
+        pops = static_cast<int64_t>(EntryArity(code, static_cast<size_t>(ins.a))), pushes = 1;
+        break;
+      case OpCode::CALL_BUILTIN: {
+        const Builtin &b = builtins.Get(ins.a);
+        pops = static_cast<int64_t>(b.paramTypes.size()), pushes = b.returnType != TypeKind::VOID;
+        break;
+      }
+      case OpCode::TAIL_CALL:
+        pops = static_cast<int64_t>(EntryArity(code, static_cast<size_t>(ins.a)));
+        break;
+      case OpCode::RET:
+        pops = 1;
+        break;
+      case OpCode::JMP: case OpCode::INC_LOCAL:
+      case OpCode::JZ_EQ_IMM: case OpCode::JZ_NEQ_IMM: case OpCode::JZ_LT_IMM:
+      case OpCode::JZ_GT_IMM: case OpCode::JZ_LE_IMM: case OpCode::JZ_GE_IMM:
+      case OpCode::JZ_EQ_LOCAL: case OpCode::JZ_NEQ_LOCAL: case OpCode::JZ_LT_LOCAL:
+      case OpCode::JZ_GT_LOCAL: case OpCode::JZ_LE_LOCAL: case OpCode::JZ_GE_LOCAL:
+        break;
+      default:
+        return false;  // LABEL, or an ENTER inside the function
+    }
+    if (d < pops) return false;
+    int64_t next = d - pops + pushes;
+
+    bool ok = true;
+    switch (ins.op) {
+      case OpCode::RET: case OpCode::TAIL_CALL:
+        break;
+      case OpCode::JMP:
+        ok = reach(static_cast<size_t>(ins.a), next);
+        break;
+      case OpCode::JZ:
+      case OpCode::JZ_EQ_IMM: case OpCode::JZ_NEQ_IMM: case OpCode::JZ_LT_IMM:
+      case OpCode::JZ_GT_IMM: case OpCode::JZ_LE_IMM: case OpCode::JZ_GE_IMM:
+      case OpCode::JZ_EQ_LOCAL: case OpCode::JZ_NEQ_LOCAL: case OpCode::JZ_LT_LOCAL:
+      case OpCode::JZ_GT_LOCAL: case OpCode::JZ_LE_LOCAL: case OpCode::JZ_GE_LOCAL:
+        ok = reach(static_cast<size_t>(ins.a), next) && reach(ip + 1, next);
+        break;
+      default:
+        ok = reach(ip + 1, next);
+        break;
+    }
+    if (!ok) return false;
+  }
+  return true;
+}
@@ -0,0 +1,30 @@
+#ifndef PETUKH_STACK_DEPTH_H
+#define PETUKH_STACK_DEPTH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Builtins.h"
+#include "Bytecode.h"
+
+// Static operand stack shape of linked bytecode, for the backends that
+// replace the stack with something fixed at compile time (Jit, the register
+// translator).
+
+// Where the top-level code and each function begin, ascending; a function
+// runs up to the next start.
+std::vector<size_t> FunctionStarts(const BytecodeModule &code);
+
+// Operands a CALL of the function at `entry` leaves for it: the STOREs
+// right after its ENTER.
+size_t EntryArity(const BytecodeModule &code, size_t entry);
+
+// Operand stack depth before each instruction of the function [begin, end)
+// (depth[ip - begin]), relative to the function's own frame; -1 where
+// control never gets. The body starts with its arguments on the stack.
+// Returns false when the stack does not add up: a jump out of the function,
+// two depths for one instruction, underflow or more than `maxDepth` operands.
+bool StackDepths(const BytecodeModule &code, const BuiltinTable &builtins, size_t begin, size_t end,
+                 size_t maxDepth, std::vector<int32_t> &depth);
+
+#endif  // PETUKH_STACK_DEPTH_H
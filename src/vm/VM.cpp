@@ -1,113 +1,266 @@
 #include "VM.h"
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <ctime>
+
+
+
+VM::VM(std::shared_ptr<const CompiledModule> module, Backend backend)
+    : module_(std::move(module)), builtins_(module_->Builtins()), program_(module_->Bytecode())
+#if PETUKH_JIT
+      , jit_(program_, builtins_)
+#endif
+{
+  // materialise pooled strings once; PUSH_STRING then only bumps a refcount.
+  // Refcounts are not atomic, so these stay private to the VM.
+  for (const auto &str : program_.strings)
+    string_consts_.push_back(Value::MakeString(str));
+  if (backend == Backend::kRegister && !module_->Registers().code.empty()) {
+    registers_ = &module_->Registers();
+    for (const RegConst &c : registers_->consts) {
+      if (c.type == ValueType::kInt) reg_consts_.push_back(Value::MakeInt(c.i));
+      else if (c.type == ValueType::kDouble) reg_consts_.push_back(Value::MakeDouble(c.d));
+      else reg_consts_.push_back(Value::MakeString(c.str));
+    }
+  }
 
+  in_.Tie(&out_);
+  // RET only shrinks these, so after the first deep recursion calls reuse
+  // the storage; reserving up front keeps ordinary depths from reallocating at all
+  call_stack_.reserve(kFramePoolSize);
+  locals_.reserve(kFramePoolSize * 4);
+  stack_.reserve(kFramePoolSize);
+#if PETUKH_JIT
+  jitStack_.resize(Jit::kMaxDepth);
+#endif
+}
 
+VM::VM(const std::vector<Instruction> &code, const BuiltinTable &builtins)
+    : VM(CompiledModule::Link(code, builtins)) {}
 
-VM::VM(const std::vector<Instruction> &code) : code_(code) {
-  BuildLabelMap();
+// Per-thread CPU clock, so VMs running side by side each see only their own time.
+static double ThreadCpuSeconds() {
+  timespec ts{};
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
 }
 
-void VM::BuildLabelMap() {
-  label_map_.clear();
-  for (size_t i = 0; i < code_.size(); ++i) {
-    if (code_[i].op == OpCode::LABEL) {
-      // map label name -> instruction index of the LABEL (execution will skip it)
-      label_map_[code_[i].arg] = i;
-    }
-  }
+double VM::CpuTime() const { return ThreadCpuSeconds() - runStartCpu_; }
+
+void VM::SetIO(int inFd, int outFd) {
+  out_.Reset(outFd);
+  in_.Reset(inFd);
 }
 
-int VM::Run() {
-  // find "main" label and start there if present
-  size_t ip = 0;
-  if (label_map_.count("main")) {
-    ip = label_map_["main"];
-    // push a bottom frame with ret_ip == end (terminates on RET when popped)
-    Frame f; f.ret_ip = code_.size(); call_stack_.push_back(std::move(f));
-    // set ip to the label so execution begins at label (LABEL will be skipped)
+// Computed-goto dispatch (PETUKH_COMPUTED_GOTO) pre-decodes every instruction
+// into the address of its handler and jumps straight from one handler to the
+// next. The portable build runs the very same handler bodies from a switch.
+// PETUKH_PROFILE adds one Profiler hook per dispatched instruction; without it
+// the hooks expand to nothing.
+#if PETUKH_PROFILE
+#define VM_PROFILE_STEP() profiler_.Step(ip, code[ip].op)
+#define VM_PROFILE_END() profiler_.End()
+#else
+#define VM_PROFILE_STEP() ((void)0)
+#define VM_PROFILE_END() ((void)0)
+#endif
+
+// PETUKH_JIT tiers up at function entries and loop headers (see Jit).
+#if PETUKH_JIT
+#define VM_JIT_ENTER() EnterNative(ip)
+#else
+#define VM_JIT_ENTER() ((void)0)
+#endif
+
+#if PETUKH_JIT
+void VM::EnterNative(size_t &ip) {
+  Jit::Entry *entry = jit_.Lookup(ip);
+  if (!entry) return;
+  // the operands it starts with must be ints, as native code keeps them
+  size_t depth = entry->depth;
+  if (stack_.size() < depth) return;
+  const Value *args = stack_.data() + (stack_.size() - depth);
+  for (size_t k = 0; k < depth; ++k) {
+    if (args[k].type != ValueType::kInt) return;
+    jitStack_[k] = args[k].i;
   }
+  stack_.resize(stack_.size() - depth);
 
-  while (ip < code_.size()) {
-    const Instruction &ins = code_[ip];
+  Jit::Exit exit = entry->code(locals_.data() + call_stack_.back().base, jitStack_.data());
+  for (size_t k = 0; k < exit.depth; ++k) Push(Value::MakeInt(jitStack_[k]));
+  if (exit.ip == ip && exit.depth == depth) jit_.Stalled(*entry);
+  ip = static_cast<size_t>(exit.ip);
+}
+#endif
 
-    switch (ins.op) {
-      case OpCode::POP:
-        Pop();
-        ip++;
-        break;
-
-      case OpCode::PUSH_INT: HandlePushInt(ins.arg); ip++; break;
-      case OpCode::PUSH_DOUBLE: HandlePushDouble(ins.arg); ip++; break;
-      case OpCode::PUSH_STRING: HandlePushString(ins.arg); ip++; break;
-
-      case OpCode::LOAD: HandleLoad(ins.arg); ip++; break;
-      case OpCode::STORE: HandleStore(ins.arg); ip++; break;
-
-      case OpCode::NEW_ARRAY: HandleNewArray(); ip++; break;
-      case OpCode::LOAD_INDEX: HandleLoadIndex(); ip++; break;
-      case OpCode::STORE_INDEX: HandleStoreIndex(ins.arg); ip++; break;
-
-      case OpCode::ADD:
-      case OpCode::SUB:
-      case OpCode::MUL:
-      case OpCode::DIV:
-      case OpCode::MOD:
-      case OpCode::EQ:
-      case OpCode::NEQ:
-      case OpCode::LT:
-      case OpCode::GT:
-      case OpCode::LE:
-      case OpCode::GE:
-        HandleBinaryOp(ins.op);
-        ip++;
-        break;
+#if PETUKH_COMPUTED_GOTO
+#define VM_CASE(name) L_##name:
+#define VM_NEXT() do { if (ip >= size) goto halt; VM_PROFILE_STEP(); goto *threaded[ip]; } while (0)
+#else
+#define VM_CASE(name) case OpCode::name:
+#define VM_NEXT() continue
+#endif
 
-      case OpCode::NEG:
-      case OpCode::NOT:
-        HandleUnaryOp(ins.op);
-        ip++;
-        break;
+int VM::Run() {
+  runStartCpu_ = ThreadCpuSeconds();
+  // leftovers of an earlier run (or one that threw) are dropped
+  stack_.clear();
+  locals_.clear();
+  call_stack_.clear();
+  BeginMemory();
+  // the run's peaks are kept and the outer heap limit put back however it ends
+  struct MemoryGuard {
+    VM &vm;
+    ~MemoryGuard() { vm.EndMemory(); }
+  } guard{*this};
+  // push a bottom frame with ret_ip == end (terminates on RET when popped);
+  // its ENTER sizes it, either main's prologue or the top-level one
+  Frame f; f.ret_ip = registers_ ? registers_->code.size() : program_.code.size(); call_stack_.push_back(f);
+  // whatever the host printed through iostreams goes out before the program's output
+  std::cout.flush();
+  return registers_ ? RunRegisters() : RunStack();
+}
 
-      case OpCode::JMP: {
-        auto it = label_map_.find(ins.arg);
-        if (it == label_map_.end()) throw std::runtime_error("unknown label for JMP: " + ins.arg);
-        ip = it->second;
-        break;
+int VM::RunStack() {
+  const BytecodeOp *code = program_.code.data();
+  const size_t size = program_.code.size();
+  size_t ip = program_.entry;
+#if PETUKH_PROFILE
+  profiler_.Begin(program_);
+#endif
+
+#if PETUKH_COMPUTED_GOTO
+  // handler addresses in OpCode order
+  static const void *const kHandlers[] = {
+    &&L_PUSH_INT, &&L_PUSH_DOUBLE, &&L_PUSH_STRING,
+    &&L_LOAD, &&L_STORE,
+    &&L_LOAD_INDEX, &&L_STORE_INDEX, &&L_NEW_ARRAY,
+    &&L_LOAD_INDEX_UNSAFE, &&L_STORE_INDEX_UNSAFE,
+    &&L_ADD, &&L_SUB, &&L_MUL, &&L_DIV, &&L_MOD, &&L_NEG,
+    &&L_EQ, &&L_NEQ, &&L_LT, &&L_GT, &&L_LE, &&L_GE,
+    &&L_NOT,
+    &&L_ADD_I64, &&L_SUB_I64, &&L_MUL_I64, &&L_DIV_I64, &&L_MOD_I64, &&L_NEG_I64,
+    &&L_EQ_I64, &&L_NEQ_I64, &&L_LT_I64, &&L_GT_I64, &&L_LE_I64, &&L_GE_I64,
+    &&L_ADD_F64, &&L_SUB_F64, &&L_MUL_F64, &&L_DIV_F64, &&L_NEG_F64,
+    &&L_LT_F64, &&L_GT_F64, &&L_LE_F64, &&L_GE_F64,
+    &&L_JMP, &&L_JZ,
+    &&L_CALL, &&L_RET, &&L_TAIL_CALL, &&L_CALL_BUILTIN,
+    &&L_POP,
+    &&L_LABEL,
+    &&L_ENTER,
+    &&L_INC_LOCAL, &&L_ADD_LOCAL_IMM, &&L_LOAD_LOAD_ADD,
+    &&L_JZ_EQ_IMM, &&L_JZ_NEQ_IMM, &&L_JZ_LT_IMM, &&L_JZ_GT_IMM, &&L_JZ_LE_IMM, &&L_JZ_GE_IMM,
+    &&L_JZ_EQ_LOCAL, &&L_JZ_NEQ_LOCAL, &&L_JZ_LT_LOCAL, &&L_JZ_GT_LOCAL, &&L_JZ_LE_LOCAL, &&L_JZ_GE_LOCAL,
+  };
+  static_assert(sizeof(kHandlers) / sizeof(kHandlers[0]) == kOpCodeCount, "handler table out of sync with OpCode");
+
+  if (threaded_.size() != size) {
+    threaded_.resize(size);
+    for (size_t i = 0; i < size; ++i)
+      threaded_[i] = kHandlers[static_cast<size_t>(code[i].op)];
+  }
+  const void *const *threaded = threaded_.data();
+  VM_NEXT();
+  {
+#else
+  while (ip < size) {
+    VM_PROFILE_STEP();
+    switch (code[ip].op) {
+#endif
+      VM_CASE(POP)
+        Pop();
+        ip++;
+        VM_NEXT();
+
+      VM_CASE(PUSH_INT) HandlePushInt(code[ip].imm.i); ip++; VM_NEXT();
+      VM_CASE(PUSH_DOUBLE) HandlePushDouble(code[ip].imm.d); ip++; VM_NEXT();
+      VM_CASE(PUSH_STRING) HandlePushString(code[ip].a); ip++; VM_NEXT();
+
+      VM_CASE(ENTER) HandleEnter(code[ip].a); NoteCall(); ip++; VM_JIT_ENTER(); VM_NEXT();
+      VM_CASE(LOAD) HandleLoad(code[ip].a); ip++; VM_NEXT();
+      VM_CASE(STORE) HandleStore(code[ip].a); ip++; VM_NEXT();
+
+      VM_CASE(NEW_ARRAY) HandleNewArray(code[ip].a); ip++; VM_NEXT();
+      VM_CASE(LOAD_INDEX) HandleLoadIndex(code[ip].a); ip++; VM_NEXT();
+      VM_CASE(STORE_INDEX) HandleStoreIndex(code[ip].a); ip++; VM_NEXT();
+      VM_CASE(LOAD_INDEX_UNSAFE) HandleLoadIndexUnsafe(code[ip].a); ip++; VM_NEXT();
+      VM_CASE(STORE_INDEX_UNSAFE) HandleStoreIndexUnsafe(code[ip].a); ip++; VM_NEXT();
+
+      VM_CASE(ADD) ApplyBinary(OpAdd); ip++; VM_NEXT();
+      VM_CASE(SUB) ApplyBinary(OpSub); ip++; VM_NEXT();
+      VM_CASE(MUL) ApplyBinary(OpMul); ip++; VM_NEXT();
+      VM_CASE(DIV) ApplyBinary(OpDiv); ip++; VM_NEXT();
+      VM_CASE(MOD) ApplyBinary(OpMod); ip++; VM_NEXT();
+      VM_CASE(EQ) ApplyBinary(OpEq); ip++; VM_NEXT();
+      VM_CASE(NEQ) ApplyBinary(OpNeq); ip++; VM_NEXT();
+      VM_CASE(LT) ApplyBinary(OpLt); ip++; VM_NEXT();
+      VM_CASE(GT) ApplyBinary(OpGt); ip++; VM_NEXT();
+      VM_CASE(LE) ApplyBinary(OpLe); ip++; VM_NEXT();
+      VM_CASE(GE) ApplyBinary(OpGe); ip++; VM_NEXT();
+
+      VM_CASE(NEG) ApplyUnary(OpNeg); ip++; VM_NEXT();
+      VM_CASE(NOT) ApplyUnary(OpNot); ip++; VM_NEXT();
+
+      VM_CASE(ADD_I64) ApplyBinary(OpAddI64); ip++; VM_NEXT();
+      VM_CASE(SUB_I64) ApplyBinary(OpSubI64); ip++; VM_NEXT();
+      VM_CASE(MUL_I64) ApplyBinary(OpMulI64); ip++; VM_NEXT();
+      VM_CASE(DIV_I64) ApplyBinary(OpDivI64); ip++; VM_NEXT();
+      VM_CASE(MOD_I64) ApplyBinary(OpModI64); ip++; VM_NEXT();
+      VM_CASE(NEG_I64) ApplyUnary(OpNegI64); ip++; VM_NEXT();
+      VM_CASE(EQ_I64) ApplyBinary(OpEqI64); ip++; VM_NEXT();
+      VM_CASE(NEQ_I64) ApplyBinary(OpNeqI64); ip++; VM_NEXT();
+      VM_CASE(LT_I64) ApplyBinary(OpLtI64); ip++; VM_NEXT();
+      VM_CASE(GT_I64) ApplyBinary(OpGtI64); ip++; VM_NEXT();
+      VM_CASE(LE_I64) ApplyBinary(OpLeI64); ip++; VM_NEXT();
+      VM_CASE(GE_I64) ApplyBinary(OpGeI64); ip++; VM_NEXT();
+
+      VM_CASE(ADD_F64) ApplyBinary(OpAddF64); ip++; VM_NEXT();
+      VM_CASE(SUB_F64) ApplyBinary(OpSubF64); ip++; VM_NEXT();
+      VM_CASE(MUL_F64) ApplyBinary(OpMulF64); ip++; VM_NEXT();
+      VM_CASE(DIV_F64) ApplyBinary(OpDivF64); ip++; VM_NEXT();
+      VM_CASE(NEG_F64) ApplyUnary(OpNegF64); ip++; VM_NEXT();
+      VM_CASE(LT_F64) ApplyBinary(OpLtF64); ip++; VM_NEXT();
+      VM_CASE(GT_F64) ApplyBinary(OpGtF64); ip++; VM_NEXT();
+      VM_CASE(LE_F64) ApplyBinary(OpLeF64); ip++; VM_NEXT();
+      VM_CASE(GE_F64) ApplyBinary(OpGeF64); ip++; VM_NEXT();
+
+      VM_CASE(JMP) {
+        size_t target = static_cast<size_t>(code[ip].a);
+        bool backEdge = target <= ip;
+        ip = target;
+        if (backEdge) VM_JIT_ENTER();
+        VM_NEXT();
       }
 
-      case OpCode::JZ: {
+      VM_CASE(JZ) {
         Value v = Pop();
         bool cond = !v.IsZero();
         if (!cond) {
-          auto it = label_map_.find(ins.arg);
-          if (it == label_map_.end()) throw std::runtime_error("unknown label for JZ: " + ins.arg);
-          ip = it->second;
+          ip = static_cast<size_t>(code[ip].a);
         } else {
           ip++;
         }
-        break;
+        VM_NEXT();
       }
 
-      case OpCode::CALL: {
-        // builtins (print/input) handled directly
-        if (IsBuiltin(ins.arg)) {
-          CallBuiltin(ins.arg);
-          ip++;
-        } else {
-          // call user function: push a return frame and jump to label
-          Frame frame;
-          frame.ret_ip = ip + 1;
-          call_stack_.push_back(std::move(frame));
-          auto it = label_map_.find(ins.arg);
-          if (it == label_map_.end()) throw std::runtime_error("unknown function label: " + ins.arg);
-          ip = it->second;
-        }
-        break;
+      VM_CASE(CALL) {
+        // call user function: push a return frame and jump to its entry
+        Frame frame;
+        frame.ret_ip = ip + 1;
+        frame.base = locals_.size();
+        call_stack_.push_back(frame);
+        ip = static_cast<size_t>(code[ip].a);
+        VM_NEXT();
       }
 
-      case OpCode::RET: {
+      VM_CASE(CALL_BUILTIN) HandleCallBuiltin(code[ip].a); ip++; VM_NEXT();
+
+      VM_CASE(RET) {
         // A function's return value is expected to be on top of the stack.
         // We pop it, tear down the stack frame, and then push it back for the caller.
         Value returnValue = Pop();
@@ -115,39 +268,131 @@ int VM::Run() {
         // Check if we are returning from the top-level 'main' function.
         if (call_stack_.size() <= 1) { // Only the sentinel frame is left
           call_stack_.clear();
+          locals_.clear();
+          out_.Flush();
+          VM_PROFILE_END();
           return returnValue.AsInt(); // Exit program with the return code
         }
 
-        // Pop the current function's call frame.
-        Frame fr = std::move(call_stack_.back());
+        // Pop the current function's call frame and release its slots.
+        Frame fr = call_stack_.back();
         call_stack_.pop_back();
+        locals_.resize(fr.base);
 
         // Push the preserved return value onto the caller's stack.
         Push(returnValue);
 
         // Jump back to the caller's instruction pointer.
         ip = fr.ret_ip;
-        break;
+        VM_NEXT();
+      }
+
+      VM_CASE(TAIL_CALL)
+        // the arguments are already on the stack; the callee's ENTER resets
+        // this frame's slots and its RET goes to our ret_ip
+        ip = static_cast<size_t>(code[ip].a);
+        VM_NEXT();
+
+      VM_CASE(LABEL)
+        // stripped by Link; never executed
+        throw std::runtime_error("unhandled opcode");
+
+      VM_CASE(INC_LOCAL) {
+        const BytecodeOp &ins = code[ip];
+        Value &x = Local(ins.a);
+        if (x.type == ValueType::kInt) x.i += ins.imm.i;
+        else x = OpAdd(x, Value::MakeInt(ins.imm.i));
+        ip++;
+        VM_NEXT();
       }
 
-      case OpCode::LABEL:
-        // no-op
+      VM_CASE(ADD_LOCAL_IMM) {
+        const BytecodeOp &ins = code[ip];
+        const Value &x = Local(ins.a);
+        if (x.type == ValueType::kInt) Push(Value::MakeInt(x.i + ins.imm.i));
+        else Push(OpAdd(x, Value::MakeInt(ins.imm.i)));
         ip++;
-        break;
+        VM_NEXT();
+      }
+
+      VM_CASE(LOAD_LOAD_ADD) {
+        const BytecodeOp &ins = code[ip];
+        const Value &x = Local(ins.a);
+        const Value &y = Local(ins.imm.pair.x);
+        if (x.type == ValueType::kInt && y.type == ValueType::kInt) Push(Value::MakeInt(x.i + y.i));
+        else Push(OpAdd(x, y));
+        ip++;
+        VM_NEXT();
+      }
+
+// Falls through when the comparison holds, jumps to the target otherwise.
+#define VM_JZ_CMP_IMM(name, CMP, generic) \
+      VM_CASE(name) { \
+        const BytecodeOp &ins = code[ip]; \
+        const Value &x = Local(ins.imm.pair.x); \
+        bool holds = x.type == ValueType::kInt ? x.i CMP ins.imm.pair.y \
+                                               : !generic(x, Value::MakeInt(ins.imm.pair.y)).IsZero(); \
+        ip = holds ? ip + 1 : static_cast<size_t>(ins.a); \
+        VM_NEXT(); \
+      }
+
+#define VM_JZ_CMP_LOCAL(name, CMP, generic) \
+      VM_CASE(name) { \
+        const BytecodeOp &ins = code[ip]; \
+        const Value &x = Local(ins.imm.pair.x); \
+        const Value &y = Local(ins.imm.pair.y); \
+        bool holds = x.type == ValueType::kInt && y.type == ValueType::kInt ? x.i CMP y.i \
+                                                                            : !generic(x, y).IsZero(); \
+        ip = holds ? ip + 1 : static_cast<size_t>(ins.a); \
+        VM_NEXT(); \
+      }
+
+      VM_JZ_CMP_IMM(JZ_EQ_IMM, ==, OpEq)
+      VM_JZ_CMP_IMM(JZ_NEQ_IMM, !=, OpNeq)
+      VM_JZ_CMP_IMM(JZ_LT_IMM, <, OpLt)
+      VM_JZ_CMP_IMM(JZ_GT_IMM, >, OpGt)
+      VM_JZ_CMP_IMM(JZ_LE_IMM, <=, OpLe)
+      VM_JZ_CMP_IMM(JZ_GE_IMM, >=, OpGe)
 
+      VM_JZ_CMP_LOCAL(JZ_EQ_LOCAL, ==, OpEq)
+      VM_JZ_CMP_LOCAL(JZ_NEQ_LOCAL, !=, OpNeq)
+      VM_JZ_CMP_LOCAL(JZ_LT_LOCAL, <, OpLt)
+      VM_JZ_CMP_LOCAL(JZ_GT_LOCAL, >, OpGt)
+      VM_JZ_CMP_LOCAL(JZ_LE_LOCAL, <=, OpLe)
+      VM_JZ_CMP_LOCAL(JZ_GE_LOCAL, >=, OpGe)
+
+#undef VM_JZ_CMP_IMM
+#undef VM_JZ_CMP_LOCAL
+
+#if PETUKH_COMPUTED_GOTO
+  }
+halt:
+#else
       default:
         throw std::runtime_error("unhandled opcode");
     }
   }
+#endif
 
+  out_.Flush();
+  VM_PROFILE_END();
   return 0;
 }
 
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_PROFILE_STEP
+#undef VM_PROFILE_END
+#undef VM_JIT_ENTER
+
 // Stack helpers
-void VM::Push(const Value &v) { stack_.push_back(v); }
+void VM::Push(const Value &v) {
+  if (stack_.size() == stack_.capacity()) GrowStack();
+  stack_.push_back(v);
+}
 Value VM::Pop() {
   if (stack_.empty()) throw std::runtime_error("stack underflow");
-  Value v = stack_.back(); stack_.pop_back(); return v;
+  Value v = std::move(stack_.back()); stack_.pop_back(); return v;
 }
 Value VM::Peek(size_t depth) const {
   if (depth >= stack_.size()) throw std::runtime_error("stack overflow peek");
@@ -155,103 +400,166 @@ Value VM::Peek(size_t depth) const {
 }
 
 // simple push handlers
-void VM::HandlePushInt(const std::string &arg) {
-  try {
-    long long v = std::stoll(arg);
-    Push(Value::MakeInt(static_cast<int64_t>(v)));
-  } catch (...) {
-    Push(Value::MakeInt(0));
-  }
+void VM::HandlePushInt(int64_t v) { Push(Value::MakeInt(v)); }
+
+void VM::HandlePushDouble(double v) { Push(Value::MakeDouble(v)); }
+
+void VM::HandlePushString(int32_t index) {
+  Push(string_consts_[static_cast<size_t>(index)]);
 }
 
-void VM::HandlePushDouble(const std::string &arg) {
-  try {
-    double v = std::stod(arg);
-    Push(Value::MakeDouble(v));
-  } catch (...) {
-    Push(Value::MakeDouble(0.0));
+void VM::BeginMemory() {
+  HeapUsage &heap = HeapUsage::Current();
+  heapBase_ = heap.bytes;
+  allocationsBase_ = heap.allocations;
+  heap.peak = heap.bytes;
+  outerLimit_ = heap.limit;
+  if (limits_.heapBytes)
+    heap.limit = heap.bytes + static_cast<int64_t>(limits_.heapBytes);
+  memory_ = {};
+  running_ = true;
+  // a limited stack is never given more room than the limit, so GrowStack
+  // sees the push that would go past it
+  if (limits_.stackDepth && stack_.capacity() > limits_.stackDepth) {
+    std::vector<Value>().swap(stack_);
+    stack_.reserve(limits_.stackDepth);
   }
+  // as deep as an earlier run went, grown once instead of doubling up to it
+  stack_.reserve(limits_.stackDepth ? std::min(reserveStack_, limits_.stackDepth) : reserveStack_);
+  locals_.reserve(reserveSlots_);
+  call_stack_.reserve(reserveCalls_);
 }
 
-void VM::HandlePushString(const std::string &arg) {
-  // strip surrounding quotes if present
-  std::string s = arg;
-  if (s.size() >= 2 && ((s.front() == '"' && s.back() == '"') || (s.front() == '\'' && s.back() == '\''))) {
-    s = s.substr(1, s.size() - 2);
-  }
-  Push(Value::MakeString(s));
+void VM::EndMemory() {
+  memory_ = Memory();
+  running_ = false;
+  HeapUsage::Current().limit = outerLimit_;
+  reserveStack_ = std::max(reserveStack_, memory_.stackPeak);
+  reserveSlots_ = std::max(reserveSlots_, memory_.slotsPeak);
+  reserveCalls_ = std::max(reserveCalls_, memory_.callPeak);
+  // what one deep run grew past the pool is given back; the next run that
+  // needs it reserves it in one go
+  auto trim = [](auto &v, size_t pool) {
+    if (v.capacity() <= pool) return;
+    std::remove_reference_t<decltype(v)>().swap(v);
+    v.reserve(pool);
+  };
+  trim(stack_, kFramePoolSize);
+  trim(locals_, kFramePoolSize * 4);
+  trim(call_stack_, kFramePoolSize);
 }
 
-void VM::HandleLoad(const std::string &name) {
-  if (call_stack_.empty()) { Push(Value::MakeInt(0)); return; }
-  auto &locals = call_stack_.back().locals;
-  auto it = locals.find(name);
-  if (it == locals.end()) {
-    // not found -> push zero
-    Push(Value::MakeInt(0));
-    return;
-  }
-  Push(it->second);
+void VM::NotePeak() {
+  memory_.stackPeak = std::max(memory_.stackPeak, stack_.size());
+  memory_.callPeak = std::max(memory_.callPeak, call_stack_.size());
+  memory_.slotsPeak = std::max(memory_.slotsPeak, locals_.size());
+  if (limits_.callDepth && call_stack_.size() > limits_.callDepth)
+    throw std::runtime_error("call depth limit exceeded");
 }
 
-void VM::HandleStore(const std::string &name) {
-  if (call_stack_.empty()) {
-    Frame f; f.ret_ip = code_.size(); call_stack_.push_back(std::move(f));
-  }
+void VM::GrowStack() {
+  size_t depth = stack_.size();
+  memory_.stackPeak = std::max(memory_.stackPeak, depth);
+  if (limits_.stackDepth && depth >= limits_.stackDepth)
+    throw std::runtime_error("operand stack limit exceeded");
+  size_t room = std::max<size_t>(16, stack_.capacity() * 2);
+  stack_.reserve(limits_.stackDepth ? std::min(room, limits_.stackDepth) : room);
+}
+
+VM::MemoryStats VM::Memory() const {
+  MemoryStats m = memory_;
+  if (!running_) return m;
+  const HeapUsage &heap = HeapUsage::Current();
+  m.heapBytes = heap.bytes - heapBase_;
+  m.heapPeak = heap.peak - heapBase_;
+  m.allocations = heap.allocations - allocationsBase_;
+  m.stackDepth = stack_.size();
+  m.callDepth = call_stack_.size();
+  m.stackPeak = std::max(m.stackPeak, m.stackDepth);
+  m.callPeak = std::max(m.callPeak, m.callDepth);
+  m.slotsPeak = std::max(m.slotsPeak, locals_.size());
+  return m;
+}
+
+void VM::ReportMemory(std::ostream &out) const {
+  MemoryStats m = Memory();
+  auto row = [&out](const char *name, auto now, auto peak, size_t limit) {
+    out << std::left << std::setw(16) << name << std::right << std::setw(14) << now
+        << std::setw(14) << peak;
+    if (limit) out << std::setw(14) << limit;
+    out << "\n";
+  };
+  out << "=== Memory ===\n";
+  out << std::left << std::setw(16) << "" << std::right << std::setw(14) << "now"
+      << std::setw(14) << "peak" << std::setw(14) << "limit" << "\n";
+  row("heap bytes", m.heapBytes, m.heapPeak, limits_.heapBytes);
+  row("operand stack", m.stackDepth, m.stackPeak, limits_.stackDepth);
+  row("call depth", m.callDepth, m.callPeak, limits_.callDepth);
+  row("frame slots", locals_.size(), m.slotsPeak, 0);
+  out << std::left << std::setw(16) << "allocations" << std::right << std::setw(14) << m.allocations << "\n";
+}
+
+void VM::HandleEnter(int64_t size) {
+  // slots start out as int 0, which is what reading a never-stored variable yields
+  size_t base = call_stack_.back().base;
+  locals_.resize(base);
+  locals_.resize(base + static_cast<size_t>(size), Value::MakeInt(0));
+}
+
+void VM::HandleLoad(int64_t slot) {
+  Push(Local(slot));
+}
+
+void VM::HandleStore(int64_t slot) {
   Value v = Pop();
-  call_stack_.back().locals[name] = v;
+  Local(slot) = std::move(v);
 }
 
-void VM::HandleNewArray() {
+void VM::HandleNewArray(int32_t kind) {
   Value sizeVal = Pop();
   int64_t n = sizeVal.AsInt();
   if (n < 0) n = 0;
-  Push(Value::MakeArray(static_cast<size_t>(n)));
+  Push(Value::MakeArray(static_cast<size_t>(n), static_cast<ElemKind>(kind)));
 }
 
-void VM::HandleLoadIndex() {
-  Value idx = Pop();
-  Value arr = Pop();
-  int64_t i = idx.AsInt();
-  if (arr.type == ValueType::kArray) {
-    if (i < 0 || static_cast<size_t>(i) >= arr.a.size()) Push(Value::MakeInt(0));
-    else Push(arr.a[static_cast<size_t>(i)]);
-  } else if (arr.type == ValueType::kString) {
-    if (i < 0 || static_cast<size_t>(i) >= arr.s.size()) Push(Value::MakeString(std::string()));
-    else Push(Value::MakeString(std::string(1, arr.s[static_cast<size_t>(i)])));
+void VM::HandleLoadIndex(int32_t slot) {
+  if (slot >= 0) {
+    // fused form: stack = [..., index], array read straight from the frame
+    Value idx = Pop();
+    PushElement(Local(slot), idx.AsInt());
   } else {
-    Push(Value::MakeInt(0));
+    // stack form: stack = [..., array, index]
+    Value idx = Pop();
+    Value arr = Pop();
+    PushElement(arr, idx.AsInt());
   }
 }
 
-void VM::HandleStoreIndex(const std::string &varName) {
-  if (!varName.empty()) {
+void VM::PushElement(const Value &arr, int64_t i) {
+  if (stack_.size() == stack_.capacity()) GrowStack();
+  stack_.push_back(ElementOf(arr, i));
+}
+
+Value VM::ElementOf(const Value &arr, int64_t i) {
+  if (arr.type == ValueType::kArray) {
+    const ArrayObject &elems = arr.Array();
+    if (i < 0 || static_cast<size_t>(i) >= elems.Size()) return Value::MakeInt(0);
+    return elems.Get(static_cast<size_t>(i));
+  }
+  if (arr.type == ValueType::kString) {
+    StringObject *str = arr.str;
+    if (i < 0 || static_cast<size_t>(i) >= str->size) return Value::MakeChar(-1);
+    return Value::MakeChar(static_cast<unsigned char>(str->At(static_cast<size_t>(i))));
+  }
+  return Value::MakeInt(0);
+}
+
+void VM::HandleStoreIndex(int32_t slot) {
+  if (slot >= 0) {
     // new convention: stack = [..., value, index] (top is index)
     Value idx = Pop();
     Value val = Pop();
-    int64_t i = idx.AsInt();
-
-    if (call_stack_.empty()) throw std::runtime_error("store_index with no frame");
-    auto &locals = call_stack_.back().locals;
-    auto it = locals.find(varName);
-    if (it == locals.end()) {
-      // if variable not present, create array large enough
-      size_t needed = static_cast<size_t>(std::max<int64_t>(0, i + 1));
-      locals[varName] = Value::MakeArray(needed);
-      it = locals.find(varName);
-    }
-
-    if (it->second.type != ValueType::kArray) {
-      // convert/replace with array
-      it->second = Value::MakeArray(static_cast<size_t>(std::max<int64_t>(0, i + 1)));
-    }
-
-    if (i >= 0) {
-      if (static_cast<size_t>(i) >= it->second.a.size())
-        it->second.a.resize(static_cast<size_t>(i) + 1, Value::MakeInt(0));
-      it->second.a[static_cast<size_t>(i)] = val;
-    }
-
+    StoreElement(Local(slot), idx.AsInt(), std::move(val));
     // nothing pushed
   } else {
     // fallback for older convention: stack = [..., value, array, index]
@@ -261,8 +569,8 @@ void VM::HandleStoreIndex(const std::string &varName) {
     Value val = Pop();
     int64_t i = idx.AsInt();
     if (arr.type == ValueType::kArray) {
-      if (i >= 0 && static_cast<size_t>(i) < arr.a.size()) {
-        arr.a[static_cast<size_t>(i)] = val;
+      if (i >= 0 && static_cast<size_t>(i) < arr.Array().Size()) {
+        arr.MutableArray().Set(static_cast<size_t>(i), val);
         Push(arr);
       } else {
         Push(arr);
@@ -273,131 +581,190 @@ void VM::HandleStoreIndex(const std::string &varName) {
   }
 }
 
-void VM::HandleBinaryOp(OpCode op) {
-  Value b = Pop();
-  Value a = Pop();
-
-  // Determine numeric vs string
-  bool a_is_double = (a.type == ValueType::kDouble);
-  bool b_is_double = (b.type == ValueType::kDouble);
-  bool either_double = a_is_double || b_is_double;
+// The *_UNSAFE forms trust LoopOptimizer: the local is an array, the index an
+// int inside it.
+void VM::HandleLoadIndexUnsafe(int32_t slot) {
+  Value &top = stack_.back();
+  top = Local(slot).Array().Get(static_cast<size_t>(top.i));
+}
 
-  switch (op) {
-    case OpCode::ADD: {
-      if (a.type == ValueType::kString || b.type == ValueType::kString) {
-        // string concatenation
-        std::string s = a.AsString() + b.AsString();
-        Push(Value::MakeString(s));
-      } else if (either_double) {
-        Push(Value::MakeDouble(a.AsDouble() + b.AsDouble()));
-      } else {
-        Push(Value::MakeInt(a.AsInt() + b.AsInt()));
-      }
-      break;
-    }
+void VM::HandleStoreIndexUnsafe(int32_t slot) {
+  Value idx = Pop();
+  Value val = Pop();
+  Local(slot).MutableArray().Set(static_cast<size_t>(idx.i), std::move(val));
+}
 
-    case OpCode::SUB:
-      if (either_double) Push(Value::MakeDouble(a.AsDouble() - b.AsDouble()));
-      else Push(Value::MakeInt(a.AsInt() - b.AsInt()));
-      break;
-    case OpCode::MUL:
-      if (either_double) Push(Value::MakeDouble(a.AsDouble() * b.AsDouble()));
-      else Push(Value::MakeInt(a.AsInt() * b.AsInt()));
-      break;
-    case OpCode::DIV:
-      if (either_double) Push(Value::MakeDouble(a.AsDouble() / b.AsDouble()));
-      else {
-        int64_t ib = b.AsInt();
-        if (ib == 0) Push(Value::MakeInt(0));
-        else Push(Value::MakeInt(a.AsInt() / ib));
-      }
-      break;
+void VM::StoreElement(Value &var, int64_t i, Value val) {
+  if (var.type != ValueType::kArray) {
+    // unset (int 0) or scalar variable: convert/replace with array large enough
+    var = Value::MakeArray(static_cast<size_t>(std::max<int64_t>(0, i + 1)));
+  }
 
-    case OpCode::MOD: {
-      int64_t ib = b.AsInt();
-      if (ib == 0) Push(Value::MakeInt(0)); // Avoid division by zero
-      else Push(Value::MakeInt(a.AsInt() % ib));
-    }
-      break;
-
-    case OpCode::EQ: Push(Value::MakeInt(a.AsString() == b.AsString() ? 1 : 0)); break;
-    case OpCode::NEQ: Push(Value::MakeInt(a.AsString() != b.AsString() ? 1 : 0)); break;
-
-    case OpCode::LT:
-      if (either_double) Push(Value::MakeInt(a.AsDouble() < b.AsDouble() ? 1 : 0));
-      else Push(Value::MakeInt(a.AsInt() < b.AsInt() ? 1 : 0));
-      break;
-    case OpCode::GT:
-      if (either_double) Push(Value::MakeInt(a.AsDouble() > b.AsDouble() ? 1 : 0));
-      else Push(Value::MakeInt(a.AsInt() > b.AsInt() ? 1 : 0));
-      break;
-    case OpCode::LE:
-      if (either_double) Push(Value::MakeInt(a.AsDouble() <= b.AsDouble() ? 1 : 0));
-      else Push(Value::MakeInt(a.AsInt() <= b.AsInt() ? 1 : 0));
-      break;
-    case OpCode::GE:
-      if (either_double) Push(Value::MakeInt(a.AsDouble() >= b.AsDouble() ? 1 : 0));
-      else Push(Value::MakeInt(a.AsInt() >= b.AsInt() ? 1 : 0));
-      break;
-
-    default:
-      throw std::runtime_error("invalid binary op");
+  if (i >= 0) {
+    ArrayObject &elems = var.MutableArray();
+    if (static_cast<size_t>(i) >= elems.Size())
+      elems.Resize(static_cast<size_t>(i) + 1);
+    elems.Set(static_cast<size_t>(i), std::move(val));
   }
 }
 
-void VM::HandleUnaryOp(OpCode op) {
-  Value v = Pop();
-  switch (op) {
-    case OpCode::NEG:
-      if (v.type == ValueType::kDouble) Push(Value::MakeDouble(-v.d));
-      else Push(Value::MakeInt(-v.AsInt()));
-      break;
-    case OpCode::NOT:
-      Push(Value::MakeInt(v.IsZero() ? 1 : 0));
-      break;
-    default:
-      throw std::runtime_error("invalid unary op");
-  }
+// Applies fn to the two topmost values and leaves the result in place of the left operand.
+template <typename Fn>
+void VM::ApplyBinary(Fn fn) {
+  if (stack_.size() < 2) throw std::runtime_error("stack underflow");
+  Value &a = stack_[stack_.size() - 2];
+  a = fn(a, stack_.back());
+  stack_.pop_back();
 }
 
-bool VM::IsBuiltin(const std::string &name) const {
-  return name == "printInt" || name == "printStr" || name == "printDouble" ||
-         name == "inputInt" || name == "inputStr" || name == "inputDouble" || name == "vsuprun" || name == "binxor";
-}
-
-void VM::CallBuiltin(const std::string &name) {
-  if (name == "printInt") {
-    Value v = Pop();
-    std::cout << v.AsInt();
-  } else if (name == "printDouble") {
-    Value v = Pop();
-    std::cout << v.AsDouble();
-  } else if (name == "printStr") {
-    Value v = Pop();
-    std::cout << v.AsString();
-  } else if (name == "inputInt") {
-    long long x = 0; if (!(std::cin >> x)) x = 0; Push(Value::MakeInt(static_cast<int64_t>(x)));
-  } else if (name == "inputDouble") {
-    double d = 0.0; if (!(std::cin >> d)) d = 0.0; Push(Value::MakeDouble(d));
-  } else if (name == "inputStr") {
-    std::string s; std::getline(std::cin, s);
-    // if previous extraction left a newline, try again
-    if (s.empty() && std::cin.good()) std::getline(std::cin, s);
-    Push(Value::MakeString(s));
-  } else if (name == "vsuprun") {
-    Push(Value::MakeInt(1.0 * clock() / CLOCKS_PER_SEC >= 1.95));
-  } else if (name == "binxor") {
-    Value a = Pop(), b = Pop();
-    auto BinXor = [&](auto&& self, int64_t base, int64_t power) -> int {
-      if (power == 0) {
-        return 0;
-      } else if (power & 1) {
-        return self(self, base, power - 1) ^ base;
-      } else {
-        int res = self(self, base, power / 2);
-        return (res ^ res);
-      }
-    };
-    Push(Value::MakeInt(BinXor(BinXor, b.AsInt(), a.AsInt())));
+template <typename Fn>
+void VM::ApplyUnary(Fn fn) {
+  if (stack_.empty()) throw std::runtime_error("stack underflow");
+  stack_.back() = fn(stack_.back());
+}
+
+// Arithmetic on two ints stays int; a double on either side promotes both.
+static bool EitherDouble(const Value &a, const Value &b) {
+  return a.type == ValueType::kDouble || b.type == ValueType::kDouble;
+}
+
+Value VM::OpAdd(const Value &a, const Value &b) {
+  if (a.type == ValueType::kString || b.type == ValueType::kString) {
+    // string concatenation
+    return Value::Concat(a, b);
   }
+  if (EitherDouble(a, b)) return Value::MakeDouble(a.AsDouble() + b.AsDouble());
+  return Value::MakeInt(a.AsInt() + b.AsInt());
+}
+
+Value VM::OpSub(const Value &a, const Value &b) {
+  if (EitherDouble(a, b)) return Value::MakeDouble(a.AsDouble() - b.AsDouble());
+  return Value::MakeInt(a.AsInt() - b.AsInt());
+}
+
+Value VM::OpMul(const Value &a, const Value &b) {
+  if (EitherDouble(a, b)) return Value::MakeDouble(a.AsDouble() * b.AsDouble());
+  return Value::MakeInt(a.AsInt() * b.AsInt());
+}
+
+Value VM::OpDiv(const Value &a, const Value &b) {
+  if (EitherDouble(a, b)) return Value::MakeDouble(a.AsDouble() / b.AsDouble());
+  int64_t ib = b.AsInt();
+  if (ib == 0) return Value::MakeInt(0);
+  return Value::MakeInt(a.AsInt() / ib);
+}
+
+Value VM::OpMod(const Value &a, const Value &b) {
+  int64_t ib = b.AsInt();
+  if (ib == 0) return Value::MakeInt(0); // Avoid division by zero
+  return Value::MakeInt(a.AsInt() % ib);
+}
+
+// Equality compares textual forms; two strings are compared in place.
+static bool SameText(const Value &a, const Value &b) {
+  if (a.type == ValueType::kString && b.type == ValueType::kString)
+    return a.str == b.str || (a.str->size == b.str->size && a.Str() == b.Str());
+  return a.AsString() == b.AsString();
+}
+
+Value VM::OpEq(const Value &a, const Value &b) { return Value::MakeInt(SameText(a, b) ? 1 : 0); }
+Value VM::OpNeq(const Value &a, const Value &b) { return Value::MakeInt(SameText(a, b) ? 0 : 1); }
+
+Value VM::OpLt(const Value &a, const Value &b) {
+  if (EitherDouble(a, b)) return Value::MakeInt(a.AsDouble() < b.AsDouble() ? 1 : 0);
+  return Value::MakeInt(a.AsInt() < b.AsInt() ? 1 : 0);
+}
+
+Value VM::OpGt(const Value &a, const Value &b) {
+  if (EitherDouble(a, b)) return Value::MakeInt(a.AsDouble() > b.AsDouble() ? 1 : 0);
+  return Value::MakeInt(a.AsInt() > b.AsInt() ? 1 : 0);
+}
+
+Value VM::OpLe(const Value &a, const Value &b) {
+  if (EitherDouble(a, b)) return Value::MakeInt(a.AsDouble() <= b.AsDouble() ? 1 : 0);
+  return Value::MakeInt(a.AsInt() <= b.AsInt() ? 1 : 0);
+}
+
+Value VM::OpGe(const Value &a, const Value &b) {
+  if (EitherDouble(a, b)) return Value::MakeInt(a.AsDouble() >= b.AsDouble() ? 1 : 0);
+  return Value::MakeInt(a.AsInt() >= b.AsInt() ? 1 : 0);
+}
+
+Value VM::OpNeg(const Value &v) {
+  if (v.type == ValueType::kDouble) return Value::MakeDouble(-v.d);
+  return Value::MakeInt(-v.AsInt());
+}
+
+Value VM::OpNot(const Value &v) { return Value::MakeInt(v.IsZero() ? 1 : 0); }
+
+// Specialized operators. The static types promise the fast path, but they are
+// re-checked on the tags (a declared int may still be handed an array, for
+// instance), and anything unexpected takes the generic route above.
+static bool BothInt(const Value &a, const Value &b) {
+  return a.type == ValueType::kInt && b.type == ValueType::kInt;
+}
+
+static bool IsNumber(const Value &v) {
+  return v.type == ValueType::kInt || v.type == ValueType::kDouble;
+}
+
+Value VM::OpAddI64(const Value &a, const Value &b) { return BothInt(a, b) ? Value::MakeInt(a.i + b.i) : OpAdd(a, b); }
+Value VM::OpSubI64(const Value &a, const Value &b) { return BothInt(a, b) ? Value::MakeInt(a.i - b.i) : OpSub(a, b); }
+Value VM::OpMulI64(const Value &a, const Value &b) { return BothInt(a, b) ? Value::MakeInt(a.i * b.i) : OpMul(a, b); }
+
+Value VM::OpDivI64(const Value &a, const Value &b) {
+  if (!BothInt(a, b)) return OpDiv(a, b);
+  return Value::MakeInt(b.i == 0 ? 0 : a.i / b.i);
+}
+
+Value VM::OpModI64(const Value &a, const Value &b) {
+  if (!BothInt(a, b)) return OpMod(a, b);
+  return Value::MakeInt(b.i == 0 ? 0 : a.i % b.i);
+}
+
+Value VM::OpNegI64(const Value &v) { return v.type == ValueType::kInt ? Value::MakeInt(-v.i) : OpNeg(v); }
+
+Value VM::OpEqI64(const Value &a, const Value &b) { return BothInt(a, b) ? Value::MakeInt(a.i == b.i) : OpEq(a, b); }
+Value VM::OpNeqI64(const Value &a, const Value &b) { return BothInt(a, b) ? Value::MakeInt(a.i != b.i) : OpNeq(a, b); }
+Value VM::OpLtI64(const Value &a, const Value &b) { return BothInt(a, b) ? Value::MakeInt(a.i < b.i) : OpLt(a, b); }
+Value VM::OpGtI64(const Value &a, const Value &b) { return BothInt(a, b) ? Value::MakeInt(a.i > b.i) : OpGt(a, b); }
+Value VM::OpLeI64(const Value &a, const Value &b) { return BothInt(a, b) ? Value::MakeInt(a.i <= b.i) : OpLe(a, b); }
+Value VM::OpGeI64(const Value &a, const Value &b) { return BothInt(a, b) ? Value::MakeInt(a.i >= b.i) : OpGe(a, b); }
+
+// The generic ops only use double arithmetic when a double is actually
+// present, so an int/int pair (e.g. a double variable that was given an int)
+// must still go the generic way.
+static bool DoubleMath(const Value &a, const Value &b) {
+  return IsNumber(a) && IsNumber(b) && EitherDouble(a, b);
+}
+
+Value VM::OpAddF64(const Value &a, const Value &b) {
+  return DoubleMath(a, b) ? Value::MakeDouble(a.AsDouble() + b.AsDouble()) : OpAdd(a, b);
+}
+Value VM::OpSubF64(const Value &a, const Value &b) {
+  return DoubleMath(a, b) ? Value::MakeDouble(a.AsDouble() - b.AsDouble()) : OpSub(a, b);
+}
+Value VM::OpMulF64(const Value &a, const Value &b) {
+  return DoubleMath(a, b) ? Value::MakeDouble(a.AsDouble() * b.AsDouble()) : OpMul(a, b);
+}
+Value VM::OpDivF64(const Value &a, const Value &b) {
+  return DoubleMath(a, b) ? Value::MakeDouble(a.AsDouble() / b.AsDouble()) : OpDiv(a, b);
+}
+
+Value VM::OpNegF64(const Value &v) { return v.type == ValueType::kDouble ? Value::MakeDouble(-v.d) : OpNeg(v); }
+
+Value VM::OpLtF64(const Value &a, const Value &b) { return DoubleMath(a, b) ? Value::MakeInt(a.AsDouble() < b.AsDouble()) : OpLt(a, b); }
+Value VM::OpGtF64(const Value &a, const Value &b) { return DoubleMath(a, b) ? Value::MakeInt(a.AsDouble() > b.AsDouble()) : OpGt(a, b); }
+Value VM::OpLeF64(const Value &a, const Value &b) { return DoubleMath(a, b) ? Value::MakeInt(a.AsDouble() <= b.AsDouble()) : OpLe(a, b); }
+Value VM::OpGeF64(const Value &a, const Value &b) { return DoubleMath(a, b) ? Value::MakeInt(a.AsDouble() >= b.AsDouble()) : OpGe(a, b); }
+
+void VM::HandleCallBuiltin(int32_t id) {
+  const Builtin &b = builtins_.Get(id);
+  size_t argc = b.paramTypes.size();
+  if (stack_.size() < argc) throw std::runtime_error("stack underflow");
+
+  // arguments are read in place and dropped afterwards
+  Value result = b.fn(*this, stack_.data() + (stack_.size() - argc));
+  stack_.resize(stack_.size() - argc);
+  if (b.returnType != TypeKind::VOID) Push(std::move(result));
 }
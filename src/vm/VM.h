@@ -1,34 +1,167 @@
 #ifndef PETUKH_VM_H
 #define PETUKH_VM_H
 
-#include <map>
+#include <memory>
+#include <ostream>
 #include <vector>
 #include <string>
 #include <unordered_map>
 #include "../rpn/RPNInstruction.h"
+#include "Builtins.h"
+#include "Bytecode.h"
+#include "CompiledModule.h"
+#include "FastIO.h"
+#include "Jit.h"
+#include "Profiler.h"
 #include "Value.h"
 
+#ifndef PETUKH_COMPUTED_GOTO
+#define PETUKH_COMPUTED_GOTO 0
+#endif
+
+#if PETUKH_JIT && PETUKH_PROFILE
+#error "PETUKH_PROFILE only sees interpreted instructions; build it without PETUKH_JIT"
+#endif
 
 
 class VM {
  public:
-  explicit VM(const std::vector<Instruction> &code);
+  // kStack interprets the bytecode as is (and is the one PETUKH_PROFILE and
+  // PETUKH_JIT work with); kRegister runs the module's RegisterModule, or
+  // the bytecode when the module could not be translated.
+  enum class Backend { kStack, kRegister };
+
+  // A VM keeps its own stacks and I/O; the module may be shared with other VMs.
+  explicit VM(std::shared_ptr<const CompiledModule> module, Backend backend = Backend::kStack);
+  explicit VM(const std::vector<Instruction> &code, const BuiltinTable &builtins = BuiltinTable::Standard());
+
   // Run the program. Returns exit code (0 if normal return from main).
+  // Every run starts from empty stacks, so one VM can run its module many times.
   int Run();
 
+  // Output is buffered while the program runs, and flushed when Run returns.
+  void FlushOutput() { out_.Flush(); }
+
+  // Points the builtins at other descriptors for the following runs
+  // (stdin / stdout by default). Pending output is flushed first.
+  void SetIO(int inFd, int outFd);
+
+  const CompiledModule &Module() const { return *module_; }
+  // what Run executes
+  Backend ActiveBackend() const { return registers_ ? Backend::kRegister : Backend::kStack; }
+
+  // Caps the following runs are stopped at with a std::runtime_error; 0 leaves one out.
+  struct Limits {
+    size_t heapBytes = 0;   // held by the program's strings and arrays (see HeapUsage)
+    size_t stackDepth = 0;  // values on the operand stack (Backend::kStack only)
+    size_t callDepth = 0;   // frames, the bottom one included
+  };
+  void SetLimits(const Limits &limits) { limits_ = limits; }
+
+  // What a run holds and has held at most. The peaks are taken whenever a
+  // frame is set up and whenever the operand stack outgrows its storage, so
+  // the deepest expression inside one frame may be missed; calls native code
+  // (PETUKH_JIT) makes without the interpreter are not seen either.
+  struct MemoryStats {
+    int64_t heapBytes = 0;     // net of what its thread held when the run started
+    int64_t heapPeak = 0;
+    uint64_t allocations = 0;  // strings and arrays made
+    size_t stackDepth = 0;     // operand stack values
+    size_t stackPeak = 0;
+    size_t callDepth = 0;
+    size_t callPeak = 0;
+    size_t slotsPeak = 0;      // frame slots (registers, on Backend::kRegister)
+  };
+  // the current run's from a builtin, the last one's after Run
+  MemoryStats Memory() const;
+  // the end-of-run summary for --memory
+  void ReportMemory(std::ostream &out) const;
+
+  // for builtins
+  FastOutput &Output() { return out_; }
+  FastInput &Input() { return in_; }
+  // CPU seconds the calling thread has spent in the current Run
+  double CpuTime() const;
+
+#if PETUKH_PROFILE
+  // what the last Run executed (see Profiler)
+  const Profiler &Profile() const { return profiler_; }
+#endif
+
  private:
-  const std::vector<Instruction> &code_;
+  std::shared_ptr<const CompiledModule> module_;
+  const BuiltinTable &builtins_;
+
+  // lowered program: LABELs stripped, targets resolved, immediates decoded
+  const BytecodeModule &program_;
+  std::vector<Value> string_consts_;  // program_.strings as ready-made values, per VM
+#if PETUKH_COMPUTED_GOTO
+  std::vector<const void *> threaded_;  // handler address per instruction
+#endif
+  // Backend::kRegister: the translated program and its constants, per VM like string_consts_
+  const RegisterModule *registers_ = nullptr;
+  std::vector<Value> reg_consts_;
+#if PETUKH_COMPUTED_GOTO
+  std::vector<const void *> reg_threaded_;
+#endif
+
+  // A frame is a window [base, base + ENTER size) on the shared register file.
+  // frames (and their slots) preallocated before the first call
+  static constexpr size_t kFramePoolSize = 4096;
 
   struct Frame {
     size_t ret_ip = 0;
-    std::map<std::string, Value> locals;
+    size_t base = 0;
   };
 
   std::vector<Value> stack_;
+  std::vector<Value> locals_;
   std::vector<Frame> call_stack_;
-  std::map<std::string, size_t> label_map_;
 
-  void BuildLabelMap();
+  Limits limits_;
+  MemoryStats memory_;
+  bool running_ = false;
+  int64_t heapBase_ = 0;  // HeapUsage::Current() when the run started
+  uint64_t allocationsBase_ = 0;
+  int64_t outerLimit_ = 0;
+  // the highest peaks of earlier runs, reserved up front by the next one
+  size_t reserveStack_ = 0;
+  size_t reserveCalls_ = 0;
+  size_t reserveSlots_ = 0;
+
+  // I/O of the print* / input* builtins
+  FastOutput out_;
+  FastInput in_;
+  double runStartCpu_ = 0.0;
+#if PETUKH_PROFILE
+  Profiler profiler_;
+#endif
+#if PETUKH_JIT
+  Jit jit_;
+  std::vector<int64_t> jitStack_;  // native code's operand stack
+
+  // Hands over to native code if there is some for `ip` by now; ip is left
+  // where the interpreter resumes.
+  void EnterNative(size_t &ip);
+#endif
+
+  // the dispatch loops, after Run has reset the VM
+  int RunStack();
+  int RunRegisters();  // RegisterVM.cpp
+
+  void BeginMemory();
+  void EndMemory();
+  // whenever a frame has been set up; cheap unless it sets a peak
+  void NoteCall() {
+    if (call_stack_.size() > memory_.callPeak || stack_.size() > memory_.stackPeak ||
+        locals_.size() > memory_.slotsPeak)
+      NotePeak();
+  }
+  void NotePeak();
+  // the slow path of a push onto a full stack_, where the stack limit is checked
+  void GrowStack();
+
+  Value &Local(int64_t slot) { return locals_[call_stack_.back().base + static_cast<size_t>(slot)]; }
 
   // stack helpers
   void Push(const Value &v);
@@ -36,21 +169,63 @@ class VM {
   Value Peek(size_t depth = 0) const;  // 0 = top
 
   // instruction handlers
-  void HandlePushInt(const std::string &arg);
-  void HandlePushDouble(const std::string &arg);
-  void HandlePushString(const std::string &arg);
+  void HandlePushInt(int64_t v);
+  void HandlePushDouble(double v);
+  void HandlePushString(int32_t index);
+
+  void HandleEnter(int64_t size);
+  void HandleLoad(int64_t slot);
+  void HandleStore(int64_t slot);
+  void HandleNewArray(int32_t kind);
+  void HandleLoadIndex(int32_t slot);
+  void PushElement(const Value &arr, int64_t i);
+  void HandleStoreIndex(int32_t slot);
+  static Value ElementOf(const Value &arr, int64_t i);
+  static void StoreElement(Value &var, int64_t i, Value val);
+  void HandleLoadIndexUnsafe(int32_t slot);
+  void HandleStoreIndexUnsafe(int32_t slot);
+  void HandleCallBuiltin(int32_t id);
+
+  // one function per operator, so neither dispatch loop switches twice
+  template <typename Fn> void ApplyBinary(Fn fn);
+  template <typename Fn> void ApplyUnary(Fn fn);
 
-  void HandleLoad(const std::string &name);
-  void HandleStore(const std::string &name);
-  void HandleNewArray();
-  void HandleLoadIndex();
-  void HandleStoreIndex(const std::string &varName);
+  static Value OpAdd(const Value &a, const Value &b);
+  static Value OpSub(const Value &a, const Value &b);
+  static Value OpMul(const Value &a, const Value &b);
+  static Value OpDiv(const Value &a, const Value &b);
+  static Value OpMod(const Value &a, const Value &b);
+  static Value OpEq(const Value &a, const Value &b);
+  static Value OpNeq(const Value &a, const Value &b);
+  static Value OpLt(const Value &a, const Value &b);
+  static Value OpGt(const Value &a, const Value &b);
+  static Value OpLe(const Value &a, const Value &b);
+  static Value OpGe(const Value &a, const Value &b);
+  static Value OpNeg(const Value &v);
+  static Value OpNot(const Value &v);
 
-  void HandleBinaryOp(OpCode op);
-  void HandleUnaryOp(OpCode op);
+  static Value OpAddI64(const Value &a, const Value &b);
+  static Value OpSubI64(const Value &a, const Value &b);
+  static Value OpMulI64(const Value &a, const Value &b);
+  static Value OpDivI64(const Value &a, const Value &b);
+  static Value OpModI64(const Value &a, const Value &b);
+  static Value OpNegI64(const Value &v);
+  static Value OpEqI64(const Value &a, const Value &b);
+  static Value OpNeqI64(const Value &a, const Value &b);
+  static Value OpLtI64(const Value &a, const Value &b);
+  static Value OpGtI64(const Value &a, const Value &b);
+  static Value OpLeI64(const Value &a, const Value &b);
+  static Value OpGeI64(const Value &a, const Value &b);
 
-  bool IsBuiltin(const std::string &name) const;
-  void CallBuiltin(const std::string &name);
+  static Value OpAddF64(const Value &a, const Value &b);
+  static Value OpSubF64(const Value &a, const Value &b);
+  static Value OpMulF64(const Value &a, const Value &b);
+  static Value OpDivF64(const Value &a, const Value &b);
+  static Value OpNegF64(const Value &v);
+  static Value OpLtF64(const Value &a, const Value &b);
+  static Value OpGtF64(const Value &a, const Value &b);
+  static Value OpLeF64(const Value &a, const Value &b);
+  static Value OpGeF64(const Value &a, const Value &b);
 };
 
 #endif  // PETUKH_VM_H
@@ -0,0 +1,147 @@
+#include "Value.h"
+
+// Below this many characters a concatenation is copied right away: a flat
+// short string costs no more than a rope node and keeps reads direct.
+static constexpr size_t kMinRope = 32;
+
+const std::string &StringObject::Text() {
+  if (kind == Kind::kFlat)
+    return data;
+
+  HeapUsage::Current().Charge(static_cast<int64_t>(size));
+  charged += size;
+  std::string text;
+  text.reserve(size);
+  if (kind == Kind::kSlice) {
+    text.assign(left->data, offset, size);
+  } else {
+    // in order over the parts, without recursion: ropes built in a loop are
+    // as deep as the loop ran
+    std::vector<StringObject *> pending{this};
+    while (!pending.empty()) {
+      StringObject *s = pending.back();
+      pending.pop_back();
+      if (s->kind == Kind::kConcat) {
+        pending.push_back(s->right);
+        pending.push_back(s->left);
+      } else if (s->kind == Kind::kSlice) {
+        text.append(s->left->data, s->offset, s->size);
+      } else {
+        text += s->data;
+      }
+    }
+    Release(right);
+  }
+  Release(left);
+  left = right = nullptr;
+  offset = 0;
+  data = std::move(text);
+  kind = Kind::kFlat;
+  return data;
+}
+
+char StringObject::At(size_t i) {
+  if (kind == Kind::kSlice)
+    return left->data[offset + i];
+  return Text()[i];
+}
+
+StringObject *StringObject::Concat(StringObject *l, StringObject *r) {
+  // the parts' references stay owned here until they are passed on
+  Value left = Value::OfString(l);
+  Value right = Value::OfString(r);
+  size_t size = l->size + r->size;
+  std::string flat;
+  if (size < kMinRope) {
+    flat = l->Text();
+    flat += r->Text();
+  }
+  size_t bytes = Bytes(flat.size());
+  HeapUsage &heap = HeapUsage::Current();
+  heap.Charge(static_cast<int64_t>(bytes));
+  heap.allocations++;
+
+  auto *s = new StringObject;
+  s->size = size;
+  s->charged = bytes;
+  if (size < kMinRope) {
+    s->data = std::move(flat);
+    return s;
+  }
+  s->kind = Kind::kConcat;
+  s->left = l;
+  s->right = r;
+  left.type = right.type = ValueType::kNone;
+  return s;
+}
+
+StringObject *StringObject::Slice(StringObject *s, size_t from, size_t count) {
+  // slices always point at flat text, and nothing below may throw
+  if (s->kind == Kind::kConcat)
+    s->Text();
+  size_t bytes = Bytes(count < kMinRope ? count : 0);
+  HeapUsage &heap = HeapUsage::Current();
+  heap.Charge(static_cast<int64_t>(bytes));
+  heap.allocations++;
+
+  auto *out = new StringObject;
+  out->size = count;
+  out->charged = bytes;
+  if (count < kMinRope) {
+    out->data.reserve(count);
+    for (size_t i = 0; i < count; ++i)
+      out->data += s->At(from + i);
+    return out;
+  }
+  StringObject *base = s;
+  if (s->kind == Kind::kSlice) {
+    base = s->left;
+    from += s->offset;
+  }
+  if (base->refs != kImmortal) base->refs++;
+  out->kind = Kind::kSlice;
+  out->left = base;
+  out->offset = from;
+  return out;
+}
+
+void StringObject::Destroy(StringObject *s) {
+  std::vector<StringObject *> dead{s};
+  while (!dead.empty()) {
+    StringObject *d = dead.back();
+    dead.pop_back();
+    for (StringObject *part : {d->left, d->right})
+      if (part && part->refs != kImmortal && --part->refs == 0)
+        dead.push_back(part);
+    delete d;
+  }
+}
+
+Value Value::MakeChar(int c) {
+  // index 0 is the empty string, 1 + c the character c
+  static StringObject *const *const table = [] {
+    static StringObject *chars[257];
+    for (int k = 0; k < 257; ++k) {
+      chars[k] = new StringObject;
+      chars[k]->refs = StringObject::kImmortal;
+      if (k > 0) chars[k]->data.assign(1, static_cast<char>(k - 1));
+      chars[k]->size = chars[k]->data.size();
+    }
+    return chars;
+  }();
+  return OfString(table[c < 0 ? 0 : 1 + (c & 0xFF)]);
+}
+
+Value Value::Concat(const Value &lhs, const Value &rhs) {
+  auto part = [](const Value &v) {
+    if (v.type == ValueType::kString) {
+      v.Retain();
+      return v.str;
+    }
+    Value flat = MakeString(v.AsString());
+    StringObject *s = flat.str;
+    flat.type = ValueType::kNone;
+    return s;
+  };
+  return OfString(StringObject::Concat(part(lhs), part(rhs)));
+}
@@ -1,33 +1,236 @@
 #ifndef PETUKH_VALUE_H
 #define PETUKH_VALUE_H
 
+#include <bit>
 #include <cstdint>
+#include <cstring>
+#include <limits>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 #include <stdexcept>
 
-enum class ValueType { kNone, kInt, kDouble, kString, kArray };
+enum class ValueType : uint8_t { kNone, kInt, kDouble, kString, kArray };
 
+struct Value;
+
+// What the strings and arrays made on the calling thread hold, for
+// VM::Memory. A VM runs on one thread and never shares its Values, so plain
+// counters do. Objects are charged their header plus their characters or
+// elements when made and whenever they change size, before they grow, and
+// credited back when freed.
+struct HeapUsage {
+  int64_t bytes = 0;
+  int64_t peak = 0;
+  uint64_t allocations = 0;  // strings and arrays made, copies on write included
+  int64_t limit = 0;         // bytes Charge refuses to go past; 0 for none
+
+  static HeapUsage &Current() {
+    thread_local HeapUsage usage;
+    return usage;
+  }
+
+  // Throws, leaving everything as it was, when bytes would go past the limit.
+  void Charge(int64_t delta) {
+    if (limit && delta > 0 && bytes + delta > limit)
+      throw std::runtime_error("memory limit exceeded");
+    bytes += delta;
+    if (bytes > peak) peak = bytes;
+  }
+};
+
+// Out-of-line payloads. Both are intrusively refcounted and owned by the
+// Values that point at them; a VM never shares them across threads.
+//
+// A string is a rope: flat text, the concatenation of two strings, or a
+// slice of a flat one. Its characters never change, but Text() flattens a
+// concatenation or slice in place the first time they are needed in one
+// piece, so building a string with `s = s + x` in a loop stays linear.
+struct StringObject {
+  // Value::MakeChar's strings are shared by every VM: never counted nor freed
+  static constexpr uint32_t kImmortal = UINT32_MAX;
+
+  enum class Kind : uint8_t { kFlat, kConcat, kSlice };
+
+  uint32_t refs = 1;
+  Kind kind = Kind::kFlat;
+  size_t size = 0;
+  std::string data;               // kFlat
+  StringObject *left = nullptr;   // kConcat: the first part; kSlice: the flat string sliced
+  StringObject *right = nullptr;  // kConcat: the second part
+  size_t offset = 0;              // kSlice
+  size_t charged = 0;             // to HeapUsage
+
+  StringObject() = default;
+  StringObject(const StringObject &) = delete;
+  StringObject &operator=(const StringObject &) = delete;
+  ~StringObject() { HeapUsage::Current().bytes -= static_cast<int64_t>(charged); }
+
+  // the header and, for flat text, the characters: parts are objects of their own
+  static size_t Bytes(size_t flatSize) { return sizeof(StringObject) + flatSize; }
+
+  const std::string &Text();
+  char At(size_t i);
+
+  // takes over the references to both parts
+  static StringObject *Concat(StringObject *l, StringObject *r);
+  // count characters from `from` on, both already clamped into the string
+  static StringObject *Slice(StringObject *s, size_t from, size_t count);
+  // with refs at 0; a whole chain of parts goes without recursion
+  static void Destroy(StringObject *s);
+  static void Release(StringObject *s) {
+    if (s->refs != kImmortal && --s->refs == 0) Destroy(s);
+  }
+};
+
+// How an array stores its elements. Arrays declared with an element type
+// keep them unboxed (8 bytes per int, 1 per char instead of a 16-byte
+// Value); string arrays and arrays a scalar variable was turned into by a
+// store hold Values.
+enum class ElemKind : uint8_t { kValue, kInt, kDouble, kChar };
+
+// NEW_ARRAY's element kind for a declared element type name
+inline ElemKind ElemKindOf(std::string_view type) {
+  if (type == "int") return ElemKind::kInt;
+  if (type == "double") return ElemKind::kDouble;
+  if (type == "char") return ElemKind::kChar;
+  return ElemKind::kValue;
+}
+
+inline const char *ElemKindName(ElemKind kind) {
+  switch (kind) {
+    case ElemKind::kInt: return "int";
+    case ElemKind::kDouble: return "double";
+    case ElemKind::kChar: return "char";
+    default: return "value";
+  }
+}
+
+// A double array's elements that were never stored read as int 0, like those
+// of every other fresh array, and so do those int 0 was stored to. The buffer
+// marks them with this signalling NaN, which no arithmetic or input produces
+// (a store of it is kept as a quiet one).
+inline constexpr uint64_t kUnsetDouble = 0x7ff4'0000'0000'0000ull;
+
+inline bool IsUnsetDouble(double d) { return std::bit_cast<uint64_t>(d) == kUnsetDouble; }
+
+struct ArrayObject {
+  uint32_t refs = 1;
+  ElemKind kind = ElemKind::kValue;
+  // only the vector for `kind` is used
+  std::vector<Value> values;
+  std::vector<int64_t> ints;
+  std::vector<double> doubles;
+  std::vector<int8_t> chars;  // wrap around like C chars
+  size_t charged = 0;         // to HeapUsage; a copy takes it over along with the elements
+
+  ArrayObject() = default;
+  ArrayObject(const ArrayObject &) = default;
+  ArrayObject &operator=(const ArrayObject &) = delete;
+  ~ArrayObject() { HeapUsage::Current().bytes -= static_cast<int64_t>(charged); }
+
+  size_t Size() const;
+  Value Get(size_t i) const;
+  // Stores v as it is (chars wrap); a value the storage cannot hold, such as
+  // an int other than 0 in a double array, boxes the whole array first.
+  void Set(size_t i, Value v);
+  // grows with zeros (unset elements, for doubles), or shrinks
+  void Resize(size_t n);
+  void Box();
+
+ private:
+  static size_t Bytes(size_t n, ElemKind kind);
+  // to HeapUsage ahead of a change to n elements of `kind`
+  void Recharge(size_t n, ElemKind kind);
+};
+
+// 16-byte tagged union: ints and doubles live inline, strings and arrays
+// behind a refcounted pointer, so copying a scalar never allocates.
 struct Value {
   ValueType type = ValueType::kNone;
-  int64_t i = 0;
-  double d = 0.0;
-  std::string s;
-  std::vector<Value> a;  // used when type == kArray
+  union {
+    int64_t i = 0;
+    double d;
+    StringObject *str;  // type == kString
+    ArrayObject *arr;   // type == kArray; shared until one holder writes
+  };
+
+  Value() = default;
+  Value(const Value &o) : type(o.type) { CopyPayload(o); Retain(); }
+  Value(Value &&o) noexcept : type(o.type) { CopyPayload(o); o.type = ValueType::kNone; }
+  Value &operator=(const Value &o) {
+    if (this != &o) {
+      o.Retain();
+      Release();
+      type = o.type;
+      CopyPayload(o);
+    }
+    return *this;
+  }
+  Value &operator=(Value &&o) noexcept {
+    if (this != &o) {
+      Release();
+      type = o.type;
+      CopyPayload(o);
+      o.type = ValueType::kNone;
+    }
+    return *this;
+  }
+  ~Value() { Release(); }
 
-  Value() : type(ValueType::kNone), i(0), d(0.0) {}
   static Value MakeInt(int64_t v) { Value x; x.type = ValueType::kInt; x.i = v; return x; }
   static Value MakeDouble(double v) { Value x; x.type = ValueType::kDouble; x.d = v; return x; }
-  static Value MakeString(const std::string &v) { Value x; x.type = ValueType::kString; x.s = v; return x; }
-  static Value MakeArray(size_t n) { Value x; x.type = ValueType::kArray; x.a.assign(n, Value::MakeInt(0)); return x; }
+  static Value MakeString(std::string v) {
+    HeapUsage &heap = HeapUsage::Current();
+    heap.Charge(static_cast<int64_t>(StringObject::Bytes(v.size())));
+    Value x; x.type = ValueType::kString; x.str = new StringObject;
+    x.str->data = std::move(v);
+    x.str->size = x.str->data.size();
+    x.str->charged = StringObject::Bytes(x.str->size);
+    heap.allocations++;
+    return x;
+  }
+  // takes over the reference to s
+  static Value OfString(StringObject *s) { Value x; x.type = ValueType::kString; x.str = s; return x; }
+  // the interned one-character string of c (0..255), or the empty one for -1
+  static Value MakeChar(int c);
+  // lhs.AsString() + rhs.AsString() as a rope
+  static Value Concat(const Value &lhs, const Value &rhs);
+  // n zeros
+  static Value MakeArray(size_t n, ElemKind kind = ElemKind::kValue) {
+    Value x; x.type = ValueType::kArray;
+    x.arr = new ArrayObject;
+    x.arr->kind = kind;
+    x.arr->Resize(n);
+    HeapUsage::Current().allocations++;
+    return x;
+  }
+
+  const std::string &Str() const { return str->Text(); }
+  const ArrayObject &Array() const { return *arr; }
+
+  // Copy-on-write access: detaches from other holders so arrays keep value semantics.
+  ArrayObject &MutableArray() {
+    if (arr->refs > 1) {
+      HeapUsage &heap = HeapUsage::Current();
+      heap.Charge(static_cast<int64_t>(arr->charged));
+      heap.allocations++;
+      ArrayObject *copy = new ArrayObject(*arr);
+      copy->refs = 1;
+      arr->refs--;
+      arr = copy;
+    }
+    return *arr;
+  }
 
   bool IsZero() const {
     switch (type) {
       case ValueType::kInt: return i == 0;
       case ValueType::kDouble: return d == 0.0;
-      case ValueType::kString: return s.empty();
-      case ValueType::kArray: return a.empty();
+      case ValueType::kString: return str->size == 0;
+      case ValueType::kArray: return arr->Size() == 0;
       default: return true;
     }
   }
@@ -36,7 +239,7 @@ struct Value {
     switch (type) {
       case ValueType::kInt: return static_cast<double>(i);
       case ValueType::kDouble: return d;
-      case ValueType::kString: try { return std::stod(s); } catch(...) { return 0.0; }
+      case ValueType::kString: try { return std::stod(str->Text()); } catch(...) { return 0.0; }
       default: return 0.0;
     }
   }
@@ -45,7 +248,7 @@ struct Value {
     switch (type) {
       case ValueType::kInt: return i;
       case ValueType::kDouble: return static_cast<int64_t>(d);
-      case ValueType::kString: try { return std::stoll(s); } catch(...) { return 0; }
+      case ValueType::kString: try { return std::stoll(str->Text()); } catch(...) { return 0; }
       default: return 0;
     }
   }
@@ -56,10 +259,117 @@ struct Value {
       case ValueType::kDouble: {
         std::ostringstream oss; oss << d; return oss.str();
       }
-      case ValueType::kString: return s;
+      case ValueType::kString: return str->Text();
       default: return std::string();
     }
   }
+
+ private:
+  void CopyPayload(const Value &o) { std::memcpy(static_cast<void *>(&i), &o.i, sizeof(i)); }
+
+  void Retain() const {
+    if (type == ValueType::kString) {
+      if (str->refs != StringObject::kImmortal) str->refs++;
+    } else if (type == ValueType::kArray) {
+      arr->refs++;
+    }
+  }
+
+  void Release() {
+    if (type == ValueType::kString) {
+      StringObject::Release(str);
+    } else if (type == ValueType::kArray) {
+      if (--arr->refs == 0) delete arr;
+    }
+  }
 };
 
+static_assert(sizeof(Value) == 16, "Value must stay a 16-byte tagged union");
+
+inline size_t ArrayObject::Size() const {
+  switch (kind) {
+    case ElemKind::kInt: return ints.size();
+    case ElemKind::kDouble: return doubles.size();
+    case ElemKind::kChar: return chars.size();
+    default: return values.size();
+  }
+}
+
+inline Value ArrayObject::Get(size_t i) const {
+  switch (kind) {
+    case ElemKind::kInt: return Value::MakeInt(ints[i]);
+    case ElemKind::kDouble: return IsUnsetDouble(doubles[i]) ? Value::MakeInt(0) : Value::MakeDouble(doubles[i]);
+    case ElemKind::kChar: return Value::MakeInt(chars[i]);
+    default: return values[i];
+  }
+}
+
+inline void ArrayObject::Set(size_t i, Value v) {
+  switch (kind) {
+    case ElemKind::kInt:
+      if (v.type == ValueType::kInt) { ints[i] = v.i; return; }
+      break;
+    case ElemKind::kDouble:
+      if (v.type == ValueType::kDouble) {
+        doubles[i] = IsUnsetDouble(v.d) ? std::numeric_limits<double>::quiet_NaN() : v.d;
+        return;
+      }
+      // ints stay ints, as in a double scalar: 0 has its marker, the rest box
+      if (v.type == ValueType::kInt && v.i == 0) { doubles[i] = std::bit_cast<double>(kUnsetDouble); return; }
+      break;
+    case ElemKind::kChar:
+      if (v.type == ValueType::kInt) { chars[i] = static_cast<int8_t>(v.i); return; }
+      break;
+    default:
+      values[i] = std::move(v);
+      return;
+  }
+  Box();
+  values[i] = std::move(v);
+}
+
+inline size_t ArrayObject::Bytes(size_t n, ElemKind kind) {
+  switch (kind) {
+    case ElemKind::kInt: return sizeof(ArrayObject) + n * sizeof(int64_t);
+    case ElemKind::kDouble: return sizeof(ArrayObject) + n * sizeof(double);
+    case ElemKind::kChar: return sizeof(ArrayObject) + n * sizeof(int8_t);
+    default: return sizeof(ArrayObject) + n * sizeof(Value);
+  }
+}
+
+inline void ArrayObject::Recharge(size_t n, ElemKind to) {
+  size_t bytes = Bytes(n, to);
+  HeapUsage::Current().Charge(static_cast<int64_t>(bytes) - static_cast<int64_t>(charged));
+  charged = bytes;
+}
+
+inline void ArrayObject::Resize(size_t n) {
+  size_t was = Size();
+  Recharge(n, kind);
+  try {
+    switch (kind) {
+      case ElemKind::kInt: ints.resize(n, 0); break;
+      case ElemKind::kDouble: doubles.resize(n, std::bit_cast<double>(kUnsetDouble)); break;
+      case ElemKind::kChar: chars.resize(n, 0); break;
+      default: values.resize(n, Value::MakeInt(0)); break;
+    }
+  } catch (...) {
+    Recharge(was, kind);  // a failed growth leaves the array, and its charge, as they were
+    throw;
+  }
+}
+
+inline void ArrayObject::Box() {
+  if (kind == ElemKind::kValue) return;
+  Recharge(Size(), ElemKind::kValue);
+  std::vector<Value> boxed;
+  boxed.reserve(Size());
+  for (size_t i = 0; i < Size(); ++i) boxed.push_back(Get(i));
+  values = std::move(boxed);
+  ints = {};
+  doubles = {};
+  chars = {};
+  kind = ElemKind::kValue;
+}
+
 #endif  // PETUKH_VALUE_H